@@ -0,0 +1,134 @@
+// Микробенчмарк пробы линии. Каждый поток, как try_start_call, берёт
+// мьютекс случайного болтуна и читает его флаги, а между пробами двигает
+// свой ГПСЧ. Сравниваются плотная раскладка Talker (поля подряд, соседи
+// делят строки кэша) и раскладка по строкам кэша из semaphore_mode.c.
+//
+//   ./probe-bench [потоков=64] [секунд на раскладку=1]
+#include "../src/common.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    pthread_mutex_t mutex;
+    bool active;
+    bool busy;
+    int conversations;
+    Rng rng;
+} PackedTalker;
+
+typedef struct {
+    CACHE_ALIGNED pthread_mutex_t mutex;
+    bool active;
+    bool busy;
+    CACHE_ALIGNED int conversations;
+    Rng rng;
+} AlignedTalker;
+
+typedef struct {
+    int id;
+    int count;
+    unsigned long probes;
+    void *talkers;
+    pthread_barrier_t *start;
+    _Atomic bool *stop;
+} Worker;
+
+// Тело одно для обеих раскладок, отличается только тип записи.
+#define PROBE_LOOP(Type)                                                        \
+    static void *probe_##Type(void *arg) {                                      \
+        Worker *w = (Worker *)arg;                                              \
+        Type *talkers = (Type *)w->talkers;                                     \
+        Type *self = &talkers[w->id];                                           \
+        unsigned long probes = 0;                                               \
+        pthread_barrier_wait(w->start);                                         \
+        while (!atomic_load_explicit(w->stop, memory_order_relaxed)) {          \
+            int target = (int)(((rng_next(&self->rng) >> 32) * (uint64_t)w->count) >> 32); \
+            Type *callee = &talkers[target];                                    \
+            pthread_mutex_lock(&callee->mutex);                                 \
+            if (callee->active && !callee->busy) self->conversations++;         \
+            pthread_mutex_unlock(&callee->mutex);                               \
+            probes++;                                                           \
+        }                                                                       \
+        w->probes = probes;                                                     \
+        return NULL;                                                            \
+    }
+
+PROBE_LOOP(PackedTalker)
+PROBE_LOOP(AlignedTalker)
+
+static double run(const char *name, void *(*fn)(void *), void *talkers, size_t size, size_t threads, int seconds) {
+    for (size_t i = 0; i < threads; ++i) {
+        char *t = (char *)talkers + size * i;
+        pthread_mutex_init((pthread_mutex_t *)t, NULL);
+    }
+    pthread_barrier_t start;
+    pthread_barrier_init(&start, NULL, (unsigned)threads + 1);
+    _Atomic bool stop = false;
+    Worker *workers = calloc(threads, sizeof(Worker));
+    pthread_t *ids = calloc(threads, sizeof(pthread_t));
+    if (!workers || !ids) {
+        perror("calloc");
+        exit(1);
+    }
+    for (size_t i = 0; i < threads; ++i) {
+        workers[i] = (Worker){ .id = (int)i, .count = (int)threads, .talkers = talkers, .start = &start, .stop = &stop };
+        pthread_create(&ids[i], NULL, fn, &workers[i]);
+    }
+
+    struct timespec begin, end;
+    pthread_barrier_wait(&start);
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    struct timespec pause = { .tv_sec = seconds, .tv_nsec = 0 };
+    nanosleep(&pause, NULL);
+    atomic_store(&stop, true);
+    unsigned long probes = 0;
+    for (size_t i = 0; i < threads; ++i) {
+        pthread_join(ids[i], NULL);
+        probes += workers[i].probes;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1e9;
+    double rate = (double)probes / elapsed;
+    printf("%-10s %3zu потоков, запись %3zu байт: %12.0f проб/с\n", name, threads, size, rate);
+
+    pthread_barrier_destroy(&start);
+    free(workers);
+    free(ids);
+    return rate;
+}
+
+static void *make_table(size_t size, int count) {
+    void *table = aligned_alloc(CACHE_LINE, (size * (size_t)count + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE);
+    if (!table) {
+        perror("aligned_alloc");
+        exit(1);
+    }
+    memset(table, 0, size * (size_t)count);
+    return table;
+}
+
+int main(int argc, char **argv) {
+    int threads = argc > 1 ? atoi(argv[1]) : 64;
+    int seconds = argc > 2 ? atoi(argv[2]) : 1;
+    if (threads < 1 || threads > 4096 || seconds < 1) {
+        fprintf(stderr, "Usage: %s [threads] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    PackedTalker *packed = make_table(sizeof(PackedTalker), threads);
+    AlignedTalker *aligned = make_table(sizeof(AlignedTalker), threads);
+    for (int i = 0; i < threads; ++i) {
+        packed[i].active = aligned[i].active = true;
+        rng_seed(&packed[i].rng, 1, (uint64_t)i);
+        rng_seed(&aligned[i].rng, 1, (uint64_t)i);
+    }
+
+    double before = run("плотная", probe_PackedTalker, packed, sizeof(PackedTalker), (size_t)threads, seconds);
+    double after = run("по строкам", probe_AlignedTalker, aligned, sizeof(AlignedTalker), (size_t)threads, seconds);
+    printf("Выигрыш: %.2fx\n", before > 0 ? after / before : 0.0);
+
+    free(packed);
+    free(aligned);
+    return 0;
+}
@@ -0,0 +1,40 @@
+#!/bin/sh
+# Прогон talkers по сетке режимов, числа болтунов и диапазонов пауз/звонков.
+# Каждый запуск дописывает строку итогов в общий CSV (--summary-csv).
+#
+#   BENCH_OUT       файл результатов (outputs/bench.csv)
+#   BENCH_MODES     режимы (semaphore condition futex process des pool epoll coro cluster)
+#   BENCH_TALKERS   числа болтунов (4 16 64)
+#   BENCH_RANGES    диапазоны min_idle:max_idle:min_call:max_call
+#   BENCH_DURATION  длительность одного запуска, с (3)
+#   BENCH_SEED      зерно ГПСЧ (1)
+set -eu
+
+BIN=${BIN:-./talkers}
+OUT=${BENCH_OUT:-outputs/bench.csv}
+MODES=${BENCH_MODES:-"semaphore condition futex process des pool epoll coro cluster"}
+TALKERS=${BENCH_TALKERS:-"4 16 64"}
+RANGES=${BENCH_RANGES:-"200:800:300:1200 10:50:20:100 1:5:1:5"}
+DURATION=${BENCH_DURATION:-3}
+SEED=${BENCH_SEED:-1}
+
+mkdir -p "$(dirname "$OUT")"
+rm -f "$OUT"
+
+for mode in $MODES; do
+    for n in $TALKERS; do
+        for range in $RANGES; do
+            IFS=: read -r min_idle max_idle min_call max_call <<RANGE
+$range
+RANGE
+            echo "bench: mode=$mode talkers=$n idle=$min_idle..$max_idle call=$min_call..$max_call" >&2
+            "$BIN" --mode "$mode" -n "$n" \
+                --min-idle "$min_idle" --max-idle "$max_idle" \
+                --min-call "$min_call" --max-call "$max_call" \
+                --leave-probability 0 --duration "$DURATION" --seed "$SEED" \
+                --output "" --summary-csv "$OUT" > /dev/null
+        done
+    done
+done
+
+echo "bench: результаты в $OUT" >&2
@@ -1,28 +1,80 @@
 #include "src/common.h"
+#include "src/affinity.h"
+#include "src/lock_profile.h"
+#include "src/stop.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 
-int main(int argc, char **argv) {
-    Config config;
-    if (!parse_args(argc, argv, &config)) {
-        return 1;
-    }
-
-    Logger logger;
-    init_logger(&logger, config.output_path);
-    log_message(&logger, "Старт симуляции, режим: %s", config.mode);
+// Прогон с уже открытым логгером; логгер закрывается здесь же.
+static int run_logged(const Config *config, Logger *logger) {
+    stats_start_reporter(logger);
+    live_start_publisher(logger);
+    // в модельном времени производитель обгоняет вывод, терять записи нельзя
+    logger->wait_when_full = strcmp(config->mode, MODE_DES) == 0 || config->replay_path[0];
+    log_event(logger, EVT_START, -1, -1, 0);
+    log_message(logger, "Зерно ГПСЧ: %llu", (unsigned long long)config->seed);
+    stop_watch_start(config, logger);
 
     int rc = 0;
-    if (strcmp(config.mode, MODE_SEMAPHORE) == 0) {
-        rc = run_semaphore_mode(&config, &logger);
+    if (config->replay_path[0]) {
+        rc = run_replay_mode(config, logger);
+    } else if (strcmp(config->mode, MODE_SEMAPHORE) == 0) {
+        rc = run_semaphore_mode(config, logger);
+    } else if (strcmp(config->mode, MODE_CONDITION) == 0) {
+        rc = run_condition_mode(config, logger);
+    } else if (strcmp(config->mode, MODE_FUTEX) == 0) {
+        rc = run_futex_mode(config, logger);
+    } else if (strcmp(config->mode, MODE_PROCESS) == 0) {
+        rc = run_process_mode(config, logger);
+    } else if (strcmp(config->mode, MODE_DES) == 0) {
+        rc = run_des_mode(config, logger);
+    } else if (strcmp(config->mode, MODE_EPOLL) == 0) {
+        rc = run_epoll_mode(config, logger);
+    } else if (strcmp(config->mode, MODE_CORO) == 0) {
+        rc = run_coro_mode(config, logger);
+    } else if (strcmp(config->mode, MODE_CLUSTER) == 0) {
+        rc = run_cluster_mode(config, logger);
     } else {
-        rc = run_condition_mode(&config, &logger);
+        rc = run_pool_mode(config, logger);
     }
+    stop_watch_finish(logger);
+    live_stop_publisher();
+
+    stats_stop_reporter();
+    stats_report(config, logger);
+    lock_profile_report(logger);
+    log_event(logger, EVT_END, -1, rc, 0);
+    close_logger(logger);
+    return rc;
+}
 
-    log_message(&logger, "Завершение симуляции, код %d", rc);
-    close_logger(&logger);
+int run_scenario(const Config *config) {
+    affinity_init(config);
+    stats_init(config);
+    // отказ на любом шаге разматывает сделанное в обратном порядке: снимок
+    // помечается законченным (иначе talkers-top ждал бы вечно), общая память
+    // профиля и статистики освобождается
+    int rc = 1;
+    if (lock_profile_init(config) && live_init(config)) {
+        Logger logger;
+        if (init_logger(&logger, config)) rc = run_logged(config, &logger);
+        live_stop_publisher();
+    }
+    lock_profile_shutdown();
+    stats_shutdown();
     return rc;
 }
 
+int main(int argc, char **argv) {
+    if (sweep_requested(argc, argv)) {
+        return run_sweep(argc, argv);
+    }
+    Config config;
+    if (!parse_args(argc, argv, &config)) {
+        return 1;
+    }
+    return run_scenario(&config);
+}
+
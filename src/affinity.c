@@ -0,0 +1,75 @@
+#define _GNU_SOURCE // pthread_setaffinity_np
+
+#include "affinity.h"
+
+#include <ctype.h>
+#include <sched.h>
+#include <stdlib.h>
+
+static int cpus[CPU_SETSIZE];
+static int cpu_count;
+static _Atomic bool pin_warned;
+
+// "0-3,8,10-11" → список номеров ядер; -1 — ошибка разбора.
+int cpu_list_parse(const char *spec, int *out, int max) {
+    int count = 0;
+    const char *p = spec;
+    while (*p) {
+        if (!isdigit((unsigned char)*p)) return -1;
+        char *end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            ++p;
+            if (!isdigit((unsigned char)*p)) return -1;
+            last = strtol(p, &end, 10);
+            p = end;
+        }
+        if (first > last || last >= CPU_SETSIZE) return -1;
+        for (long cpu = first; cpu <= last; ++cpu) {
+            if (count >= max) return -1;
+            if (out) out[count] = (int)cpu;
+            count++;
+        }
+        if (*p == ',') {
+            ++p;
+            if (!*p) return -1;
+        } else if (*p) {
+            return -1;
+        }
+    }
+    return count;
+}
+
+bool affinity_init(const Config *config) {
+    cpu_count = 0;
+    if (!config->cpus[0]) return true;
+    int n = cpu_list_parse(config->cpus, cpus, CPU_SETSIZE);
+    if (n < 0) return false;
+    cpu_count = n;
+    return true;
+}
+
+static bool pin(int slot) {
+    if (cpu_count == 0) return true;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpus[slot % cpu_count], &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0) return true;
+    if (!atomic_exchange(&pin_warned, true)) {
+        fprintf(stderr, "Не удалось привязать поток к ядру %d\n", cpus[slot % cpu_count]);
+    }
+    return false;
+}
+
+// Поток пула (pool, epoll, coro) i — на i-е ядро списка по кругу.
+bool affinity_pin_worker(int worker) {
+    return pin(worker);
+}
+
+// Поток болтуна — на ядро своего шарда; без шардов — по кругу.
+bool affinity_pin_talker(const Config *config, int talker) {
+    int slot = config->shards > 1 ? shard_of(talker, config->talkers, config->shards) : talker;
+    return pin(slot);
+}
@@ -0,0 +1,22 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include "common.h"
+
+// Привязка потоков к ядрам (--cpus) и разбиение болтунов на шарды
+// (--shards). Шард — непрерывный диапазон номеров: так он занимает
+// соседние слова индекса свободных линий и соседние записи таблиц.
+static inline int shard_of(int talker, int count, int shards) {
+    return (int)(((int64_t)(talker + 1) * shards - 1) / count);
+}
+
+static inline int shard_begin(int shard, int count, int shards) {
+    return (int)((int64_t)shard * count / shards);
+}
+
+int cpu_list_parse(const char *spec, int *out, int max);
+bool affinity_init(const Config *config);
+bool affinity_pin_worker(int worker);
+bool affinity_pin_talker(const Config *config, int talker);
+
+#endif // AFFINITY_H
@@ -0,0 +1,111 @@
+#include "call_queue.h"
+#include "futex.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+bool call_queue_init(CallQueue *queue, int capacity) {
+    uint32_t size = 1;
+    while (size < (uint32_t)capacity) size <<= 1;
+    queue->slots = calloc(size, sizeof(CallSlot));
+    if (!queue->slots) return false;
+    queue->mask = size - 1;
+    for (uint32_t i = 0; i < size; ++i) atomic_init(&queue->slots[i].seq, i);
+    atomic_init(&queue->tail, 0);
+    atomic_init(&queue->head, 0);
+    return true;
+}
+
+void call_queue_destroy(CallQueue *queue) {
+    free(queue->slots);
+    queue->slots = NULL;
+}
+
+// Ячейка свободна для позиции pos, когда её номер равен pos; номер меньше —
+// владелец ещё не забрал запись круг назад, очередь полна.
+bool call_queue_push(CallQueue *queue, int caller, uint32_t ticket, uint32_t *depth) {
+    uint32_t pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    CallSlot *slot;
+    for (;;) {
+        slot = &queue->slots[pos & queue->mask];
+        int32_t diff = (int32_t)(atomic_load_explicit(&slot->seq, memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+    slot->caller = caller;
+    slot->ticket = ticket;
+    // seq_cst: с записью линии адресатом и её проверкой звонящим это пара
+    // Деккера, одна из сторон обязательно увидит другую
+    atomic_store(&slot->seq, pos + 1);
+    if (depth) *depth = pos + 1 - atomic_load_explicit(&queue->head, memory_order_relaxed);
+    return true;
+}
+
+bool call_queue_pop(CallQueue *queue, int *caller, uint32_t *ticket) {
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    CallSlot *slot = &queue->slots[head & queue->mask];
+    if ((int32_t)(atomic_load(&slot->seq) - (head + 1)) < 0) return false;
+    *caller = slot->caller;
+    *ticket = slot->ticket;
+    atomic_store_explicit(&slot->seq, head + queue->mask + 1, memory_order_release);
+    atomic_store_explicit(&queue->head, head + 1, memory_order_relaxed);
+    return true;
+}
+
+bool call_queue_empty(CallQueue *queue) {
+    uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    return (int32_t)(atomic_load(&queue->slots[head & queue->mask].seq) - (head + 1)) < 0;
+}
+
+// Начать новое ожидание может только сам звонящий, и только когда прежнее
+// уже решено, так что простая запись не гонится с CAS-ами адресатов.
+uint32_t call_wait_begin(CallWaiter *waiter) {
+    uint32_t ticket = (atomic_load(waiter) >> 2) + 1;
+    atomic_store(waiter, ticket << 2 | WAIT_PARKED);
+    return ticket;
+}
+
+bool call_wait_resolve(CallWaiter *waiter, uint32_t ticket, unsigned state) {
+    uint32_t parked = ticket << 2 | WAIT_PARKED;
+    if (!atomic_compare_exchange_strong(waiter, &parked, ticket << 2 | state)) return false;
+    futex_wake(waiter, 1);
+    return true;
+}
+
+// Снять текущее ожидание, каким бы ни был его номер (остановка прогона).
+void call_wait_drop(CallWaiter *waiter) {
+    uint32_t word = atomic_load(waiter);
+    if ((word & 3u) == WAIT_PARKED) call_wait_resolve(waiter, word >> 2, WAIT_DROPPED);
+}
+
+// Ждёт решения адресата; по тайм-ауту снимает ожидание сам. Если адресат
+// успел раньше, побеждает его ответ.
+unsigned call_wait_park(CallWaiter *waiter, uint32_t ticket, int timeout_ms) {
+    uint32_t parked = ticket << 2 | WAIT_PARKED;
+    struct timespec now, until;
+    clock_gettime(CLOCK_MONOTONIC, &until);
+    until.tv_sec += timeout_ms / 1000;
+    until.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_nsec -= 1000000000L;
+        until.tv_sec += 1;
+    }
+    while (atomic_load(waiter) == parked) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        long long ns = (long long)(until.tv_sec - now.tv_sec) * 1000000000LL + (until.tv_nsec - now.tv_nsec);
+        if (ns <= 0) {
+            call_wait_resolve(waiter, ticket, WAIT_DROPPED);
+            break;
+        }
+        futex_wait(waiter, parked, (long)((ns + 999999) / 1000000));
+    }
+    return atomic_load(waiter) & 3u;
+}
@@ -0,0 +1,50 @@
+#ifndef CALL_QUEUE_H
+#define CALL_QUEUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Ожидание вызова (--call-waiting). Звонящий, застав линию занятой, встаёт
+// в ограниченную очередь адресата и паркуется на своём слове ожидания, а не
+// перебирает другие номера. Освободившийся адресат придерживает линию для
+// первого ещё ждущего. Очередь — кольцо Вьюкова: у каждой ячейки свой
+// порядковый номер, звонящие занимают ячейку CAS-ом хвоста, читает только
+// владелец. Блокировок нет ни с одной стороны.
+typedef struct {
+    _Atomic uint32_t seq;
+    int caller;
+    uint32_t ticket;
+} CallSlot;
+
+typedef struct {
+    CallSlot *slots;
+    uint32_t mask;
+    _Atomic uint32_t tail;
+    _Atomic uint32_t head; // пишет только владелец, звонящие читают для глубины
+} CallQueue;
+
+// Слово ожидания звонящего (futex): биты 0-1 — состояние, выше — номер
+// ожидания. Номер не даёт устаревшей записи в чужой очереди разбудить
+// следующее ожидание того же звонящего.
+enum {
+    WAIT_IDLE = 0,
+    WAIT_PARKED = 1,
+    WAIT_OFFERED = 2, // адресат придержал линию: можно звонить
+    WAIT_DROPPED = 3, // тайм-аут, уход адресата или остановка
+};
+
+typedef _Atomic uint32_t CallWaiter;
+
+bool call_queue_init(CallQueue *queue, int capacity);
+void call_queue_destroy(CallQueue *queue);
+bool call_queue_push(CallQueue *queue, int caller, uint32_t ticket, uint32_t *depth);
+bool call_queue_pop(CallQueue *queue, int *caller, uint32_t *ticket);
+bool call_queue_empty(CallQueue *queue);
+
+uint32_t call_wait_begin(CallWaiter *waiter);
+unsigned call_wait_park(CallWaiter *waiter, uint32_t ticket, int timeout_ms);
+bool call_wait_resolve(CallWaiter *waiter, uint32_t ticket, unsigned state);
+void call_wait_drop(CallWaiter *waiter);
+
+#endif // CALL_QUEUE_H
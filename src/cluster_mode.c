@@ -0,0 +1,713 @@
+#define _GNU_SOURCE // eventfd, epoll, SOCK_NONBLOCK
+
+#include "common.h"
+#include "affinity.h"
+#include "event_queue.h"
+#include "idle_index.h"
+#include "stop.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Кластер из процессов-узлов на одной машине. Узел k владеет непрерывным
+// диапазоном номеров болтунов (как шард) и один ведёт их автоматы в цикле
+// epoll. Общей памяти у узлов нет: набор, ответ и отбой болтуну чужого узла
+// уходят сообщением по сокету Unix (SOCK_SEQPACKET, пара на каждую пару
+// узлов). Сообщения копятся за такт цикла и уходят одной пачкой на узел.
+// Родитель — координатор: сводит число болтунов в сети, пишет уходы,
+// рассылает их узлам и по уходу последнего останавливает узлы.
+#define DIAL_ATTEMPTS 16 // наборов подряд, пока не найдётся свободная линия
+#define BATCH_MAX 1024   // сообщений в одной пачке
+#define REDIAL_MS 5      // пауза перед новым набором после «занято»
+#define PICK_TRIES 4     // случайных проб адресата до обхода по порядку
+
+enum {
+    MSG_DIAL = 1, // from звонит to, arg — длительность разговора
+    MSG_RING,     // линия to свободна, звонит
+    MSG_BUSY,     // линия to занята
+    MSG_ANSWER,   // to ответил, arg — длительность
+    MSG_HANGUP,   // to положил трубку
+    MSG_LEFT,     // узел → координатор: from ушёл
+    MSG_STOP,     // координатор → узлы
+    MSG_DEPARTED, // координатор → остальные узлы: from ушёл, не звонить ему
+};
+
+typedef struct {
+    uint32_t type;
+    int32_t from;
+    int32_t to;
+    int32_t arg;
+} Msg;
+
+typedef struct {
+    Msg *items;
+    size_t count;
+    size_t capacity;
+    int fd; // -1 — своя очередь: сообщения себе не уходят в сокет
+} Outbox;
+
+enum { CL_IDLE, CL_BUSY, CL_RINGING, CL_LEFT };
+enum { CL_WAKE, CL_CALL_END, CL_REDIAL };
+
+typedef struct {
+    int state;
+    int peer;
+    int duration_ms;
+    int call_ms; // длительность, предложенная в текущем наборе
+    int attempts;
+    int conversations;
+    int64_t dial_sent_ns;
+    Rng rng;
+} ClusterTalker;
+
+// Счётчики узла лежат в общей анонимной памяти: их читает координатор
+// после завершения узла. Каждый узел пишет только свою запись.
+typedef struct {
+    CACHE_ALIGNED unsigned long sent;    // сообщений другим узлам
+    unsigned long batches;               // пачек (вызовов send) другим узлам
+    unsigned long dials_remote;
+    unsigned long dials_local;
+    unsigned long calls_remote;          // разговоров с болтуном другого узла
+    unsigned long calls_local;
+    unsigned long events;
+    int64_t reply_remote_ns;             // от набора до ответа «звонит/занято»
+    int64_t reply_local_ns;
+} NodeCounters;
+
+typedef struct {
+    const Config *config;
+    Logger *logger;
+    int id;
+    int nodes;
+    int first;
+    int count;
+    ClusterTalker *talkers; // talkers[i - first]
+    IdleIndex idle;         // свободные болтуны узла, биты по i - first
+    uint64_t *departed;     // ушедшие болтуны сети: свои и по рассылке координатора
+    int alive;              // не ушедших по сведениям узла
+    EventQueue calendar;
+    int epoll_fd;
+    int wake_fd;
+    Outbox *out;  // [nodes] — узлам, [nodes] — координатору
+    NodeCounters *counters;
+    long deadline_ms;
+    bool stopping;
+    bool out_of_memory;
+} Node;
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int node_of(const Node *node, int talker) {
+    return shard_of(talker, node->config->talkers, node->nodes);
+}
+
+static bool outbox_push(Outbox *box, Msg msg) {
+    if (box->count == box->capacity) {
+        size_t capacity = box->capacity ? box->capacity * 2 : 64;
+        Msg *items = realloc(box->items, capacity * sizeof(Msg));
+        if (!items) return false;
+        box->items = items;
+        box->capacity = capacity;
+    }
+    box->items[box->count++] = msg;
+    return true;
+}
+
+// Отправляет пачками до BATCH_MAX. Что не влезло в буфер сокета (EAGAIN),
+// остаётся до следующего такта; у закрытого сокета очередь сбрасывается.
+static void outbox_flush(Outbox *box, NodeCounters *counters) {
+    size_t done = 0;
+    while (box->fd >= 0 && done < box->count) {
+        size_t chunk = box->count - done < BATCH_MAX ? box->count - done : BATCH_MAX;
+        ssize_t n = send(box->fd, box->items + done, chunk * sizeof(Msg), MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (n < 0) {
+            box->fd = -1;
+            break;
+        }
+        if (counters) {
+            counters->sent += chunk;
+            counters->batches++;
+        }
+        done += chunk;
+    }
+    if (box->fd < 0) done = box->count;
+    memmove(box->items, box->items + done, (box->count - done) * sizeof(Msg));
+    box->count -= done;
+}
+
+static void post(Node *node, int to_node, uint32_t type, int from, int to, int arg) {
+    Msg msg = { .type = type, .from = from, .to = to, .arg = arg };
+    if (!outbox_push(&node->out[to_node], msg)) {
+        node->out_of_memory = true;
+        node->stopping = true;
+    }
+}
+
+static ClusterTalker *local(Node *node, int talker) {
+    return &node->talkers[talker - node->first];
+}
+
+// Состояние своего болтуна меняется только здесь: индекс свободных
+// узла следует за ним.
+static void set_state(Node *node, ClusterTalker *self, int talker, int state) {
+    self->state = state;
+    if (state == CL_IDLE) {
+        idle_index_set(&node->idle, talker - node->first);
+    } else {
+        idle_index_clear(&node->idle, talker - node->first);
+    }
+}
+
+static bool is_departed(const Node *node, int talker) {
+    return node->departed[talker / 64] & (1ull << (talker & 63));
+}
+
+static void mark_departed(Node *node, int talker) {
+    if (is_departed(node, talker)) return;
+    node->departed[talker / 64] |= 1ull << (talker & 63);
+    node->alive--;
+}
+
+// Случайный неушедший болтун всей сети, кроме звонящего; -1 — никого.
+// Сначала несколько случайных проб, затем обход: к концу прогона ушедших
+// становится большинство.
+static int pick_peer(Node *node, Rng *rng, int self) {
+    int total = node->config->talkers;
+    if (node->alive <= 1) return -1;
+    for (int i = 0; i < PICK_TRIES; ++i) {
+        int target = random_range(rng, 0, total - 2);
+        if (target >= self) target++;
+        if (!is_departed(node, target)) return target;
+    }
+    int start = random_range(rng, 0, total - 1);
+    for (int i = 0; i < total; ++i) {
+        int target = (start + i) % total;
+        if (target != self && !is_departed(node, target)) return target;
+    }
+    return -1;
+}
+
+static void schedule(Node *node, int talker, long at_ms, int kind) {
+    if (!event_queue_push(&node->calendar, at_ms, talker, kind)) {
+        node->out_of_memory = true;
+        node->stopping = true;
+    }
+}
+
+static bool should_stop(const Node *node, long now) {
+    if (node->stopping || stop_requested()) return true;
+    return node->deadline_ms >= 0 && now >= node->deadline_ms;
+}
+
+static void after_action(Node *node, ClusterTalker *self, int id, long now) {
+    const Config *cfg = node->config;
+    bool leave = (cfg->stop_after_calls > 0 && self->conversations >= cfg->stop_after_calls)
+        || random_chance(&self->rng, cfg->leave_probability);
+    if (leave) {
+        // уход пишет координатор: только он знает, сколько осталось в сети
+        set_state(node, self, id, CL_LEFT);
+        mark_departed(node, id);
+        post(node, node->nodes, MSG_LEFT, id, -1, 0);
+        return;
+    }
+    int pause_ms = random_range(&self->rng, cfg->min_idle_ms, cfg->max_idle_ms);
+    stats_on_idle((int64_t)pause_ms * 1000);
+    schedule(node, id, now + pause_ms, CL_WAKE);
+}
+
+// Очередной набор: адресат случайный по всей сети, кроме известных ушедших.
+// С долей --cluster-local набор сначала ищет свободного болтуна своего узла:
+// его линии узел видит сам.
+static void dial_next(Node *node, ClusterTalker *self, int id, long now) {
+    const Config *cfg = node->config;
+    int target = -1;
+    if (self->attempts < DIAL_ATTEMPTS && !should_stop(node, now)) {
+        if (cfg->cluster_local > 0.0 && random_chance(&self->rng, cfg->cluster_local)) {
+            int slot = idle_index_pick(&node->idle, &self->rng, id - node->first);
+            if (slot >= 0) target = node->first + slot;
+        }
+        if (target < 0) target = pick_peer(node, &self->rng, id);
+    }
+    if (target < 0) {
+        set_state(node, self, id, CL_IDLE);
+        after_action(node, self, id, now);
+        return;
+    }
+    self->attempts++;
+    int owner = node_of(node, target);
+    if (owner == node->id) {
+        node->counters->dials_local++;
+    } else {
+        node->counters->dials_remote++;
+    }
+    self->dial_sent_ns = now_ns();
+    post(node, owner, MSG_DIAL, id, target, self->call_ms);
+}
+
+// После «занято» новый набор идёт событием календаря, а не в том же такте:
+// иначе все попытки уходят разом, пока адресаты ещё заняты. До него линия
+// свободна, и входящий звонок ждёт ответа в on_redial.
+static void redial_later(Node *node, ClusterTalker *self, int id, long now) {
+    if (self->attempts >= DIAL_ATTEMPTS || should_stop(node, now)) {
+        dial_next(node, self, id, now);
+        return;
+    }
+    set_state(node, self, id, CL_IDLE);
+    int delay = node->config->min_idle_ms < REDIAL_MS ? node->config->min_idle_ms : REDIAL_MS;
+    schedule(node, id, now + delay, CL_REDIAL);
+}
+
+static void answer(Node *node, ClusterTalker *self, int id, long now) {
+    int caller = self->peer;
+    int duration = self->duration_ms;
+    set_state(node, self, id, CL_BUSY);
+    log_event_at(node->logger, now, EVT_ANSWER, id, caller, 0);
+    log_event_at(node->logger, now, EVT_TALK, caller, id, duration);
+    log_event_at(node->logger, now, EVT_TALK, caller, id, duration);
+    post(node, node_of(node, caller), MSG_ANSWER, id, caller, duration);
+    schedule(node, id, now + duration, CL_CALL_END);
+}
+
+static void on_wake(Node *node, int id, long now) {
+    ClusterTalker *self = local(node, id);
+    if (self->state == CL_RINGING) {
+        answer(node, self, id, now);
+        return;
+    }
+    if (random_range(&self->rng, 0, 1) == 0 || node->config->talkers < 2) {
+        // ждём входящих
+        after_action(node, self, id, now);
+        return;
+    }
+    self->call_ms = random_range(&self->rng, node->config->min_call_ms, node->config->max_call_ms);
+    set_state(node, self, id, CL_BUSY);
+    self->attempts = 0;
+    dial_next(node, self, id, now);
+}
+
+static void on_redial(Node *node, int id, long now) {
+    ClusterTalker *self = local(node, id);
+    if (self->state == CL_RINGING) {
+        answer(node, self, id, now);
+        return;
+    }
+    set_state(node, self, id, CL_BUSY);
+    dial_next(node, self, id, now);
+}
+
+// Отбой шлёт отвечавший: его таймер отмеряет разговор за обоих.
+static void on_call_end(Node *node, int id, long now) {
+    ClusterTalker *self = local(node, id);
+    log_event_at(node->logger, now, EVT_FINISH, id, self->peer, self->duration_ms);
+    post(node, node_of(node, self->peer), MSG_HANGUP, id, self->peer, 0);
+    set_state(node, self, id, CL_IDLE);
+    self->conversations++;
+    after_action(node, self, id, now);
+}
+
+static void note_reply(Node *node, ClusterTalker *self, int from) {
+    int64_t waited = now_ns() - self->dial_sent_ns;
+    if (node_of(node, from) == node->id) {
+        node->counters->reply_local_ns += waited;
+    } else {
+        node->counters->reply_remote_ns += waited;
+    }
+}
+
+static void handle(Node *node, const Msg *msg, long now) {
+    if (msg->type == MSG_STOP) {
+        node->stopping = true;
+        return;
+    }
+    if (msg->type == MSG_DEPARTED) {
+        if (msg->from >= 0 && msg->from < node->config->talkers) mark_departed(node, msg->from);
+        return;
+    }
+    if (msg->to < node->first || msg->to >= node->first + node->count) return;
+    ClusterTalker *self = local(node, msg->to);
+    switch (msg->type) {
+    case MSG_DIAL:
+        // набор и занятость пишет узел адресата: линию захватывает он
+        if (self->state == CL_IDLE) {
+            set_state(node, self, msg->to, CL_RINGING);
+            self->peer = msg->from;
+            self->duration_ms = msg->arg;
+            log_event_at(node->logger, now, EVT_DIAL, msg->from, msg->to, 0);
+            post(node, node_of(node, msg->from), MSG_RING, msg->to, msg->from, 0);
+        } else {
+            log_event_at(node->logger, now, EVT_BUSY, msg->from, msg->to, 0);
+            post(node, node_of(node, msg->from), MSG_BUSY, msg->to, msg->from, 0);
+        }
+        break;
+    case MSG_RING:
+        note_reply(node, self, msg->from);
+        break;
+    case MSG_BUSY:
+        note_reply(node, self, msg->from);
+        redial_later(node, self, msg->to, now);
+        break;
+    case MSG_ANSWER:
+        self->peer = msg->from;
+        self->duration_ms = msg->arg;
+        if (node_of(node, msg->from) == node->id) {
+            node->counters->calls_local++;
+        } else {
+            node->counters->calls_remote++;
+        }
+        break;
+    case MSG_HANGUP:
+        log_event_at(node->logger, now, EVT_FINISH, msg->to, msg->from, self->duration_ms);
+        set_state(node, self, msg->to, CL_IDLE);
+        self->conversations++;
+        after_action(node, self, msg->to, now);
+        break;
+    default:
+        break;
+    }
+}
+
+// Сообщения болтунам своего узла не ходят через сокет, но идут той же
+// очередью: обработка не уходит в рекурсию набор → занято → набор.
+static void drain_self(Node *node, long now) {
+    Outbox *self = &node->out[node->id];
+    for (size_t i = 0; i < self->count && !node->stopping; ++i) {
+        Msg msg = self->items[i]; // handle дописывает в ту же очередь, items может переехать
+        handle(node, &msg, now);
+    }
+    self->count = 0;
+}
+
+// false — сокет закрыт с той стороны.
+static bool receive(Node *node, int fd, long now) {
+    Msg batch[BATCH_MAX];
+    for (;;) {
+        ssize_t n = recv(fd, batch, sizeof(batch), MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return errno == EAGAIN || errno == EWOULDBLOCK;
+        if (n == 0) return false;
+        size_t count = (size_t)n / sizeof(Msg);
+        for (size_t i = 0; i < count; ++i) handle(node, &batch[i], now);
+    }
+}
+
+static bool flush_all(Node *node) {
+    bool pending = false;
+    for (int k = 0; k <= node->nodes; ++k) {
+        if (k == node->id) continue;
+        outbox_flush(&node->out[k], k < node->nodes ? node->counters : NULL);
+        pending |= node->out[k].count > 0;
+    }
+    return pending;
+}
+
+static void wake_node(void *arg) {
+    uint64_t one = 1;
+    while (write(((Node *)arg)->wake_fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+static void run_node(Node *node) {
+    const Config *cfg = node->config;
+    long now = elapsed_ms_since(node->logger);
+    for (int i = node->first; i < node->first + node->count; ++i) {
+        ClusterTalker *t = local(node, i);
+        t->peer = -1;
+        rng_seed(&t->rng, cfg->seed, (uint64_t)i);
+        set_state(node, t, i, CL_IDLE);
+        log_event_at(node->logger, now, EVT_CONNECT, i, -1, 0);
+        schedule(node, i, now + random_range(&t->rng, cfg->min_idle_ms, cfg->max_idle_ms), CL_WAKE);
+    }
+
+    bool pending = false;
+    while (!should_stop(node, now = elapsed_ms_since(node->logger))) {
+        SimEvent ev;
+        const SimEvent *top;
+        while (!node->stopping && (top = event_queue_peek(&node->calendar)) && top->at_ms <= now) {
+            event_queue_pop(&node->calendar, &ev);
+            node->counters->events++;
+            if (ev.kind == CL_CALL_END) {
+                on_call_end(node, ev.talker, now);
+            } else if (ev.kind == CL_REDIAL) {
+                on_redial(node, ev.talker, now);
+            } else {
+                on_wake(node, ev.talker, now);
+            }
+            drain_self(node, now);
+        }
+        pending = flush_all(node);
+
+        // до ближайшего события или дедлайна; неушедшие пачки — через 1 мс
+        top = event_queue_peek(&node->calendar);
+        long wake_at = top ? top->at_ms : -1;
+        if (node->deadline_ms >= 0 && (wake_at < 0 || wake_at > node->deadline_ms)) wake_at = node->deadline_ms;
+        int timeout = wake_at < 0 ? -1 : (int)(wake_at > now ? wake_at - now : 0);
+        if (pending && (timeout < 0 || timeout > 1)) timeout = 1;
+
+        struct epoll_event events[16];
+        int n = epoll_wait(node->epoll_fd, events, 16, timeout);
+        now = elapsed_ms_since(node->logger);
+        for (int i = 0; i < n; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == node->wake_fd) {
+                uint64_t count;
+                while (read(fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+                }
+            } else if (!receive(node, fd, now)) {
+                epoll_ctl(node->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+                if (fd == node->out[node->nodes].fd) node->stopping = true;
+            }
+        }
+        drain_self(node, now);
+        flush_all(node);
+    }
+}
+
+// Узел k: fds[k][j] — сокет к узлу j, fds[k][nodes] — к координатору.
+static int node_main(const Config *config, Logger *logger, int k, int nodes, int (*fds)[MAX_CLUSTER_NODES + 1],
+                     NodeCounters *counters) {
+    Node node = {
+        .config = config,
+        .logger = logger,
+        .id = k,
+        .nodes = nodes,
+        .first = shard_begin(k, config->talkers, nodes),
+        .counters = &counters[k],
+        .deadline_ms = config->duration_seconds > 0 ? config->duration_seconds * 1000L : -1,
+    };
+    node.count = shard_begin(k + 1, config->talkers, nodes) - node.first;
+    node.alive = config->talkers;
+    node.talkers = calloc((size_t)node.count, sizeof(ClusterTalker));
+    node.departed = calloc(((size_t)config->talkers + 63) / 64, sizeof(uint64_t));
+    node.out = calloc((size_t)nodes + 1, sizeof(Outbox));
+    node.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    node.wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (!node.talkers || !node.departed || !node.out || !idle_index_init(&node.idle, node.count)
+        || !event_queue_init(&node.calendar, (size_t)node.count * 2) || node.epoll_fd < 0 || node.wake_fd < 0) {
+        fprintf(stderr, "Узел %d: недостаточно ресурсов\n", k);
+        return 1;
+    }
+    struct epoll_event ev = { .events = EPOLLIN };
+    for (int j = 0; j <= nodes; ++j) {
+        node.out[j].fd = j == k ? -1 : fds[k][j];
+        if (j == k) continue;
+        ev.data.fd = fds[k][j];
+        epoll_ctl(node.epoll_fd, EPOLL_CTL_ADD, fds[k][j], &ev);
+    }
+    ev.data.fd = node.wake_fd;
+    epoll_ctl(node.epoll_fd, EPOLL_CTL_ADD, node.wake_fd, &ev);
+
+    stop_watch_add(wake_node, &node);
+    run_node(&node);
+    stop_watch_remove(wake_node, &node);
+    if (node.out_of_memory) fprintf(stderr, "Узел %d: недостаточно памяти для очередей\n", k);
+    return node.out_of_memory ? 1 : 0;
+}
+
+typedef struct {
+    const pid_t *pids;
+    int count;
+} Nodes;
+
+// Сигнал мог прийти одному координатору, а дедлайн у узлов свой.
+static void forward_stop(void *arg) {
+    Nodes *n = (Nodes *)arg;
+    for (int k = 0; k < n->count; ++k) {
+        if (n->pids[k] > 0) kill(n->pids[k], SIGINT);
+    }
+}
+
+// Координатор ждёт уходы, пока все узлы не закроют сокеты.
+static void coordinate(const Config *config, Logger *logger, int nodes, int *fds) {
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev = { .events = EPOLLIN };
+    Outbox out[MAX_CLUSTER_NODES];
+    for (int k = 0; k < nodes; ++k) {
+        out[k] = (Outbox){ .fd = fds[k] };
+        ev.data.u32 = (uint32_t)k;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fds[k], &ev);
+    }
+
+    int active = config->talkers;
+    int open = nodes;
+    bool pending = false;
+    Msg batch[BATCH_MAX];
+    while (open > 0) {
+        struct epoll_event events[MAX_CLUSTER_NODES];
+        int n = epoll_wait(epoll_fd, events, MAX_CLUSTER_NODES, pending ? 1 : -1);
+        for (int i = 0; i < n; ++i) {
+            int k = (int)events[i].data.u32;
+            for (;;) {
+                ssize_t got = recv(fds[k], batch, sizeof(batch), MSG_DONTWAIT);
+                if (got < 0 && errno == EINTR) continue;
+                if (got <= 0) {
+                    if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fds[k], NULL);
+                        out[k].fd = -1;
+                        open--;
+                    }
+                    break;
+                }
+                for (size_t m = 0; m < (size_t)got / sizeof(Msg); ++m) {
+                    if (batch[m].type != MSG_LEFT) continue;
+                    log_event(logger, EVT_LEAVE, batch[m].from, --active, 0);
+                    // узел ушедшего знает сам, остальные перестают ему звонить
+                    for (int j = 0; j < nodes; ++j) {
+                        if (j == k) continue;
+                        outbox_push(&out[j], (Msg){ .type = MSG_DEPARTED, .from = batch[m].from, .to = -1 });
+                    }
+                    if (active > 0) continue;
+                    log_event(logger, EVT_LAST, -1, -1, 0);
+                    for (int j = 0; j < nodes; ++j) outbox_push(&out[j], (Msg){ .type = MSG_STOP });
+                }
+            }
+        }
+        pending = false;
+        for (int k = 0; k < nodes; ++k) {
+            outbox_flush(&out[k], NULL);
+            pending |= out[k].count > 0;
+        }
+    }
+    for (int k = 0; k < nodes; ++k) free(out[k].items);
+    close(epoll_fd);
+}
+
+static void report(Logger *logger, int nodes, const NodeCounters *counters) {
+    NodeCounters sum = {0};
+    for (int k = 0; k < nodes; ++k) {
+        sum.sent += counters[k].sent;
+        sum.batches += counters[k].batches;
+        sum.dials_remote += counters[k].dials_remote;
+        sum.dials_local += counters[k].dials_local;
+        sum.calls_remote += counters[k].calls_remote;
+        sum.calls_local += counters[k].calls_local;
+        sum.events += counters[k].events;
+        sum.reply_remote_ns += counters[k].reply_remote_ns;
+        sum.reply_local_ns += counters[k].reply_local_ns;
+    }
+    unsigned long calls = sum.calls_remote + sum.calls_local;
+    log_message(logger, "Кластер: узлов %d, событий %lu, разговоров между узлами %lu из %lu (%.1f%%)", nodes,
+                sum.events, sum.calls_remote, calls, calls ? 100.0 * (double)sum.calls_remote / (double)calls : 0.0);
+    log_message(logger, "Сообщений между узлами %lu в %lu пачках (%.1f в пачке), %.1f на межузловой разговор",
+                sum.sent, sum.batches, sum.batches ? (double)sum.sent / (double)sum.batches : 0.0,
+                sum.calls_remote ? (double)sum.sent / (double)sum.calls_remote : 0.0);
+    log_message(logger, "Ответ на набор: с другого узла %.1f мкс, внутри узла %.1f мкс",
+                sum.dials_remote ? (double)sum.reply_remote_ns / 1e3 / (double)sum.dials_remote : 0.0,
+                sum.dials_local ? (double)sum.reply_local_ns / 1e3 / (double)sum.dials_local : 0.0);
+}
+
+int run_cluster_mode(const Config *config, Logger *logger) {
+    int nodes = config->processes;
+    size_t counters_bytes = (size_t)nodes * sizeof(NodeCounters);
+    NodeCounters *counters = mmap(NULL, counters_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (counters == MAP_FAILED) {
+        perror("mmap cluster counters");
+        return 1;
+    }
+
+    // fds[k][j] — конец пары k↔j у узла k; fds[k][nodes] — у узла к координатору,
+    // coord[k] — у координатора к узлу k
+    static int fds[MAX_CLUSTER_NODES][MAX_CLUSTER_NODES + 1];
+    int coord[MAX_CLUSTER_NODES];
+    for (int k = 0; k < nodes; ++k) {
+        coord[k] = -1;
+        for (int j = 0; j <= nodes; ++j) fds[k][j] = -1;
+    }
+    int rc = 0;
+    for (int k = 0; k < nodes && rc == 0; ++k) {
+        for (int j = k; j <= nodes && rc == 0; ++j) {
+            int pair[2];
+            if (j == k) continue;
+            if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, pair) < 0) {
+                perror("socketpair");
+                rc = 1;
+                break;
+            }
+            fds[k][j] = pair[0];
+            if (j < nodes) {
+                fds[j][k] = pair[1];
+            } else {
+                coord[k] = pair[1];
+            }
+        }
+    }
+    if (rc != 0) {
+        for (int k = 0; k < nodes; ++k) {
+            if (coord[k] >= 0) close(coord[k]);
+            for (int j = 0; j <= nodes; ++j) {
+                if (fds[k][j] >= 0) close(fds[k][j]);
+            }
+        }
+        munmap(counters, counters_bytes);
+        return rc;
+    }
+
+    log_message(logger, "Узлов кластера: %d", nodes);
+    pid_t pids[MAX_CLUSTER_NODES];
+    for (int k = 0; k < nodes; ++k) {
+        pids[k] = fork();
+        if (pids[k] == 0) {
+            // узлу нужны только его концы пар
+            for (int i = 0; i < nodes; ++i) {
+                close(coord[i]);
+                for (int j = 0; j <= nodes; ++j) {
+                    if (i != k && fds[i][j] >= 0) close(fds[i][j]);
+                }
+            }
+            if (!logger_after_fork(logger)) _exit(1);
+            stop_watch_after_fork();
+            stats_after_fork();
+            affinity_pin_worker(k);
+            int status = node_main(config, logger, k, nodes, fds, counters);
+            close_logger(logger);
+            _exit(status);
+        }
+        if (pids[k] < 0) {
+            perror("fork");
+            rc = 1;
+            nodes = k; // узлы без пары не запущены: останавливаем уже запущенные
+            break;
+        }
+    }
+    for (int i = 0; i < config->processes; ++i) {
+        for (int j = 0; j <= config->processes; ++j) {
+            if (fds[i][j] >= 0) close(fds[i][j]);
+        }
+    }
+    Nodes alive = { .pids = pids, .count = nodes };
+    if (rc != 0) forward_stop(&alive);
+    stop_watch_add(forward_stop, &alive);
+
+    coordinate(config, logger, nodes, coord);
+    for (int k = 0; k < nodes; ++k) {
+        int status = 0;
+        while (waitpid(pids[k], &status, 0) < 0 && errno == EINTR) {
+        }
+        if (WIFSIGNALED(status)) {
+            log_message(logger, "Узел %d (pid %ld) завершён сигналом %d", k, (long)pids[k], WTERMSIG(status));
+            rc = 1;
+        } else if (WEXITSTATUS(status) != 0) {
+            rc = 1;
+        }
+        pids[k] = 0; // forward_stop не должен слать сигнал чужому процессу с тем же pid
+    }
+    stop_watch_remove(forward_stop, &alive);
+    for (int k = 0; k < config->processes; ++k) close(coord[k]);
+
+    report(logger, nodes, counters);
+    munmap(counters, counters_bytes);
+    return rc;
+}
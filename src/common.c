@@ -1,37 +1,36 @@
 #include "common.h"
+#include "affinity.h"
+#include "futex.h"
+#include "journal.h"
 
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdarg.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
-#include <signal.h>
+#include <sched.h>
 #include <unistd.h>
 
 typedef struct {
     const char *key;
-    enum { CFG_INT, CFG_DOUBLE, CFG_STRING } type;
+    enum { CFG_INT, CFG_DOUBLE, CFG_STRING, CFG_U64 } type;
     void *target;
     size_t max_len;
 } ConfigEntry;
 
-static _Atomic bool stop_flag = false;
-
-static void on_signal(int signum) {
-    (void)signum;
-    stop_flag = true;
-}
-
-bool stop_requested(void) {
-    return atomic_load(&stop_flag);
-}
-
-int random_range(int min, int max) {
+int random_range(Rng *rng, int min, int max) {
     if (max <= min) {
         return min;
     }
-    int span = max - min + 1;
-    return min + rand() % span;
+    uint64_t span = (uint64_t)max - (uint64_t)min + 1;
+    // умножение вместо деления по модулю (метод Лемира)
+    return min + (int)(((rng_next(rng) >> 32) * span) >> 32);
+}
+
+bool random_chance(Rng *rng, double probability) {
+    return rng_unit(rng) < probability;
 }
 
 static void trim(char *s) {
@@ -60,11 +59,13 @@ static bool parse_line(const char *line, char *key, char *value) {
     return strlen(key) > 0;
 }
 
-bool load_config_file(const char *path, Config *config) {
-    if (!path || !*path) return false;
-    FILE *f = fopen(path, "r");
-    if (!f) return false;
+static bool thread_per_talker(const char *mode) {
+    return strcmp(mode, MODE_SEMAPHORE) == 0 || strcmp(mode, MODE_CONDITION) == 0
+        || strcmp(mode, MODE_FUTEX) == 0 || strcmp(mode, MODE_PROCESS) == 0;
+}
 
+// Присваивает ключ конфига; false — такого ключа нет.
+bool config_set(Config *config, const char *key, const char *value) {
     ConfigEntry table[] = {
         {"talkers", CFG_INT, &config->talkers, 0},
         {"min_idle_ms", CFG_INT, &config->min_idle_ms, 0},
@@ -74,10 +75,49 @@ bool load_config_file(const char *path, Config *config) {
         {"stop_after_calls", CFG_INT, &config->stop_after_calls, 0},
         {"leave_probability", CFG_DOUBLE, &config->leave_probability, 0},
         {"duration_seconds", CFG_INT, &config->duration_seconds, 0},
+        {"workers", CFG_INT, &config->workers, 0},
+        {"processes", CFG_INT, &config->processes, 0},
+        {"shards", CFG_INT, &config->shards, 0},
+        {"cluster_local", CFG_DOUBLE, &config->cluster_local, 0},
+        {"call_waiting", CFG_INT, &config->call_waiting, 0},
+        {"call_wait_ms", CFG_INT, &config->call_wait_ms, 0},
+        {"cpus", CFG_STRING, config->cpus, sizeof(config->cpus)},
+        {"seed", CFG_U64, &config->seed, 0},
         {"output", CFG_STRING, config->output_path, MAX_PATH_LEN},
         {"mode", CFG_STRING, config->mode, sizeof(config->mode)},
+        {"trace_format", CFG_STRING, config->trace_format, sizeof(config->trace_format)},
+        {"lock_profile", CFG_STRING, config->lock_profile, sizeof(config->lock_profile)},
+        {"log_level", CFG_STRING, config->log_level, sizeof(config->log_level)},
+        {"summary_csv", CFG_STRING, config->summary_path, MAX_PATH_LEN},
+        {"live_snapshot", CFG_STRING, config->live_path, MAX_PATH_LEN},
+        {"record_journal", CFG_STRING, config->record_path, MAX_PATH_LEN},
+        {"replay_journal", CFG_STRING, config->replay_path, MAX_PATH_LEN},
+        {"replay_speed", CFG_DOUBLE, &config->replay_speed, 0},
     };
 
+    for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); ++i) {
+        if (strcmp(table[i].key, key) != 0) continue;
+        if (table[i].type == CFG_INT) {
+            *(int *)table[i].target = atoi(value);
+        } else if (table[i].type == CFG_U64) {
+            *(uint64_t *)table[i].target = strtoull(value, NULL, 10);
+        } else if (table[i].type == CFG_DOUBLE) {
+            *(double *)table[i].target = atof(value);
+        } else if (table[i].type == CFG_STRING) {
+            size_t limit = table[i].max_len ? table[i].max_len : MAX_PATH_LEN;
+            strncpy((char *)table[i].target, value, limit - 1);
+            ((char *)table[i].target)[limit - 1] = '\0';
+        }
+        return true;
+    }
+    return false;
+}
+
+bool load_config_file(const char *path, Config *config) {
+    if (!path || !*path) return false;
+    FILE *f = fopen(path, "r");
+    if (!f) return false;
+
     char line[256];
     char key[128];
     char value[128];
@@ -85,19 +125,7 @@ bool load_config_file(const char *path, Config *config) {
         trim(line);
         if (!line[0] || line[0] == '#') continue;
         if (!parse_line(line, key, value)) continue;
-        for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); ++i) {
-            if (strcmp(table[i].key, key) == 0) {
-                if (table[i].type == CFG_INT) {
-                    *(int *)table[i].target = atoi(value);
-                } else if (table[i].type == CFG_DOUBLE) {
-                    *(double *)table[i].target = atof(value);
-                } else if (table[i].type == CFG_STRING) {
-                    size_t limit = table[i].max_len ? table[i].max_len : MAX_PATH_LEN;
-                    strncpy((char *)table[i].target, value, limit - 1);
-                    ((char *)table[i].target)[limit - 1] = '\0';
-                }
-            }
-        }
+        config_set(config, key, value);
     }
 
     fclose(f);
@@ -114,9 +142,26 @@ bool parse_args(int argc, char **argv, Config *config) {
     config->stop_after_calls = 0;
     config->leave_probability = 0.2;
     config->duration_seconds = 10;
+    config->workers = 0;
+    config->processes = 2;
+    config->shards = 1;
+    config->cluster_local = 0.0;
+    config->call_waiting = 0;
+    config->call_wait_ms = 200;
+    config->cpus[0] = '\0';
+    config->seed = 0;
     strcpy(config->output_path, "outputs/run.log");
     strcpy(config->mode, MODE_SEMAPHORE);
+    strcpy(config->trace_format, TRACE_FORMAT_TEXT);
+    strcpy(config->lock_profile, "off");
+    strcpy(config->log_level, TALKERS_LOG_LEVEL >= LOG_LEVEL_EVENTS ? "events"
+                              : TALKERS_LOG_LEVEL >= LOG_LEVEL_SUMMARY ? "summary" : "off");
     config->config_path[0] = '\0';
+    config->summary_path[0] = '\0';
+    config->live_path[0] = '\0';
+    config->record_path[0] = '\0';
+    config->replay_path[0] = '\0';
+    config->replay_speed = 0.0;
 
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "--config") == 0 && i + 1 < argc) {
@@ -138,16 +183,56 @@ bool parse_args(int argc, char **argv, Config *config) {
             config->leave_probability = atof(argv[++i]);
         } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
             config->duration_seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            config->workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--processes") == 0 && i + 1 < argc) {
+            config->processes = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            config->shards = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cluster-local") == 0 && i + 1 < argc) {
+            config->cluster_local = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--call-waiting") == 0 && i + 1 < argc) {
+            config->call_waiting = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--call-wait") == 0 && i + 1 < argc) {
+            config->call_wait_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cpus") == 0 && i + 1 < argc) {
+            strncpy(config->cpus, argv[++i], sizeof(config->cpus) - 1);
+            config->cpus[sizeof(config->cpus) - 1] = '\0';
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            config->seed = strtoull(argv[++i], NULL, 10);
         } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
             strncpy(config->output_path, argv[++i], MAX_PATH_LEN - 1);
             config->output_path[MAX_PATH_LEN - 1] = '\0';
         } else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
             strncpy(config->mode, argv[++i], sizeof(config->mode) - 1);
             config->mode[sizeof(config->mode) - 1] = '\0';
+        } else if (strcmp(argv[i], "--trace-format") == 0 && i + 1 < argc) {
+            strncpy(config->trace_format, argv[++i], sizeof(config->trace_format) - 1);
+            config->trace_format[sizeof(config->trace_format) - 1] = '\0';
+        } else if (strcmp(argv[i], "--lock-profile") == 0 && i + 1 < argc) {
+            strncpy(config->lock_profile, argv[++i], sizeof(config->lock_profile) - 1);
+            config->lock_profile[sizeof(config->lock_profile) - 1] = '\0';
+        } else if (strcmp(argv[i], "--log-level") == 0 && i + 1 < argc) {
+            strncpy(config->log_level, argv[++i], sizeof(config->log_level) - 1);
+            config->log_level[sizeof(config->log_level) - 1] = '\0';
+        } else if (strcmp(argv[i], "--summary-csv") == 0 && i + 1 < argc) {
+            strncpy(config->summary_path, argv[++i], MAX_PATH_LEN - 1);
+            config->summary_path[MAX_PATH_LEN - 1] = '\0';
+        } else if (strcmp(argv[i], "--live-snapshot") == 0 && i + 1 < argc) {
+            strncpy(config->live_path, argv[++i], MAX_PATH_LEN - 1);
+            config->live_path[MAX_PATH_LEN - 1] = '\0';
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            strncpy(config->record_path, argv[++i], MAX_PATH_LEN - 1);
+            config->record_path[MAX_PATH_LEN - 1] = '\0';
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            strncpy(config->replay_path, argv[++i], MAX_PATH_LEN - 1);
+            config->replay_path[MAX_PATH_LEN - 1] = '\0';
+        } else if (strcmp(argv[i], "--replay-speed") == 0 && i + 1 < argc) {
+            config->replay_speed = atof(argv[++i]);
         } else if (strcmp(argv[i], "--help") == 0) {
             printf("Usage: %s [options]\n", argv[0]);
             printf("  --config <file>          конфигурационный файл (key=value)\n");
-            printf("  -n, --talkers <N>        число болтунов (1-%d)\n", MAX_TALKERS);
+            printf("  -n, --talkers <N>        число болтунов (1-%d; в режимах des, pool, epoll и coro — по памяти)\n", MAX_TALKERS);
             printf("  --min-idle <ms>          минимальная пауза ожидания\n");
             printf("  --max-idle <ms>          максимальная пауза ожидания\n");
             printf("  --min-call <ms>          минимальная длительность звонка\n");
@@ -155,8 +240,28 @@ bool parse_args(int argc, char **argv, Config *config) {
             printf("  --stop-after-calls <n>   отключение после n разговоров (0 — нет лимита)\n");
             printf("  --leave-probability <p>  вероятность ухода после разговора (0..1)\n");
             printf("  --duration <sec>         ограничение по времени работы\n");
+            printf("  --workers <N>            потоки пула в режимах pool и coro (0 — по числу ядер), циклы epoll (0 — один)\n");
+            printf("  --processes <N>          процессы-воркеры в режиме process, узлы в cluster (до %d)\n", MAX_CLUSTER_NODES);
+            printf("  --shards <N>             группы болтунов: звонок сначала ищется в своей группе\n");
+            printf("  --cluster-local <p>      cluster: доля наборов, что сначала ищут свободного на своём узле (0)\n");
+            printf("  --call-waiting <N>       semaphore, futex: занятая линия ставит звонящего в очередь на N мест\n");
+            printf("  --call-wait <ms>         сколько ждать в очереди (по умолчанию 200)\n");
+            printf("  --cpus <list>            привязать потоки к ядрам, например 0-3,8\n");
+            printf("  --seed <n>               зерно ГПСЧ для воспроизводимых запусков (0 — от времени)\n");
             printf("  --output <path>          файл лога (пусто — только консоль)\n");
-            printf("  --mode <semaphore|condition> выбор реализации синхронизации\n");
+            printf("  --mode <semaphore|condition|futex|process|des|pool|epoll|coro|cluster> выбор реализации синхронизации\n");
+            printf("  --trace-format <text|binary> формат файла лога (binary — записи фиксированного размера)\n");
+            printf("  --lock-profile <off|sites|talkers> профиль блокировок semaphore, condition, process (talkers — с картой)\n");
+            printf("  --log-level <events|summary|off> что писать в лог (summary — только итоги, счётчики ведутся)\n");
+            printf("  --summary-csv <path>     дописать строку итогов запуска в CSV\n");
+            printf("  --live-snapshot <path>   публиковать живой снимок состояния для talkers-top\n");
+            printf("  --record <path>          des, pool, epoll: записать журнал решений автоматов\n");
+            printf("  --replay <path>          воспроизвести журнал (параметры прогона берутся из него)\n");
+            printf("  --replay-speed <x>       темп воспроизведения: 0 — без пауз, 1 — как при записи\n");
+            printf("  --sweep <dir|file.conf>  прогнать сценарии (каталог — все *.conf), можно повторять\n");
+            printf("  --grid <key=v1,v2,...>   умножить сценарии на значения ключа конфига, можно повторять\n");
+            printf("  --jobs <N>               параллельных прогонов в --sweep (по умолчанию по числу ядер)\n");
+            printf("  --sweep-out <dir>        каталог логов и сводной таблицы sweep.csv (outputs/sweep)\n");
             return false;
         }
     }
@@ -165,67 +270,424 @@ bool parse_args(int argc, char **argv, Config *config) {
         load_config_file(config->config_path, config);
     }
 
-    if (config->talkers < 1 || config->talkers > MAX_TALKERS) {
+    return validate_config(config);
+}
+
+// Проверка после слияния умолчаний, файла и ключей CLI; зерно 0
+// заменяется случайным.
+bool validate_config(Config *config) {
+    if (config->record_path[0] && config->replay_path[0]) {
+        fprintf(stderr, "--record и --replay несовместимы\n");
+        return false;
+    }
+    if (config->replay_path[0] && !journal_load_config(config->replay_path, config)) return false;
+    if (config->replay_speed < 0.0) return false;
+    int max_talkers = thread_per_talker(config->mode) ? MAX_TALKERS : MAX_FSM_TALKERS;
+    if (config->talkers < 1 || config->talkers > max_talkers) {
         fprintf(stderr, "Некорректное число болтунов\n");
         return false;
     }
     if (config->min_idle_ms <= 0 || config->max_idle_ms < config->min_idle_ms) return false;
     if (config->min_call_ms <= 0 || config->max_call_ms < config->min_call_ms) return false;
     if (config->leave_probability < 0.0 || config->leave_probability > 1.0) return false;
-    if (strcmp(config->mode, MODE_SEMAPHORE) != 0 && strcmp(config->mode, MODE_CONDITION) != 0) return false;
+    if (strcmp(config->mode, MODE_SEMAPHORE) != 0 && strcmp(config->mode, MODE_CONDITION) != 0
+        && strcmp(config->mode, MODE_FUTEX) != 0 && strcmp(config->mode, MODE_DES) != 0
+        && strcmp(config->mode, MODE_POOL) != 0 && strcmp(config->mode, MODE_PROCESS) != 0
+        && strcmp(config->mode, MODE_EPOLL) != 0 && strcmp(config->mode, MODE_CORO) != 0
+        && strcmp(config->mode, MODE_CLUSTER) != 0) return false;
+    if (config->processes < 1) return false;
+    if (config->processes > config->talkers) config->processes = config->talkers;
+    if (strcmp(config->mode, MODE_CLUSTER) == 0 && config->processes > MAX_CLUSTER_NODES) {
+        fprintf(stderr, "Узлов кластера не больше %d\n", MAX_CLUSTER_NODES);
+        return false;
+    }
+    if (config->cluster_local < 0.0 || config->cluster_local > 1.0) {
+        fprintf(stderr, "Некорректная доля местных наборов: %g\n", config->cluster_local);
+        return false;
+    }
+    if (config->shards < 1 || config->shards > config->talkers) {
+        fprintf(stderr, "Некорректное число шардов\n");
+        return false;
+    }
+    if (config->call_waiting < 0 || config->call_waiting > 1024 || config->call_wait_ms < 1) {
+        fprintf(stderr, "Некорректные параметры ожидания вызова\n");
+        return false;
+    }
+    if (config->call_waiting > 0 && strcmp(config->mode, MODE_SEMAPHORE) != 0
+        && strcmp(config->mode, MODE_FUTEX) != 0) {
+        fprintf(stderr, "Ожидание вызова есть только в режимах semaphore и futex\n");
+        return false;
+    }
+    if (config->cpus[0] && cpu_list_parse(config->cpus, NULL, 1 << 16) <= 0) {
+        fprintf(stderr, "Некорректный список ядер: %s\n", config->cpus);
+        return false;
+    }
+    if (strcmp(config->trace_format, TRACE_FORMAT_TEXT) != 0
+        && strcmp(config->trace_format, TRACE_FORMAT_BINARY) != 0) {
+        fprintf(stderr, "Некорректный формат трассы: %s\n", config->trace_format);
+        return false;
+    }
+    if (strcmp(config->lock_profile, "off") != 0 && strcmp(config->lock_profile, "sites") != 0
+        && strcmp(config->lock_profile, "talkers") != 0) {
+        fprintf(stderr, "Некорректный профиль блокировок: %s\n", config->lock_profile);
+        return false;
+    }
+    if (strcmp(config->lock_profile, "off") != 0 && strcmp(config->mode, MODE_SEMAPHORE) != 0
+        && strcmp(config->mode, MODE_CONDITION) != 0 && strcmp(config->mode, MODE_PROCESS) != 0) {
+        fprintf(stderr, "Профиль блокировок есть только в режимах semaphore, condition и process\n");
+        return false;
+    }
+    int level = log_level_parse(config->log_level);
+    if (level < 0) {
+        fprintf(stderr, "Некорректный уровень лога: %s\n", config->log_level);
+        return false;
+    }
+    if (level > TALKERS_LOG_LEVEL) {
+        fprintf(stderr, "Уровень лога %s вырезан при сборке: пересоберите с make LOG_LEVEL=%s\n",
+                config->log_level, config->log_level);
+        return false;
+    }
+    if (config->record_path[0] && strcmp(config->mode, MODE_DES) != 0 && strcmp(config->mode, MODE_POOL) != 0
+        && strcmp(config->mode, MODE_EPOLL) != 0) {
+        fprintf(stderr, "Запись журнала есть только в режимах des, pool и epoll\n");
+        return false;
+    }
+
+    if (config->seed == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        uint64_t state = ((uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec) ^ ((uint64_t)getpid() << 32);
+        config->seed = rng_splitmix(&state) | 1;
+    }
 
     return true;
 }
 
-void init_logger(Logger *logger, const char *path) {
-    pthread_mutex_init(&logger->lock, NULL);
+// Пишем напрямую в дескриптор: пачка уже собрана, а буферы stdio не
+// переживают fork в многопроцессном режиме.
+static void write_batch(int fd, const char *batch, size_t *used) {
+    size_t done = 0;
+    while (fd >= 0 && done < *used) {
+        ssize_t n = write(fd, batch + done, *used - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        done += (size_t)n;
+    }
+    *used = 0;
+}
+
+typedef struct {
+    char *console;
+    size_t console_used;
+    char *trace; // двоичный журнал; в текстовом формате файл получает консольную пачку
+    size_t trace_used;
+} LogBatch;
+
+static void flush_batch(Logger *logger, LogBatch *batch) {
+    if (!logger->binary && batch->console_used) {
+        size_t used = batch->console_used;
+        write_batch(logger->fd, batch->console, &used);
+    }
+    write_batch(STDOUT_FILENO, batch->console, &batch->console_used);
+    write_batch(logger->fd, batch->trace, &batch->trace_used);
+}
+
+static bool append_record(Logger *logger, LogBatch *batch, const LogRecord *cell) {
+    const TraceRecord *ev = &cell->event;
+    if (logger->binary && ev->type != EVT_TEXT) {
+        if (batch->trace_used + sizeof(TraceRecord) > LOG_BATCH_BYTES) return false;
+        memcpy(batch->trace + batch->trace_used, ev, sizeof(TraceRecord));
+        batch->trace_used += sizeof(TraceRecord);
+        return true;
+    }
+
+    if (batch->console_used + LOG_TEXT_MAX + 32 > LOG_BATCH_BYTES) return false;
+    char *out = batch->console + batch->console_used;
+    size_t room = LOG_BATCH_BYTES - batch->console_used;
+    int n = snprintf(out, room, "[%6ld ms] ", (long)ev->ts_ms);
+    if (ev->type == EVT_TEXT) {
+        n += snprintf(out + n, room - (size_t)n, "%s\n", cell->text);
+    } else {
+        n += format_event(out + n, room - (size_t)n - 1, ev, logger->mode);
+        out[n++] = '\n';
+    }
+    batch->console_used += (size_t)n;
+    return true;
+}
+
+// Пустое кольцо: поток сброса засыпает на futex до публикации записи,
+// закрытия или срока сброса пачки. Флаг parked выставляется до повторной
+// проверки ячейки, а производитель смотрит его после публикации — так
+// пробуждение не теряется.
+static void park_drain(Logger *logger, LogRecord *cell, long timeout_ms) {
+    uint32_t word = atomic_load(&logger->wake);
+    atomic_store(&logger->parked, true);
+    atomic_thread_fence(memory_order_seq_cst);
+    bool ready = atomic_load_explicit(&cell->seq, memory_order_relaxed) == logger->tail + 1;
+    if (!ready && !atomic_load(&logger->closing)) futex_wait(&logger->wake, word, timeout_ms);
+    atomic_store_explicit(&logger->parked, false, memory_order_relaxed);
+}
+
+static void wake_drain(Logger *logger) {
+    atomic_fetch_add(&logger->wake, 1);
+    futex_wake(&logger->wake, 1);
+}
+
+// Единственный потребитель кольца: забирает записи пачками и сбрасывает
+// их при заполнении буфера или по истечении интервала.
+static void *drain_thread(void *arg) {
+    Logger *logger = (Logger *)arg;
+    LogBatch batch = { .console = logger->batch_console, .trace = logger->batch_trace };
+    long last_flush = elapsed_ms_since(logger);
+
+    while (true) {
+        bool closing = atomic_load(&logger->closing);
+        LogRecord *cell = &logger->ring[logger->tail & LOG_RING_MASK];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        if (seq == logger->tail + 1) {
+            if (!append_record(logger, &batch, cell)) {
+                flush_batch(logger, &batch);
+                last_flush = elapsed_ms_since(logger);
+                append_record(logger, &batch, cell);
+            }
+            atomic_store_explicit(&cell->seq, logger->tail + LOG_RING_CAPACITY, memory_order_release);
+            logger->tail++;
+            atomic_fetch_add_explicit(&logger->written, 1, memory_order_relaxed);
+            continue;
+        }
+
+        if (closing) break;
+        long now = elapsed_ms_since(logger);
+        bool pending = batch.console_used || batch.trace_used;
+        if (pending && now - last_flush >= LOG_FLUSH_INTERVAL_MS) {
+            flush_batch(logger, &batch);
+            last_flush = now;
+            pending = false;
+        }
+        // без несброшенной пачки будить по таймеру незачем
+        park_drain(logger, cell, pending ? LOG_FLUSH_INTERVAL_MS - (now - last_flush) : -1);
+    }
+
+    flush_batch(logger, &batch);
+    return NULL;
+}
+
+static void write_trace_header(Logger *logger) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    TraceHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.record_size = sizeof(TraceRecord);
+    header.start_unix_ms = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+    memcpy(header.mode, logger->mode, sizeof(header.mode));
+    size_t used = sizeof(header);
+    write_batch(logger->fd, (const char *)&header, &used);
+}
+
+static void reset_ring(Logger *logger) {
+    for (size_t i = 0; i < LOG_RING_CAPACITY; ++i) {
+        atomic_init(&logger->ring[i].seq, i);
+    }
+    atomic_init(&logger->head, 0);
+    logger->tail = 0;
+    atomic_init(&logger->dropped, 0);
+    atomic_init(&logger->written, 0);
+    atomic_init(&logger->closing, false);
+    atomic_init(&logger->wake, 0);
+    atomic_init(&logger->parked, false);
+}
+
+static void free_logger(Logger *logger) {
+    if (logger->fd >= 0) close(logger->fd);
+    free(logger->ring);
+    free(logger->batch_console);
+    free(logger->batch_trace);
+}
+
+int log_level_parse(const char *name) {
+    if (strcmp(name, "events") == 0) return LOG_LEVEL_EVENTS;
+    if (strcmp(name, "summary") == 0) return LOG_LEVEL_SUMMARY;
+    if (strcmp(name, "off") == 0) return LOG_LEVEL_OFF;
+    return -1;
+}
+
+bool init_logger(Logger *logger, const Config *config) {
     clock_gettime(CLOCK_MONOTONIC, &logger->start_ts);
-    logger->file = NULL;
-    if (path && *path) {
-        logger->file = fopen(path, "w");
-        if (!logger->file) {
-            perror("fopen log");
+    strncpy(logger->mode, config->mode, sizeof(logger->mode) - 1);
+    logger->mode[sizeof(logger->mode) - 1] = '\0';
+    logger->binary = strcmp(config->trace_format, TRACE_FORMAT_BINARY) == 0;
+    logger->fd = -1;
+    if (config->output_path[0]) {
+        logger->fd = open(config->output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (logger->fd < 0) {
+            perror("open log");
+        } else if (logger->binary) {
+            write_trace_header(logger);
         }
     }
-    signal(SIGINT, on_signal);
+
+    logger->ring = malloc(LOG_RING_CAPACITY * sizeof(LogRecord));
+    logger->batch_console = malloc(LOG_BATCH_BYTES);
+    logger->batch_trace = malloc(LOG_BATCH_BYTES);
+    if (!logger->ring || !logger->batch_console || !logger->batch_trace) {
+        fprintf(stderr, "Недостаточно памяти для кольца лога\n");
+        free_logger(logger);
+        return false;
+    }
+    reset_ring(logger);
+    logger->wait_when_full = false;
+    logger->level = log_level_parse(config->log_level);
+    int rc = pthread_create(&logger->drain, NULL, drain_thread, logger);
+    if (rc != 0) {
+        fprintf(stderr, "Логгер: не удалось запустить поток сброса: %s\n", strerror(rc));
+        free_logger(logger);
+        return false;
+    }
+    watch_stop_signal();
+    return true;
+}
+
+// В дочернем процессе нет потока сброса, а кольцо — копия родительского:
+// начинаем с пустого кольца и своего потока, дескриптор файла общий.
+bool logger_after_fork(Logger *logger) {
+    reset_ring(logger);
+    int rc = pthread_create(&logger->drain, NULL, drain_thread, logger);
+    if (rc != 0) {
+        fprintf(stderr, "Логгер: не удалось запустить поток сброса: %s\n", strerror(rc));
+        return false;
+    }
+    return true;
 }
 
 void close_logger(Logger *logger) {
-    if (logger->file) fclose(logger->file);
-    pthread_mutex_destroy(&logger->lock);
+    atomic_store(&logger->closing, true);
+    wake_drain(logger);
+    pthread_join(logger->drain, NULL);
+    unsigned long dropped = atomic_load(&logger->dropped);
+    if (dropped) {
+        fprintf(stderr, "Логгер: записано %lu, потеряно при переполнении %lu\n",
+                atomic_load(&logger->written), dropped);
+    }
+    free_logger(logger);
 }
 
-long elapsed_ms_since(Logger *logger) {
+// Единственный счёт времени лога: миллисекунды log_message и события
+// log_event берутся из одних микросекунд, так что метки не идут назад.
+static int64_t elapsed_us_since(const Logger *logger) {
     struct timespec now;
     clock_gettime(CLOCK_MONOTONIC, &now);
-    long sec = now.tv_sec - logger->start_ts.tv_sec;
-    long nsec = now.tv_nsec - logger->start_ts.tv_nsec;
-    return sec * 1000 + nsec / 1000000;
+    int64_t ns = (int64_t)(now.tv_sec - logger->start_ts.tv_sec) * 1000000000LL
+        + (now.tv_nsec - logger->start_ts.tv_nsec);
+    return ns / 1000;
+}
+
+long elapsed_ms_since(Logger *logger) {
+    return (long)(elapsed_us_since(logger) / 1000);
+}
+
+// Производители (MPSC, схема Вьюкова): позиция резервируется CAS по head,
+// запись публикуется номером последовательности ячейки.
+static LogRecord *reserve_record(Logger *logger, size_t *pos_out) {
+    size_t pos = atomic_load_explicit(&logger->head, memory_order_relaxed);
+    while (true) {
+        LogRecord *cell = &logger->ring[pos & LOG_RING_MASK];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&logger->head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                *pos_out = pos;
+                return cell;
+            }
+        } else if (diff < 0) {
+            if (logger->wait_when_full) {
+                sched_yield();
+                pos = atomic_load_explicit(&logger->head, memory_order_relaxed);
+                continue;
+            }
+            atomic_fetch_add_explicit(&logger->dropped, 1, memory_order_relaxed);
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&logger->head, memory_order_relaxed);
+        }
+    }
+}
+
+// Пара к park_drain: публикация, барьер, затем проверка parked.
+static void publish_record(Logger *logger, LogRecord *cell, size_t pos) {
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&logger->parked, memory_order_relaxed)) wake_drain(logger);
+}
+
+static void log_va(Logger *logger, long ms, const char *fmt, va_list args) {
+#if TALKERS_LOG_LEVEL < LOG_LEVEL_SUMMARY
+    (void)logger;
+    (void)ms;
+    (void)fmt;
+    (void)args;
+#else
+    if (logger->level < LOG_LEVEL_SUMMARY) return;
+    size_t pos;
+    LogRecord *cell = reserve_record(logger, &pos);
+    if (!cell) return;
+    memset(&cell->event, 0, sizeof(cell->event));
+    cell->event.ts_ms = ms;
+    cell->event.type = EVT_TEXT;
+    vsnprintf(cell->text, sizeof(cell->text), fmt, args);
+    publish_record(logger, cell, pos);
+#endif
 }
 
 void log_message(Logger *logger, const char *fmt, ...) {
-    pthread_mutex_lock(&logger->lock);
     long ms = elapsed_ms_since(logger);
-    printf("[%6ld ms] ", ms);
-    if (logger->file) fprintf(logger->file, "[%6ld ms] ", ms);
+    va_list args;
+    va_start(args, fmt);
+    log_va(logger, ms, fmt, args);
+    va_end(args);
+}
 
+void log_message_at(Logger *logger, long ms, const char *fmt, ...) {
     va_list args;
     va_start(args, fmt);
-    vprintf(fmt, args);
-    if (logger->file) {
-        va_list args2;
-        va_start(args2, fmt);
-        vfprintf(logger->file, fmt, args2);
-        va_end(args2);
-    }
+    log_va(logger, ms, fmt, args);
     va_end(args);
+}
 
-    printf("\n");
-    if (logger->file) {
-        fprintf(logger->file, "\n");
-        fflush(logger->file);
-    }
-    fflush(stdout);
-    pthread_mutex_unlock(&logger->lock);
+// Старт и конец прогона — рамка лога, они пишутся и на уровне summary:
+// по ним talkers-stats узнаёт режим и длительность.
+static void enqueue_event(Logger *logger, long ms, EventType type, int talker, int peer, int duration_ms) {
+#if TALKERS_LOG_LEVEL < LOG_LEVEL_EVENTS
+    if (type != EVT_START && type != EVT_END) return;
+#endif
+    int needed = type == EVT_START || type == EVT_END ? LOG_LEVEL_SUMMARY : LOG_LEVEL_EVENTS;
+    if (logger->level < needed) return;
+    size_t pos;
+    LogRecord *cell = reserve_record(logger, &pos);
+    if (!cell) return;
+    cell->event.ts_ms = ms;
+    cell->event.type = (uint16_t)type;
+    cell->event.reserved = 0;
+    cell->event.talker = talker;
+    cell->event.peer = peer;
+    cell->event.duration_ms = duration_ms;
+    publish_record(logger, cell, pos);
 }
 
+// Структурированное событие: форматирование откладывается до потока сброса.
+void log_event_at(Logger *logger, long ms, EventType type, int talker, int peer, int duration_ms) {
+    stats_on_event(type, talker, peer, (int64_t)ms * 1000);
+    live_on_event(type, talker, peer);
+    enqueue_event(logger, ms, type, talker, peer, duration_ms);
+}
+
+void log_event(Logger *logger, EventType type, int talker, int peer, int duration_ms) {
+    int64_t us = elapsed_us_since(logger);
+    stats_on_event(type, talker, peer, us);
+    live_on_event(type, talker, peer);
+    enqueue_event(logger, (long)(us / 1000), type, talker, peer, duration_ms);
+}
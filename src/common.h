@@ -9,14 +9,42 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <stdatomic.h>
+#include <stdint.h>
 #include <time.h>
 
+#include "rng.h"
+#include "trace.h"
+
 #define MODE_SEMAPHORE "semaphore"
 #define MODE_CONDITION "condition"
+#define MODE_DES "des"
+#define MODE_POOL "pool"
+#define MODE_FUTEX "futex"
+#define MODE_PROCESS "process"
+#define MODE_EPOLL "epoll"
+#define MODE_CORO "coro"
+#define MODE_CLUSTER "cluster"
 
-#define MAX_TALKERS 64
+#define MAX_TALKERS 64 // режимы с потоком на болтуна
+#define MAX_CLUSTER_NODES 16 // узлы cluster: сокетов на полную сетку ~N², держим в пределах ulimit -n
+#define MAX_FSM_TALKERS 0x3fffffff // режимы-автоматы: ограничены памятью и упаковкой line.h
 #define MAX_PATH_LEN 256
 
+// Уровни лога: events — все события, summary — только служебные строки и
+// итоги (счётчики статистики ведутся всё равно), off — ничего. Выше
+// TALKERS_LOG_LEVEL (make LOG_LEVEL=...) код записи вырезается при сборке,
+// а --log-level выбирает уровень не выше собранного.
+#define LOG_LEVEL_OFF 0
+#define LOG_LEVEL_SUMMARY 1
+#define LOG_LEVEL_EVENTS 2
+#ifndef TALKERS_LOG_LEVEL
+#define TALKERS_LOG_LEVEL LOG_LEVEL_EVENTS
+#endif
+
+// Строка кэша: горячие поля разных болтунов не должны делить одну строку.
+#define CACHE_LINE 64
+#define CACHE_ALIGNED _Alignas(CACHE_LINE)
+
 typedef struct {
     int talkers;
     int min_idle_ms;
@@ -26,27 +54,119 @@ typedef struct {
     int stop_after_calls; // <=0 to ignore
     double leave_probability; // 0..1
     int duration_seconds; // <=0 to ignore
+    int workers; // pool, coro: <=0 — по числу ядер; epoll: число циклов, <=0 — один
+    int processes; // режим process: число процессов-воркеров; cluster: число узлов
+    int shards; // группы болтунов, звонок сначала ищется внутри своей
+    double cluster_local; // cluster: доля наборов, что сначала ищут свободного на своём узле
+    int call_waiting; // semaphore, futex: мест в очереди ожидания вызова, 0 — перебор номеров
+    int call_wait_ms; // сколько звонящий ждёт в очереди
+    uint64_t seed; // 0 — выбрать от времени
     char output_path[MAX_PATH_LEN];
     char config_path[MAX_PATH_LEN];
+    char summary_path[MAX_PATH_LEN]; // пусто — итоги только в лог
+    char live_path[MAX_PATH_LEN]; // живой снимок для talkers-top, пусто — нет
+    char record_path[MAX_PATH_LEN]; // des, pool, epoll: журнал решений автоматов, пусто — нет
+    char replay_path[MAX_PATH_LEN]; // воспроизвести журнал вместо прогона
+    double replay_speed; // 0 — без пауз, 1 — в записанном темпе
+    char cpus[128]; // список ядер "0-3,8", пусто — без привязки
     char mode[16];
+    char trace_format[16];
+    char lock_profile[16]; // off, sites, talkers (ещё и карта по болтунам)
+    char log_level[16]; // events, summary, off
 } Config;
 
+#define LOG_RING_CAPACITY 16384 // степень двойки
+#define LOG_RING_MASK (LOG_RING_CAPACITY - 1)
+#define LOG_TEXT_MAX 192
+#define LOG_BATCH_BYTES 65536
+#define LOG_FLUSH_INTERVAL_MS 50
+
+typedef struct {
+    _Atomic size_t seq;
+    TraceRecord event;
+    char text[LOG_TEXT_MAX]; // только для EVT_TEXT
+} LogRecord;
+
+// Счётчики индекса свободных линий, слитые по шардам статистики.
 typedef struct {
-    FILE *file;
-    pthread_mutex_t lock;
+    uint64_t picks;
+    uint64_t misses;       // индекс указал линию, но её успели занять
+    uint64_t no_line;      // свободных линий не нашлось
+    uint64_t probes_saved;
+} IndexStats;
+
+// Асинхронный логгер: потоки кладут записи в кольцо без блокировок,
+// отдельный поток пишет их пачками в консоль и файл.
+typedef struct {
+    int fd; // файл лога, -1 — только консоль
+    bool binary;
+    char mode[16];
     struct timespec start_ts;
+    LogRecord *ring;
+    _Atomic size_t head;
+    size_t tail; // только поток сброса
+    _Atomic unsigned long dropped;
+    _Atomic unsigned long written;
+    _Atomic bool closing;
+    _Atomic uint32_t wake; // futex потока сброса: производители двигают его, когда поток спит
+    _Atomic bool parked;
+    char *batch_console; // буферы пачек, выделяются вместе с кольцом
+    char *batch_trace;
+    bool wait_when_full; // false — при переполнении запись теряется
+    int level; // LOG_LEVEL_*, не выше TALKERS_LOG_LEVEL
+    pthread_t drain;
 } Logger;
 
-int random_range(int min, int max);
+int random_range(Rng *rng, int min, int max);
+bool random_chance(Rng *rng, double probability);
 bool stop_requested(void);
+void watch_stop_signal(void);
 bool parse_args(int argc, char **argv, Config *config);
 bool load_config_file(const char *path, Config *config);
-void init_logger(Logger *logger, const char *path);
+bool config_set(Config *config, const char *key, const char *value);
+bool validate_config(Config *config);
+int log_level_parse(const char *name);
+bool init_logger(Logger *logger, const Config *config);
 void close_logger(Logger *logger);
+bool logger_after_fork(Logger *logger);
 void log_message(Logger *logger, const char *fmt, ...);
+void log_message_at(Logger *logger, long ms, const char *fmt, ...);
+void log_event(Logger *logger, EventType type, int talker, int peer, int duration_ms);
+void log_event_at(Logger *logger, long ms, EventType type, int talker, int peer, int duration_ms);
 long elapsed_ms_since(Logger *logger);
 
+void stats_init(const Config *config);
+void stats_on_event(EventType type, int talker, int peer, int64_t ts_us);
+void stats_on_idle(int64_t us);
+void stats_on_call_wait(uint32_t depth, int64_t wait_us, bool served);
+void stats_on_index_pick(bool found, uint64_t probes_saved);
+void stats_on_index_miss(void);
+IndexStats stats_index_totals(void);
+void stats_start_reporter(Logger *logger);
+void stats_stop_reporter(void);
+void stats_dump(Logger *logger);
+void stats_report(const Config *config, Logger *logger);
+void stats_shutdown(void);
+void stats_after_fork(void);
+
+bool live_init(const Config *config);
+void live_on_event(EventType type, int talker, int peer);
+void live_start_publisher(Logger *logger);
+void live_stop_publisher(void);
+
 int run_semaphore_mode(const Config *config, Logger *logger);
 int run_condition_mode(const Config *config, Logger *logger);
+int run_des_mode(const Config *config, Logger *logger);
+int run_pool_mode(const Config *config, Logger *logger);
+int run_futex_mode(const Config *config, Logger *logger);
+int run_process_mode(const Config *config, Logger *logger);
+int run_epoll_mode(const Config *config, Logger *logger);
+int run_coro_mode(const Config *config, Logger *logger);
+int run_cluster_mode(const Config *config, Logger *logger);
+int run_replay_mode(const Config *config, Logger *logger);
+
+int run_scenario(const Config *config); // main.c: один прогон от логгера до итогов
+bool sweep_requested(int argc, char **argv);
+int run_sweep(int argc, char **argv);
 
 #endif // COMMON_H
@@ -1,4 +1,10 @@
 #include "common.h"
+#include "affinity.h"
+#include "idle_index.h"
+#include "lock_profile.h"
+#include "session_pool.h"
+#include "stop.h"
+#include "timer_wheel.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -6,21 +12,24 @@
 #include <unistd.h>
 
 typedef struct {
-    int from_id;
-    int duration_ms;
     bool ready;
-    pthread_barrier_t *sync;
+    CallSession *session;
 } CallInfo;
 
+// Мьютекс, флаги и входящий звонок читают пробы звонящих — они на своей
+// строке кэша; условная переменная и поля владельца — на следующих.
 typedef struct {
-    int id;
-    pthread_t thread;
-    pthread_mutex_t mutex;
-    pthread_cond_t incoming_cond;
-    CallInfo incoming;
+    CACHE_ALIGNED pthread_mutex_t mutex;
     bool active;
     bool busy;
+    bool timer_fired; // под mutex
+    CallInfo incoming;
+    CACHE_ALIGNED pthread_cond_t incoming_cond;
+    CACHE_ALIGNED TimerEntry timer;
+    int id;
     int conversations;
+    Rng rng;
+    pthread_t thread;
     struct SharedCondState *shared;
 } Talker;
 
@@ -28,112 +37,174 @@ typedef struct SharedCondState {
     const Config *config;
     Logger *logger;
     Talker talkers[MAX_TALKERS];
+    IdleIndex idle;
+    SessionPool sessions;
+    TimerWheel wheel;
     _Atomic int active_count;
     struct timespec start_ts;
-    _Atomic bool stop;
 } SharedCond;
 
-static void msleep(int ms) {
-    struct timespec ts;
-    ts.tv_sec = ms / 1000;
-    ts.tv_nsec = (ms % 1000) * 1000000L;
-    nanosleep(&ts, NULL);
+static void wake_sleeper(void *arg) {
+    Talker *t = (Talker *)arg;
+    prof_mutex_lock(&t->mutex, LOCK_COND_TIMER, t->id);
+    t->timer_fired = true;
+    pthread_cond_signal(&t->incoming_cond);
+    prof_mutex_unlock(&t->mutex);
 }
 
+// Пауза через общее колесо таймеров: болтун ждёт на своей условной
+// переменной, поток колеса будит его по истечении срока.
+static void talker_sleep(Talker *self, int ms) {
+    prof_mutex_lock(&self->mutex, LOCK_COND_TIMER, self->id);
+    self->timer_fired = false;
+    prof_mutex_unlock(&self->mutex);
+    timer_wheel_add(&self->shared->wheel, &self->timer, ms);
+    prof_mutex_lock(&self->mutex, LOCK_COND_TIMER, self->id);
+    while (!self->timer_fired) {
+        prof_cond_wait(&self->incoming_cond, &self->mutex, LOCK_COND_PAUSE);
+    }
+    prof_mutex_unlock(&self->mutex);
+}
+
+// Ожидание входящего звонка — не таймер колеса, его прерываем отдельно.
+static void wake_on_stop(void *arg) {
+    SharedCond *shared = (SharedCond *)arg;
+    for (int i = 0; i < shared->config->talkers; ++i) {
+        Talker *t = &shared->talkers[i];
+        prof_mutex_lock(&t->mutex, LOCK_COND_STOP, t->id);
+        pthread_cond_broadcast(&t->incoming_cond);
+        prof_mutex_unlock(&t->mutex);
+    }
+}
+
+// болтуны просыпаются по колесу, так что его тик свежий
 static bool timed_out(const SharedCond *shared) {
     if (shared->config->duration_seconds <= 0) return false;
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    long sec = now.tv_sec - shared->start_ts.tv_sec;
-    return sec >= shared->config->duration_seconds;
+    return timer_wheel_now(&shared->wheel) >= shared->config->duration_seconds * 1000L;
 }
 
 static bool should_leave(const Config *cfg, Talker *self) {
     if (cfg->stop_after_calls > 0 && self->conversations >= cfg->stop_after_calls) {
         return true;
     }
-    double r = rand() / (double)RAND_MAX;
-    return r < cfg->leave_probability;
+    return random_chance(&self->rng, cfg->leave_probability);
 }
 
 static void leave_network(SharedCond *shared, Talker *self) {
-    pthread_mutex_lock(&self->mutex);
+    prof_mutex_lock(&self->mutex, LOCK_COND_SELF, self->id);
     self->active = false;
-    pthread_mutex_unlock(&self->mutex);
+    idle_index_clear(&shared->idle, self->id);
+    prof_mutex_unlock(&self->mutex);
     int left = atomic_fetch_sub(&shared->active_count, 1) - 1;
-    log_message(shared->logger, "Болтун %d отключился (осталось %d)", self->id, left);
+    log_event(shared->logger, EVT_LEAVE, self->id, left, 0);
 }
 
-static void finish(Talker *self, SharedCond *shared, int other_id, int duration_ms) {
+// Свою линию занимаем до чужой: иначе двое, одновременно позвонившие
+// друг другу, оба ждали бы на барьере сеанса.
+static bool claim_self(SharedCond *shared, Talker *self) {
+    prof_mutex_lock(&self->mutex, LOCK_COND_SELF, self->id);
+    bool free = !self->busy && !self->incoming.ready;
+    if (free) {
+        self->busy = true;
+        idle_index_clear(&shared->idle, self->id);
+    }
+    prof_mutex_unlock(&self->mutex);
+    return free;
+}
+
+static void release_self(SharedCond *shared, Talker *self) {
+    prof_mutex_lock(&self->mutex, LOCK_COND_SELF, self->id);
     self->busy = false;
+    if (self->active && !self->incoming.ready) idle_index_set(&shared->idle, self->id);
+    prof_mutex_unlock(&self->mutex);
+}
+
+static void finish(Talker *self, SharedCond *shared, int other_id, int duration_ms) {
+    release_self(shared, self);
     self->conversations++;
-    log_message(shared->logger, "Болтун %d завершил разговор с %d (%d мс)", self->id, other_id, duration_ms);
+    log_event(shared->logger, EVT_FINISH, self->id, other_id, duration_ms);
 }
 
 static void handle_incoming(SharedCond *shared, Talker *self) {
-    pthread_mutex_lock(&self->mutex);
+    prof_mutex_lock(&self->mutex, LOCK_COND_SELF, self->id);
     while (self->incoming.ready) {
-        CallInfo info = self->incoming;
+        CallSession *session = self->incoming.session;
         self->incoming.ready = false;
-        self->incoming.sync = NULL;
+        self->incoming.session = NULL;
         self->busy = true;
-        pthread_mutex_unlock(&self->mutex);
+        prof_mutex_unlock(&self->mutex);
 
-        Talker *caller = &shared->talkers[info.from_id];
-        log_message(shared->logger, "Болтун %d отвечает на звонок %d", self->id, caller->id);
+        int caller_id = session->caller_id;
+        int duration = session->duration_ms;
+        log_event(shared->logger, EVT_ANSWER, self->id, caller_id, 0);
 
-        pthread_barrier_wait(info.sync);
+        prof_barrier_wait(&session->rendezvous, LOCK_COND_RENDEZVOUS);
+        session_release(&shared->sessions, session);
 
-        log_message(shared->logger, "Разговор %d ↔ %d (%d мс)", caller->id, self->id, info.duration_ms);
-        msleep(info.duration_ms);
+        log_event(shared->logger, EVT_TALK, caller_id, self->id, duration);
+        talker_sleep(self, duration);
 
-        finish(self, shared, caller->id, info.duration_ms);
+        finish(self, shared, caller_id, duration);
 
-        pthread_mutex_lock(&self->mutex);
+        prof_mutex_lock(&self->mutex, LOCK_COND_SELF, self->id);
     }
-    pthread_mutex_unlock(&self->mutex);
+    prof_mutex_unlock(&self->mutex);
+}
+
+// Завершившийся болтун больше не принимает звонков, но звонящий, успевший
+// передать ему сеанс, ждёт на барьере: отвечаем, иначе он зависнет.
+static void hang_up(SharedCond *shared, Talker *self) {
+    prof_mutex_lock(&self->mutex, LOCK_COND_SELF, self->id);
+    self->active = false;
+    prof_mutex_unlock(&self->mutex);
+    handle_incoming(shared, self);
 }
 
 static bool try_call(SharedCond *shared, Talker *self) {
     const Config *cfg = shared->config;
-    int duration = random_range(cfg->min_call_ms, cfg->max_call_ms);
+    int duration = random_range(&self->rng, cfg->min_call_ms, cfg->max_call_ms);
+    // нам уже звонят: ответим на следующем handle_incoming
+    if (!claim_self(shared, self)) return false;
     int attempts = 0;
 
-    while (attempts < cfg->talkers * 2 && !atomic_load(&shared->stop) && !timed_out(shared)) {
-        int target = random_range(0, cfg->talkers - 1);
-        if (target == self->id) { attempts++; continue; }
+    while (attempts < cfg->talkers * 2 && !stop_requested() && !timed_out(shared)) {
+        int target = idle_index_pick(&shared->idle, &self->rng, self->id);
+        if (target < 0) {
+            log_event(shared->logger, EVT_NO_LINE, self->id, -1, 0);
+            break;
+        }
         Talker *callee = &shared->talkers[target];
 
-        pthread_mutex_lock(&callee->mutex);
+        prof_mutex_lock(&callee->mutex, LOCK_COND_PROBE, callee->id);
         bool available = callee->active && !callee->busy && !callee->incoming.ready;
-        if (available) {
-            callee->incoming.from_id = self->id;
-            pthread_barrier_t *sync = malloc(sizeof(pthread_barrier_t));
-            pthread_barrier_init(sync, NULL, 2);
-
-            callee->incoming.duration_ms = duration;
+        CallSession *session = available ? session_acquire(&shared->sessions) : NULL;
+        if (session) {
+            // набор пишется до передачи заявки, иначе ответ опередит его в логе
+            log_event(shared->logger, EVT_DIAL, self->id, target, 0);
+            session->caller_id = self->id;
+            session->callee_id = target;
+            session->duration_ms = duration;
             callee->incoming.ready = true;
-            callee->incoming.sync = sync;
+            callee->incoming.session = session;
             callee->busy = true;
+            idle_index_clear(&shared->idle, target);
             pthread_cond_signal(&callee->incoming_cond);
-            pthread_mutex_unlock(&callee->mutex);
-
-            self->busy = true;
-            log_message(shared->logger, "Болтун %d набирает %d", self->id, target);
+            prof_mutex_unlock(&callee->mutex);
 
-            pthread_barrier_wait(sync);
-            pthread_barrier_destroy(sync);
-            free(sync);
+            prof_barrier_wait(&session->rendezvous, LOCK_COND_RENDEZVOUS);
+            session_release(&shared->sessions, session);
 
-            log_message(shared->logger, "Разговор %d ↔ %d (%d мс)", self->id, target, duration);
-            msleep(duration);
+            log_event(shared->logger, EVT_TALK, self->id, target, duration);
+            talker_sleep(self, duration);
             finish(self, shared, target, duration);
             return true;
         }
-        pthread_mutex_unlock(&callee->mutex);
-        log_message(shared->logger, "Линия %d занята для %d", target, self->id);
+        prof_mutex_unlock(&callee->mutex);
+        idle_index_note_miss(&shared->idle);
+        log_event(shared->logger, EVT_BUSY, self->id, target, 0);
         attempts++;
     }
+    release_self(shared, self);
     return false;
 }
 
@@ -141,25 +212,29 @@ static void *talker_thread(void *arg) {
     Talker *self = (Talker *)arg;
     SharedCond *shared = self->shared;
     const Config *cfg = shared->config;
+    affinity_pin_talker(cfg, self->id);
+    lock_profile_bind(self->id);
 
-    while (self->active && !atomic_load(&shared->stop) && !timed_out(shared)) {
-        int pause_ms = random_range(cfg->min_idle_ms, cfg->max_idle_ms);
-        msleep(pause_ms);
+    while (self->active && !stop_requested() && !timed_out(shared)) {
+        int pause_ms = random_range(&self->rng, cfg->min_idle_ms, cfg->max_idle_ms);
+        talker_sleep(self, pause_ms);
+        stats_on_idle((int64_t)pause_ms * 1000);
 
         handle_incoming(shared, self);
-        if (!self->active || atomic_load(&shared->stop) || timed_out(shared)) break;
+        if (!self->active || stop_requested() || timed_out(shared)) break;
 
-        if (random_range(0, 1) == 0) {
+        if (random_range(&self->rng, 0, 1) == 0) {
             // предпочтение ожиданию
-            pthread_mutex_lock(&self->mutex);
-            if (!self->incoming.ready) {
+            prof_mutex_lock(&self->mutex, LOCK_COND_SELF, self->id);
+            // проверка под мьютексом: wake_on_stop будит тоже под ним
+            if (!self->incoming.ready && !stop_requested()) {
                 struct timespec ts;
                 clock_gettime(CLOCK_REALTIME, &ts);
                 ts.tv_nsec += 100000000L;
                 if (ts.tv_nsec >= 1000000000L) { ts.tv_nsec -= 1000000000L; ts.tv_sec += 1; }
-                pthread_cond_timedwait(&self->incoming_cond, &self->mutex, &ts);
+                prof_cond_timedwait(&self->incoming_cond, &self->mutex, &ts, LOCK_COND_INCOMING_WAIT);
             }
-            pthread_mutex_unlock(&self->mutex);
+            prof_mutex_unlock(&self->mutex);
             handle_incoming(shared, self);
         } else {
             try_call(shared, self);
@@ -170,9 +245,10 @@ static void *talker_thread(void *arg) {
             break;
         }
     }
+    hang_up(shared, self);
 
     if (atomic_load(&shared->active_count) == 0) {
-        log_message(shared->logger, "Последний болтун завершил работу");
+        log_event(shared->logger, EVT_LAST, -1, -1, 0);
     }
     return NULL;
 }
@@ -180,9 +256,24 @@ static void *talker_thread(void *arg) {
 int run_condition_mode(const Config *config, Logger *logger) {
     SharedCond shared = { .config = config, .logger = logger };
     shared.active_count = config->talkers;
-    shared.stop = false;
     clock_gettime(CLOCK_MONOTONIC, &shared.start_ts);
-    srand((unsigned)time(NULL) ^ 0x55aa);
+    if (!idle_index_init(&shared.idle, config->talkers)) {
+        fprintf(stderr, "Недостаточно памяти для индекса линий\n");
+        return 1;
+    }
+    idle_index_set_shards(&shared.idle, config->shards);
+    // звонящий держит не больше одного сеанса, так что пул не исчерпается
+    if (!session_pool_init(&shared.sessions, config->talkers)) {
+        fprintf(stderr, "Недостаточно памяти для пула сеансов\n");
+        idle_index_destroy(&shared.idle);
+        return 1;
+    }
+    if (!timer_wheel_start(&shared.wheel, &shared.start_ts)) {
+        fprintf(stderr, "Не удалось запустить колесо таймеров\n");
+        session_pool_destroy(&shared.sessions);
+        idle_index_destroy(&shared.idle);
+        return 1;
+    }
 
     for (int i = 0; i < config->talkers; ++i) {
         Talker *t = &shared.talkers[i];
@@ -191,24 +282,38 @@ int run_condition_mode(const Config *config, Logger *logger) {
         t->active = true;
         t->busy = false;
         t->incoming.ready = false;
+        t->incoming.session = NULL;
+        t->timer.fire = wake_sleeper;
+        t->timer.arg = t;
+        t->timer_fired = false;
         t->conversations = 0;
+        rng_seed(&t->rng, config->seed, (uint64_t)i);
         pthread_mutex_init(&t->mutex, NULL);
         pthread_cond_init(&t->incoming_cond, NULL);
+        idle_index_set(&shared.idle, i);
     }
+    stop_watch_add(wake_on_stop, &shared);
 
     for (int i = 0; i < config->talkers; ++i) {
         pthread_create(&shared.talkers[i].thread, NULL, talker_thread, &shared.talkers[i]);
-        log_message(logger, "Болтун %d подключился", i);
+        log_event(logger, EVT_CONNECT, i, -1, 0);
     }
 
     for (int i = 0; i < config->talkers; ++i) {
         pthread_join(shared.talkers[i].thread, NULL);
     }
+    stop_watch_remove(wake_on_stop, &shared);
+    timer_wheel_stop(&shared.wheel);
+    timer_wheel_report(&shared.wheel, logger);
 
     for (int i = 0; i < config->talkers; ++i) {
         pthread_mutex_destroy(&shared.talkers[i].mutex);
         pthread_cond_destroy(&shared.talkers[i].incoming_cond);
     }
+    idle_index_report(&shared.idle, logger);
+    idle_index_destroy(&shared.idle);
+    session_pool_report(&shared.sessions, logger);
+    session_pool_destroy(&shared.sessions);
     return 0;
 }
 
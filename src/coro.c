@@ -0,0 +1,296 @@
+#define _GNU_SOURCE // MAP_ANONYMOUS, MAP_STACK
+
+#include "coro.h"
+#include "affinity.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define CORO_GUARDED_STACKS 8192
+
+static _Thread_local CoroWorker *current_worker;
+static _Thread_local Coro *current_coro;
+
+// Сопрограмма переезжает между потоками, поэтому указатели на
+// потоковые переменные нельзя держать через переключение.
+static __attribute__((noinline)) CoroWorker *this_worker(void) {
+    return current_worker;
+}
+
+static __attribute__((noinline)) Coro *this_coro(void) {
+    return current_coro;
+}
+
+static size_t round_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+static bool deque_init(CoroDeque *q, size_t capacity) {
+    size_t size = round_pow2(capacity + 1);
+    q->items = calloc(size, sizeof(*q->items));
+    q->mask = size - 1;
+    q->head = q->tail = 0;
+    pthread_mutex_init(&q->lock, NULL);
+    return q->items != NULL;
+}
+
+static void deque_destroy(CoroDeque *q) {
+    pthread_mutex_destroy(&q->lock);
+    free(q->items);
+    q->items = NULL;
+}
+
+// Каждая сопрограмма лежит не больше чем в одной очереди, так что
+// ёмкости на все сопрограммы хватает без проверки переполнения.
+static void deque_push(CoroDeque *q, Coro *co) {
+    pthread_mutex_lock(&q->lock);
+    q->items[q->tail++ & q->mask] = co;
+    pthread_mutex_unlock(&q->lock);
+}
+
+static Coro *deque_pop(CoroDeque *q) {
+    Coro *co = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->tail != q->head) co = q->items[--q->tail & q->mask];
+    pthread_mutex_unlock(&q->lock);
+    return co;
+}
+
+static Coro *deque_steal(CoroDeque *q) {
+    Coro *co = NULL;
+    if (pthread_mutex_trylock(&q->lock) != 0) return NULL;
+    if (q->tail != q->head) co = q->items[q->head++ & q->mask];
+    pthread_mutex_unlock(&q->lock);
+    return co;
+}
+
+// Готовая сопрограмма встаёт в очередь текущего потока, а если её будит
+// посторонний поток (колесо таймеров) — в очередь, где она работала.
+static void make_ready(Coro *co) {
+    CoroSched *sched = co->sched;
+    CoroWorker *w = this_worker();
+    if (!w || w->sched != sched) w = co->home;
+    deque_push(&w->runq, co);
+    atomic_fetch_add(&sched->ready, 1);
+    if (atomic_load(&sched->sleeping) > 0) {
+        pthread_mutex_lock(&sched->idle_lock);
+        pthread_cond_signal(&sched->idle_cond);
+        pthread_mutex_unlock(&sched->idle_lock);
+    }
+}
+
+// Уступает поток планировщику, не вставая в очередь: вернёт сопрограмму
+// тот, кто вызовет make_ready. Мьютекс held отпускается уже после
+// переключения, иначе будящий мог бы запустить ещё не ушедшую сопрограмму.
+static void park(pthread_mutex_t *held) {
+    Coro *co = this_coro();
+    CoroWorker *w = this_worker();
+    w->unlock_after_switch = held;
+    swapcontext(&co->ctx, &w->sched_ctx);
+}
+
+static void trampoline(unsigned int hi, unsigned int lo) {
+    Coro *co = (Coro *)(((uintptr_t)hi << 32) | (uintptr_t)lo);
+    co->fn(co->arg);
+    co->finished = true;
+    setcontext(&this_worker()->sched_ctx);
+}
+
+static Coro *next_runnable(CoroWorker *self) {
+    CoroSched *sched = self->sched;
+    Coro *co = deque_pop(&self->runq);
+    for (int i = 1; !co && i < sched->worker_count; ++i) {
+        co = deque_steal(&sched->workers[(self->index + i) % sched->worker_count].runq);
+        if (co) self->steals++;
+    }
+    if (co) atomic_fetch_sub(&sched->ready, 1);
+    return co;
+}
+
+static void *worker_thread(void *arg) {
+    CoroWorker *self = (CoroWorker *)arg;
+    CoroSched *sched = self->sched;
+    current_worker = self;
+    affinity_pin_worker(self->index);
+
+    while (atomic_load(&sched->live) > 0) {
+        Coro *co = next_runnable(self);
+        if (!co) {
+            pthread_mutex_lock(&sched->idle_lock);
+            atomic_fetch_add(&sched->sleeping, 1);
+            if (atomic_load(&sched->ready) == 0 && atomic_load(&sched->live) > 0) {
+                pthread_cond_wait(&sched->idle_cond, &sched->idle_lock);
+            }
+            atomic_fetch_sub(&sched->sleeping, 1);
+            pthread_mutex_unlock(&sched->idle_lock);
+            continue;
+        }
+
+        co->home = self;
+        current_coro = co;
+        swapcontext(&self->sched_ctx, &co->ctx);
+        current_coro = NULL;
+        self->switches++;
+        if (self->unlock_after_switch) {
+            pthread_mutex_unlock(self->unlock_after_switch);
+            self->unlock_after_switch = NULL;
+        }
+        if (co->finished && atomic_fetch_sub(&sched->live, 1) == 1) {
+            pthread_mutex_lock(&sched->idle_lock);
+            pthread_cond_broadcast(&sched->idle_cond);
+            pthread_mutex_unlock(&sched->idle_lock);
+        }
+    }
+    current_worker = NULL;
+    return NULL;
+}
+
+bool coro_sched_init(CoroSched *sched, int workers, int capacity, size_t stack_size) {
+    memset(sched, 0, sizeof(*sched));
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    sched->stack_stride = (stack_size + page - 1) / page * page + page;
+    sched->capacity = capacity;
+    sched->worker_count = workers;
+    atomic_init(&sched->live, 0);
+    atomic_init(&sched->ready, 0);
+    atomic_init(&sched->sleeping, 0);
+    pthread_mutex_init(&sched->idle_lock, NULL);
+    pthread_cond_init(&sched->idle_cond, NULL);
+
+    sched->coros = calloc((size_t)capacity, sizeof(Coro));
+    sched->workers = calloc((size_t)workers, sizeof(CoroWorker));
+    void *stacks = mmap(NULL, sched->stack_stride * (size_t)capacity, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK | MAP_NORESERVE, -1, 0);
+    sched->stacks = stacks == MAP_FAILED ? NULL : stacks;
+    if (!sched->coros || !sched->workers || !sched->stacks) return false;
+
+    // сторожевая страница под стеком ловит переполнение, но каждая делит
+    // отображение надвое, а их число ограничено vm.max_map_count
+    int guarded = capacity < CORO_GUARDED_STACKS ? capacity : CORO_GUARDED_STACKS;
+    for (int i = 0; i < guarded; ++i) {
+        mprotect(sched->stacks + sched->stack_stride * (size_t)i, page, PROT_NONE);
+    }
+    for (int i = 0; i < workers; ++i) {
+        CoroWorker *w = &sched->workers[i];
+        w->index = i;
+        w->sched = sched;
+        if (!deque_init(&w->runq, (size_t)capacity)) return false;
+    }
+    return true;
+}
+
+bool coro_spawn(CoroSched *sched, void (*fn)(void *arg), void *arg) {
+    if (sched->coro_count >= sched->capacity) return false;
+    int index = sched->coro_count++;
+    Coro *co = &sched->coros[index];
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    co->stack = sched->stacks + sched->stack_stride * (size_t)index + page;
+    co->fn = fn;
+    co->arg = arg;
+    co->sched = sched;
+    co->home = &sched->workers[index % sched->worker_count];
+    getcontext(&co->ctx);
+    co->ctx.uc_stack.ss_sp = co->stack;
+    co->ctx.uc_stack.ss_size = sched->stack_stride - page;
+    co->ctx.uc_link = NULL;
+    uintptr_t p = (uintptr_t)co;
+    makecontext(&co->ctx, (void (*)(void))trampoline, 2, (unsigned int)(p >> 32), (unsigned int)p);
+    atomic_fetch_add(&sched->live, 1);
+    deque_push(&co->home->runq, co);
+    atomic_fetch_add(&sched->ready, 1);
+    return true;
+}
+
+// Поток 0 — вызывающий; возвращается, когда все сопрограммы завершились.
+void coro_sched_run(CoroSched *sched) {
+    for (int i = 1; i < sched->worker_count; ++i) {
+        pthread_create(&sched->workers[i].thread, NULL, worker_thread, &sched->workers[i]);
+    }
+    worker_thread(&sched->workers[0]);
+    for (int i = 1; i < sched->worker_count; ++i) {
+        pthread_join(sched->workers[i].thread, NULL);
+    }
+}
+
+void coro_sched_destroy(CoroSched *sched) {
+    if (sched->workers) {
+        for (int i = 0; i < sched->worker_count; ++i) {
+            if (sched->workers[i].runq.items) deque_destroy(&sched->workers[i].runq);
+        }
+    }
+    if (sched->stacks) munmap(sched->stacks, sched->stack_stride * (size_t)sched->capacity);
+    free(sched->workers);
+    free(sched->coros);
+    pthread_mutex_destroy(&sched->idle_lock);
+    pthread_cond_destroy(&sched->idle_cond);
+    sched->workers = NULL;
+    sched->coros = NULL;
+    sched->stacks = NULL;
+}
+
+void coro_sched_report(const CoroSched *sched, Logger *logger) {
+    unsigned long switches = 0;
+    unsigned long steals = 0;
+    for (int i = 0; i < sched->worker_count; ++i) {
+        switches += sched->workers[i].switches;
+        steals += sched->workers[i].steals;
+    }
+    log_message(logger, "Сопрограммы: %d, потоков %d, переключений %lu, краж %lu",
+                sched->coro_count, sched->worker_count, switches, steals);
+}
+
+void coro_sem_init(CoroSem *sem, int value) {
+    pthread_mutex_init(&sem->lock, NULL);
+    sem->count = value;
+    sem->waiter = NULL;
+}
+
+void coro_sem_destroy(CoroSem *sem) {
+    pthread_mutex_destroy(&sem->lock);
+}
+
+void coro_sem_wait(CoroSem *sem) {
+    pthread_mutex_lock(&sem->lock);
+    if (sem->count > 0) {
+        sem->count--;
+        pthread_mutex_unlock(&sem->lock);
+        return;
+    }
+    sem->waiter = this_coro();
+    park(&sem->lock);
+}
+
+bool coro_sem_trywait(CoroSem *sem) {
+    pthread_mutex_lock(&sem->lock);
+    bool taken = sem->count > 0;
+    if (taken) sem->count--;
+    pthread_mutex_unlock(&sem->lock);
+    return taken;
+}
+
+// Семафор может лежать на стеке ожидающего: после unlock его не трогаем.
+void coro_sem_post(CoroSem *sem) {
+    pthread_mutex_lock(&sem->lock);
+    Coro *waiter = sem->waiter;
+    sem->waiter = NULL;
+    if (!waiter) sem->count++;
+    pthread_mutex_unlock(&sem->lock);
+    if (waiter) make_ready(waiter);
+}
+
+static void wake_sleeper(void *arg) {
+    coro_sem_post((CoroSem *)arg);
+}
+
+void coro_sleep(TimerWheel *wheel, int ms) {
+    CoroSem done;
+    coro_sem_init(&done, 0);
+    TimerEntry timer = { .fire = wake_sleeper, .arg = &done };
+    timer_wheel_add(wheel, &timer, ms);
+    coro_sem_wait(&done);
+    coro_sem_destroy(&done);
+}
@@ -0,0 +1,81 @@
+#ifndef CORO_H
+#define CORO_H
+
+#include "common.h"
+#include "timer_wheel.h"
+
+#include <ucontext.h>
+
+// Стековые сопрограммы на ucontext поверх пула рабочих потоков с кражей
+// работы. У каждого потока своя очередь готовых сопрограмм: владелец берёт
+// с хвоста, простаивающие потоки крадут с головы чужих очередей.
+// Блокирующие точки (сон, ожидание семафора) уступают поток другим.
+struct CoroWorker;
+struct CoroSched;
+
+typedef struct Coro {
+    ucontext_t ctx;
+    void *stack;
+    void (*fn)(void *arg);
+    void *arg;
+    bool finished;
+    struct CoroWorker *home; // где сопрограмма работала последней
+    struct CoroSched *sched;
+} Coro;
+
+typedef struct {
+    pthread_mutex_t lock;
+    Coro **items;
+    size_t mask;
+    size_t head; // отсюда крадут
+    size_t tail; // сюда кладёт и отсюда берёт владелец
+} CoroDeque;
+
+typedef struct CoroWorker {
+    pthread_t thread;
+    ucontext_t sched_ctx;
+    CoroDeque runq;
+    pthread_mutex_t *unlock_after_switch; // отпускается уже на стеке планировщика
+    unsigned long switches;
+    unsigned long steals;
+    int index;
+    struct CoroSched *sched;
+} CoroWorker;
+
+typedef struct CoroSched {
+    CoroWorker *workers;
+    int worker_count;
+    Coro *coros;
+    int coro_count;
+    int capacity;
+    char *stacks; // один mmap: стеки со сторожевыми страницами
+    size_t stack_stride;
+    _Atomic int live;
+    _Atomic long ready; // готовых сопрограмм во всех очередях
+    _Atomic int sleeping; // потоков, ждущих idle_cond
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+} CoroSched;
+
+// Семафор для сопрограмм: ждущая сопрограмма не занимает поток.
+typedef struct {
+    pthread_mutex_t lock;
+    int count;
+    Coro *waiter; // у семафора болтуна не больше одного ожидающего
+} CoroSem;
+
+bool coro_sched_init(CoroSched *sched, int workers, int capacity, size_t stack_size);
+bool coro_spawn(CoroSched *sched, void (*fn)(void *arg), void *arg);
+void coro_sched_run(CoroSched *sched);
+void coro_sched_destroy(CoroSched *sched);
+void coro_sched_report(const CoroSched *sched, Logger *logger);
+
+void coro_sem_init(CoroSem *sem, int value);
+void coro_sem_destroy(CoroSem *sem);
+void coro_sem_wait(CoroSem *sem);
+bool coro_sem_trywait(CoroSem *sem);
+void coro_sem_post(CoroSem *sem);
+
+void coro_sleep(TimerWheel *wheel, int ms);
+
+#endif // CORO_H
@@ -0,0 +1,263 @@
+#include "common.h"
+#include "coro.h"
+#include "idle_index.h"
+#include "timer_wheel.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+// Тот же последовательный сценарий болтуна, что в режиме semaphore, но
+// болтун — сопрограмма: сон и ожидание ответа уступают рабочий поток
+// другим болтунам вместо блокировки потока ядра.
+#define CORO_STACK_SIZE (128 * 1024)
+
+typedef struct {
+    int from_id;
+    int duration_ms;
+    bool has_request;
+} CallRequest;
+
+typedef struct {
+    int id;
+    pthread_mutex_t mutex;
+    CoroSem incoming_sem;
+    CoroSem answer_sem;
+    CallRequest incoming;
+    bool active;
+    bool busy;
+    int conversations;
+    Rng rng;
+    struct CoroShared *shared;
+} Talker;
+
+typedef struct CoroShared {
+    const Config *config;
+    Logger *logger;
+    Talker *talkers;
+    IdleIndex idle;
+    TimerWheel wheel;
+    CoroSched sched;
+    _Atomic int active_count;
+} Shared;
+
+// болтуны просыпаются по колесу, так что его тик свежий
+static bool timed_out(const Shared *shared) {
+    if (shared->config->duration_seconds <= 0) return false;
+    return timer_wheel_now(&shared->wheel) >= shared->config->duration_seconds * 1000L;
+}
+
+static void release_self(Talker *self) {
+    pthread_mutex_lock(&self->mutex);
+    self->busy = false;
+    if (self->active) idle_index_set(&self->shared->idle, self->id);
+    pthread_mutex_unlock(&self->mutex);
+}
+
+static void finish_conversation(Shared *shared, Talker *self, int other_id, int duration_ms) {
+    log_event(shared->logger, EVT_FINISH, self->id, other_id, duration_ms);
+    release_self(self);
+    self->conversations++;
+}
+
+static bool should_leave(const Config *cfg, Talker *self) {
+    if (cfg->stop_after_calls > 0 && self->conversations >= cfg->stop_after_calls) {
+        return true;
+    }
+    return random_chance(&self->rng, cfg->leave_probability);
+}
+
+static void leave_network(Shared *shared, Talker *self) {
+    pthread_mutex_lock(&self->mutex);
+    self->active = false;
+    idle_index_clear(&shared->idle, self->id);
+    pthread_mutex_unlock(&self->mutex);
+    int left = atomic_fetch_sub(&shared->active_count, 1) - 1;
+    log_event(shared->logger, EVT_LEAVE, self->id, left, 0);
+}
+
+static void answer_call(Shared *shared, Talker *self) {
+    pthread_mutex_lock(&self->mutex);
+    CallRequest req = self->incoming;
+    self->incoming.has_request = false;
+    pthread_mutex_unlock(&self->mutex);
+
+    Talker *caller = &shared->talkers[req.from_id];
+    log_event(shared->logger, EVT_ANSWER, self->id, caller->id, 0);
+    coro_sem_post(&caller->answer_sem);
+
+    log_event(shared->logger, EVT_TALK, caller->id, self->id, req.duration_ms);
+    coro_sleep(&shared->wheel, req.duration_ms);
+
+    finish_conversation(shared, self, caller->id, req.duration_ms);
+}
+
+static void handle_incoming(Shared *shared, Talker *self) {
+    while (coro_sem_trywait(&self->incoming_sem)) {
+        answer_call(shared, self);
+    }
+}
+
+// Завершившийся болтун больше не принимает звонков, но звонящий, успевший
+// занять его линию, ждёт ответа: дожидаемся его сигнала и отвечаем,
+// иначе сопрограмма звонящего не завершится никогда.
+static void hang_up(Shared *shared, Talker *self) {
+    pthread_mutex_lock(&self->mutex);
+    self->active = false;
+    bool pending = self->incoming.has_request;
+    pthread_mutex_unlock(&self->mutex);
+    if (pending) {
+        coro_sem_wait(&self->incoming_sem);
+        answer_call(shared, self);
+    }
+}
+
+// Свою линию занимаем до чужой: сопрограммы на разных рабочих потоках
+// могут позвонить друг другу одновременно и обе ждать ответа.
+static bool claim_self(Shared *shared, Talker *self) {
+    pthread_mutex_lock(&self->mutex);
+    bool free = !self->busy;
+    if (free) {
+        self->busy = true;
+        idle_index_clear(&shared->idle, self->id);
+    }
+    pthread_mutex_unlock(&self->mutex);
+    return free;
+}
+
+static bool try_start_call(Shared *shared, Talker *self) {
+    const Config *cfg = shared->config;
+    int duration = random_range(&self->rng, cfg->min_call_ms, cfg->max_call_ms);
+    // нам уже звонят: ответим на следующем handle_incoming
+    if (!claim_self(shared, self)) return false;
+
+    int attempts = 0;
+    while (attempts < cfg->talkers * 2 && !stop_requested() && !timed_out(shared)) {
+        int target = idle_index_pick(&shared->idle, &self->rng, self->id);
+        if (target < 0) {
+            log_event(shared->logger, EVT_NO_LINE, self->id, -1, 0);
+            break;
+        }
+        Talker *callee = &shared->talkers[target];
+
+        pthread_mutex_lock(&callee->mutex);
+        bool available = callee->active && !callee->busy;
+        if (available) {
+            callee->busy = true;
+            idle_index_clear(&shared->idle, target);
+            callee->incoming.from_id = self->id;
+            callee->incoming.duration_ms = duration;
+            callee->incoming.has_request = true;
+            pthread_mutex_unlock(&callee->mutex);
+
+            log_event(shared->logger, EVT_DIAL, self->id, target, 0);
+            coro_sem_post(&callee->incoming_sem);
+            coro_sem_wait(&self->answer_sem);
+            log_event(shared->logger, EVT_TALK, self->id, target, duration);
+            coro_sleep(&shared->wheel, duration);
+            finish_conversation(shared, self, target, duration);
+            return true;
+        }
+        pthread_mutex_unlock(&callee->mutex);
+        idle_index_note_miss(&shared->idle);
+        log_event(shared->logger, EVT_BUSY, self->id, target, 0);
+        attempts++;
+    }
+    release_self(self);
+    return false;
+}
+
+static void talker_coro(void *arg) {
+    Talker *self = (Talker *)arg;
+    Shared *shared = self->shared;
+    const Config *cfg = shared->config;
+    log_event(shared->logger, EVT_CONNECT, self->id, -1, 0);
+
+    while (self->active && !stop_requested() && !timed_out(shared)) {
+        int pause_ms = random_range(&self->rng, cfg->min_idle_ms, cfg->max_idle_ms);
+        coro_sleep(&shared->wheel, pause_ms);
+        stats_on_idle((int64_t)pause_ms * 1000);
+
+        handle_incoming(shared, self);
+        if (!self->active || stop_requested() || timed_out(shared)) break;
+
+        if (random_range(&self->rng, 0, 1) == 0) {
+            // предпочитаем дождаться входящих
+            handle_incoming(shared, self);
+        } else {
+            try_start_call(shared, self);
+        }
+
+        if (should_leave(cfg, self)) {
+            leave_network(shared, self);
+            break;
+        }
+    }
+    hang_up(shared, self);
+
+    if (atomic_load(&shared->active_count) == 0) {
+        log_event(shared->logger, EVT_LAST, -1, -1, 0);
+    }
+}
+
+// initialized — сколько болтунов успели получить мьютекс и семафоры
+static void destroy_shared(Shared *shared, int initialized) {
+    for (int i = 0; i < initialized; ++i) {
+        pthread_mutex_destroy(&shared->talkers[i].mutex);
+        coro_sem_destroy(&shared->talkers[i].incoming_sem);
+        coro_sem_destroy(&shared->talkers[i].answer_sem);
+    }
+    idle_index_destroy(&shared->idle);
+    coro_sched_destroy(&shared->sched);
+    free(shared->talkers);
+    free(shared);
+}
+
+int run_coro_mode(const Config *config, Logger *logger) {
+    Shared *shared = calloc(1, sizeof(Shared));
+    if (!shared) return 1;
+    shared->config = config;
+    shared->logger = logger;
+    atomic_init(&shared->active_count, config->talkers);
+    int workers = config->workers > 0 ? config->workers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (workers < 1) workers = 1;
+    if (workers > config->talkers) workers = config->talkers;
+
+    shared->talkers = calloc((size_t)config->talkers, sizeof(Talker));
+    bool ok = shared->talkers && idle_index_init(&shared->idle, config->talkers)
+        && coro_sched_init(&shared->sched, workers, config->talkers, CORO_STACK_SIZE);
+    if (ok) idle_index_set_shards(&shared->idle, config->shards);
+    // время колеса — время лога, как у таймаутов в остальных режимах
+    if (!ok || !timer_wheel_start(&shared->wheel, &logger->start_ts)) {
+        fprintf(stderr, "Недостаточно памяти для сопрограмм\n");
+        destroy_shared(shared, 0);
+        return 1;
+    }
+
+    for (int i = 0; i < config->talkers; ++i) {
+        Talker *t = &shared->talkers[i];
+        t->id = i;
+        t->shared = shared;
+        t->active = true;
+        rng_seed(&t->rng, config->seed, (uint64_t)i);
+        pthread_mutex_init(&t->mutex, NULL);
+        coro_sem_init(&t->incoming_sem, 0);
+        coro_sem_init(&t->answer_sem, 0);
+        idle_index_set(&shared->idle, i);
+        // созданные раньше сопрограммы ещё не запускались, их стеки освободит
+        // coro_sched_destroy
+        if (!coro_spawn(&shared->sched, talker_coro, t)) {
+            fprintf(stderr, "Не удалось создать сопрограмму болтуна %d\n", i);
+            timer_wheel_stop(&shared->wheel);
+            destroy_shared(shared, i + 1);
+            return 1;
+        }
+    }
+
+    coro_sched_run(&shared->sched);
+    timer_wheel_stop(&shared->wheel);
+    coro_sched_report(&shared->sched, logger);
+    timer_wheel_report(&shared->wheel, logger);
+    idle_index_report(&shared->idle, logger);
+    destroy_shared(shared, config->talkers);
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "common.h"
+#include "event_queue.h"
+#include "fsm.h"
+
+// Дискретно-событийная модель: болтуны не спят, а календарь событий
+// продвигает виртуальное время от одного события к следующему.
+typedef struct {
+    EventQueue calendar;
+    long now_ms;
+    bool out_of_memory;
+} DesEngine;
+
+static long des_now(void *ctx) {
+    return ((DesEngine *)ctx)->now_ms;
+}
+
+static void des_schedule(void *ctx, int talker_id, long at_ms, FsmEventKind kind) {
+    DesEngine *engine = (DesEngine *)ctx;
+    if (!event_queue_push(&engine->calendar, at_ms, talker_id, (int)kind)) {
+        engine->out_of_memory = true;
+    }
+}
+
+int run_des_mode(const Config *config, Logger *logger) {
+    DesEngine engine = { .now_ms = 0 };
+    if (!event_queue_init(&engine.calendar, (size_t)config->talkers * 2)) {
+        fprintf(stderr, "Недостаточно памяти для календаря событий\n");
+        return 1;
+    }
+
+    FsmNetwork net;
+    FsmDriver driver = { .ctx = &engine, .now_ms = des_now, .schedule = des_schedule };
+    if (!fsm_init(&net, config, logger, driver)) {
+        fprintf(stderr, "Недостаточно памяти для болтунов\n");
+        event_queue_destroy(&engine.calendar);
+        return 1;
+    }
+
+    fsm_start(&net);
+
+    unsigned long processed = 0;
+    SimEvent ev;
+    while (!engine.out_of_memory && event_queue_pop(&engine.calendar, &ev)) {
+        if (fsm_should_stop(&net, ev.at_ms)) {
+            engine.now_ms = net.deadline_ms >= 0 && ev.at_ms > net.deadline_ms ? net.deadline_ms : ev.at_ms;
+            break;
+        }
+        engine.now_ms = ev.at_ms;
+        fsm_dispatch(&net, ev.talker, (FsmEventKind)ev.kind);
+        processed++;
+    }
+
+    int rc = 0;
+    if (engine.out_of_memory) {
+        fprintf(stderr, "Недостаточно памяти для календаря событий\n");
+        rc = 1;
+    }
+    log_message_at(logger, engine.now_ms, "Модельное время %ld мс, обработано событий: %lu",
+                   engine.now_ms, processed);
+
+    if (!fsm_destroy(&net)) rc = 1;
+    event_queue_destroy(&engine.calendar);
+    return rc;
+}
@@ -0,0 +1,268 @@
+#define _GNU_SOURCE // timerfd, eventfd, epoll
+
+#include "common.h"
+#include "affinity.h"
+#include "event_queue.h"
+#include "fsm.h"
+#include "stop.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+// Болтуны — автоматы из fsm.c, как в pool, но поток не спит на условной
+// переменной: цикл epoll ждёт timerfd, взведённый на ближайшее событие
+// календаря, и eventfd, которым другие циклы будят его. Болтун закреплён
+// за циклом (id % loops); свой календарь цикл трогает без блокировок,
+// события для чужих болтунов попадают во входящую очередь цикла-владельца.
+struct LoopSet;
+
+typedef struct {
+    pthread_t thread;
+    int epoll_fd;
+    int timer_fd;
+    int wake_fd;
+    long armed_at; // на что взведён timerfd, -1 — не взведён
+    EventQueue timers;
+    pthread_mutex_t inbox_lock;
+    EventQueue inbox;
+    unsigned long processed;
+    unsigned long wakeups;
+    struct LoopSet *set;
+} Loop;
+
+typedef struct LoopSet {
+    FsmNetwork net;
+    Logger *logger;
+    Loop *loops;
+    int loop_count;
+    _Atomic long pending; // запланированные, но не исполненные события
+    _Atomic bool done;
+    _Atomic bool out_of_memory;
+} LoopSet;
+
+static _Thread_local Loop *current_loop;
+
+static long loop_now(void *ctx) {
+    return elapsed_ms_since(((LoopSet *)ctx)->logger);
+}
+
+static void notify(int fd) {
+    uint64_t one = 1;
+    while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+    }
+}
+
+// с шардами болтуны одного шарда живут в одном цикле
+static Loop *home_loop(LoopSet *set, int talker_id) {
+    const Config *cfg = set->net.config;
+    int slot = cfg->shards > 1 ? shard_of(talker_id, cfg->talkers, cfg->shards) : talker_id;
+    return &set->loops[slot % set->loop_count];
+}
+
+static void loop_schedule(void *ctx, int talker_id, long at_ms, FsmEventKind kind) {
+    LoopSet *set = (LoopSet *)ctx;
+    Loop *owner = home_loop(set, talker_id);
+    atomic_fetch_add(&set->pending, 1);
+    bool ok;
+    if (owner == current_loop) {
+        ok = event_queue_push(&owner->timers, at_ms, talker_id, (int)kind);
+    } else {
+        pthread_mutex_lock(&owner->inbox_lock);
+        bool first = owner->inbox.size == 0;
+        ok = event_queue_push(&owner->inbox, at_ms, talker_id, (int)kind);
+        pthread_mutex_unlock(&owner->inbox_lock);
+        if (first) notify(owner->wake_fd);
+    }
+    if (!ok) {
+        atomic_store(&set->out_of_memory, true);
+        atomic_store(&set->done, true);
+    }
+}
+
+static void finish_loops(LoopSet *set) {
+    atomic_store(&set->done, true);
+    for (int i = 0; i < set->loop_count; ++i) {
+        notify(set->loops[i].wake_fd);
+    }
+}
+
+static void drain_inbox(Loop *self) {
+    uint64_t count;
+    while (read(self->wake_fd, &count, sizeof(count)) < 0 && errno == EINTR) {
+    }
+    pthread_mutex_lock(&self->inbox_lock);
+    SimEvent ev;
+    while (event_queue_pop(&self->inbox, &ev)) {
+        if (!event_queue_push(&self->timers, ev.at_ms, ev.talker, ev.kind)) {
+            atomic_store(&self->set->out_of_memory, true);
+            atomic_store(&self->set->done, true);
+        }
+    }
+    pthread_mutex_unlock(&self->inbox_lock);
+}
+
+// Остановку цикл проверяет перед каждым epoll_wait, а eventfd хранит
+// пробуждение, пока его не прочтут: гонки с проверкой нет.
+static void wake_loops(void *arg) {
+    LoopSet *set = (LoopSet *)arg;
+    for (int i = 0; i < set->loop_count; ++i) {
+        notify(set->loops[i].wake_fd);
+    }
+}
+
+// timerfd взводится на абсолютное время CLOCK_MONOTONIC от начала лога;
+// at_ms < 0 снимает таймер
+static void arm_timer(Loop *self, long at_ms) {
+    if (at_ms == self->armed_at) return;
+    struct itimerspec spec = {0};
+    if (at_ms < 0) {
+        timerfd_settime(self->timer_fd, 0, &spec, NULL);
+        self->armed_at = -1;
+        return;
+    }
+    spec.it_value = self->set->logger->start_ts;
+    spec.it_value.tv_sec += at_ms / 1000;
+    spec.it_value.tv_nsec += (at_ms % 1000) * 1000000L;
+    if (spec.it_value.tv_nsec >= 1000000000L) {
+        spec.it_value.tv_nsec -= 1000000000L;
+        spec.it_value.tv_sec += 1;
+    }
+    timerfd_settime(self->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL);
+    self->armed_at = at_ms;
+}
+
+static void *loop_thread(void *arg) {
+    Loop *self = (Loop *)arg;
+    LoopSet *set = self->set;
+    FsmNetwork *net = &set->net;
+    current_loop = self;
+    affinity_pin_worker((int)(self - set->loops));
+
+    while (!atomic_load(&set->done)) {
+        long now = loop_now(set);
+        if (fsm_should_stop(net, now)) {
+            finish_loops(set);
+            break;
+        }
+
+        SimEvent ev;
+        const SimEvent *top = event_queue_peek(&self->timers);
+        if (top && top->at_ms <= now) {
+            event_queue_pop(&self->timers, &ev);
+            fsm_dispatch(net, ev.talker, (FsmEventKind)ev.kind);
+            self->processed++;
+            if (atomic_fetch_sub(&set->pending, 1) == 1) finish_loops(set);
+            continue;
+        }
+
+        // ближайший таймер или дедлайн; SIGINT будит wake_loops через eventfd
+        long wake_at = top ? top->at_ms : -1;
+        if (net->deadline_ms >= 0 && (wake_at < 0 || wake_at > net->deadline_ms)) wake_at = net->deadline_ms;
+        arm_timer(self, wake_at);
+
+        struct epoll_event events[2];
+        int n = epoll_wait(self->epoll_fd, events, 2, -1);
+        self->wakeups++;
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.fd == self->wake_fd) {
+                drain_inbox(self);
+            } else {
+                uint64_t expirations;
+                while (read(self->timer_fd, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {
+                }
+                self->armed_at = -1;
+            }
+        }
+    }
+    return NULL;
+}
+
+static bool open_loop(Loop *loop, LoopSet *set, size_t capacity) {
+    loop->set = set;
+    loop->armed_at = -1;
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    loop->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    pthread_mutex_init(&loop->inbox_lock, NULL);
+    if (!event_queue_init(&loop->timers, capacity) || !event_queue_init(&loop->inbox, 16)) return false;
+    if (loop->epoll_fd < 0 || loop->timer_fd < 0 || loop->wake_fd < 0) return false;
+
+    struct epoll_event ev = { .events = EPOLLIN };
+    ev.data.fd = loop->timer_fd;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->timer_fd, &ev) < 0) return false;
+    ev.data.fd = loop->wake_fd;
+    return epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &ev) == 0;
+}
+
+static void close_loop(Loop *loop) {
+    if (loop->epoll_fd >= 0) close(loop->epoll_fd);
+    if (loop->timer_fd >= 0) close(loop->timer_fd);
+    if (loop->wake_fd >= 0) close(loop->wake_fd);
+    pthread_mutex_destroy(&loop->inbox_lock);
+    event_queue_destroy(&loop->timers);
+    event_queue_destroy(&loop->inbox);
+}
+
+// Цикл 0 исполняется в вызывающем потоке: с одним циклом режим однопоточный.
+int run_epoll_mode(const Config *config, Logger *logger) {
+    LoopSet set = { .logger = logger };
+    set.loop_count = config->workers > 0 ? config->workers : 1;
+    if (set.loop_count > config->talkers) set.loop_count = config->talkers;
+    atomic_init(&set.pending, 0);
+    atomic_init(&set.done, false);
+    atomic_init(&set.out_of_memory, false);
+
+    FsmDriver driver = { .ctx = &set, .now_ms = loop_now, .schedule = loop_schedule };
+    set.loops = calloc((size_t)set.loop_count, sizeof(Loop));
+    if (!set.loops || !fsm_init(&set.net, config, logger, driver)) {
+        fprintf(stderr, "Недостаточно памяти для болтунов\n");
+        free(set.loops);
+        return 1;
+    }
+
+    int rc = 0;
+    size_t per_loop = (size_t)config->talkers / (size_t)set.loop_count + 1;
+    for (int i = 0; i < set.loop_count; ++i) {
+        if (!open_loop(&set.loops[i], &set, per_loop * 2)) {
+            perror("epoll loop");
+            rc = 1;
+        }
+    }
+
+    if (rc == 0) {
+        stop_watch_add(wake_loops, &set);
+        current_loop = &set.loops[0];
+        fsm_start(&set.net);
+        for (int i = 1; i < set.loop_count; ++i) {
+            pthread_create(&set.loops[i].thread, NULL, loop_thread, &set.loops[i]);
+        }
+        loop_thread(&set.loops[0]);
+        current_loop = NULL;
+
+        unsigned long processed = set.loops[0].processed;
+        unsigned long wakeups = set.loops[0].wakeups;
+        for (int i = 1; i < set.loop_count; ++i) {
+            pthread_join(set.loops[i].thread, NULL);
+            processed += set.loops[i].processed;
+            wakeups += set.loops[i].wakeups;
+        }
+        stop_watch_remove(wake_loops, &set);
+        log_message(logger, "epoll: %d циклов, обработано событий: %lu, пробуждений: %lu",
+                    set.loop_count, processed, wakeups);
+    }
+
+    if (atomic_load(&set.out_of_memory)) {
+        fprintf(stderr, "Недостаточно памяти для календаря событий\n");
+        rc = 1;
+    }
+    for (int i = 0; i < set.loop_count; ++i) {
+        close_loop(&set.loops[i]);
+    }
+    free(set.loops);
+    if (!fsm_destroy(&set.net)) rc = 1;
+    return rc;
+}
@@ -0,0 +1,67 @@
+#include "event_queue.h"
+
+#include <stdlib.h>
+
+static bool earlier(const SimEvent *a, const SimEvent *b) {
+    if (a->at_ms != b->at_ms) return a->at_ms < b->at_ms;
+    return a->seq < b->seq;
+}
+
+bool event_queue_init(EventQueue *queue, size_t capacity) {
+    if (capacity < 16) capacity = 16;
+    queue->items = malloc(capacity * sizeof(SimEvent));
+    queue->size = 0;
+    queue->capacity = queue->items ? capacity : 0;
+    queue->next_seq = 0;
+    return queue->items != NULL;
+}
+
+void event_queue_destroy(EventQueue *queue) {
+    free(queue->items);
+    queue->items = NULL;
+    queue->size = queue->capacity = 0;
+}
+
+bool event_queue_push(EventQueue *queue, long at_ms, int talker, int kind) {
+    if (queue->size == queue->capacity) {
+        size_t capacity = queue->capacity ? queue->capacity * 2 : 16;
+        SimEvent *items = realloc(queue->items, capacity * sizeof(SimEvent));
+        if (!items) return false;
+        queue->items = items;
+        queue->capacity = capacity;
+    }
+
+    SimEvent ev = { .at_ms = at_ms, .seq = queue->next_seq++, .talker = talker, .kind = kind };
+    size_t i = queue->size++;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!earlier(&ev, &queue->items[parent])) break;
+        queue->items[i] = queue->items[parent];
+        i = parent;
+    }
+    queue->items[i] = ev;
+    return true;
+}
+
+const SimEvent *event_queue_peek(const EventQueue *queue) {
+    return queue->size ? &queue->items[0] : NULL;
+}
+
+bool event_queue_pop(EventQueue *queue, SimEvent *out) {
+    if (!queue->size) return false;
+    *out = queue->items[0];
+    SimEvent last = queue->items[--queue->size];
+
+    size_t i = 0;
+    size_t n = queue->size;
+    while (true) {
+        size_t child = 2 * i + 1;
+        if (child >= n) break;
+        if (child + 1 < n && earlier(&queue->items[child + 1], &queue->items[child])) child++;
+        if (!earlier(&queue->items[child], &last)) break;
+        queue->items[i] = queue->items[child];
+        i = child;
+    }
+    if (n) queue->items[i] = last;
+    return true;
+}
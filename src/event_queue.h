@@ -0,0 +1,29 @@
+#ifndef EVENT_QUEUE_H
+#define EVENT_QUEUE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Календарь событий: двоичная min-куча по времени срабатывания.
+// При равном времени события извлекаются в порядке добавления.
+typedef struct {
+    long at_ms;
+    unsigned long seq;
+    int talker;
+    int kind;
+} SimEvent;
+
+typedef struct {
+    SimEvent *items;
+    size_t size;
+    size_t capacity;
+    unsigned long next_seq;
+} EventQueue;
+
+bool event_queue_init(EventQueue *queue, size_t capacity);
+void event_queue_destroy(EventQueue *queue);
+bool event_queue_push(EventQueue *queue, long at_ms, int talker, int kind);
+bool event_queue_pop(EventQueue *queue, SimEvent *out);
+const SimEvent *event_queue_peek(const EventQueue *queue);
+
+#endif // EVENT_QUEUE_H
@@ -0,0 +1,228 @@
+#include "fsm.h"
+#include "journal.h"
+
+#include <stdlib.h>
+
+static void schedule(FsmNetwork *net, int talker_id, long at_ms, FsmEventKind kind) {
+    net->driver.schedule(net->driver.ctx, talker_id, at_ms, kind);
+}
+
+// Случайные значения, выбор адресата и захваты линий идут через журнал,
+// когда прогон записывается или воспроизводится.
+static int draw_range(FsmNetwork *net, FsmTalker *self, int min, int max) {
+    if (net->journal) return journal_range(net->journal, &self->rng, min, max);
+    return random_range(&self->rng, min, max);
+}
+
+static int pick_callee(FsmNetwork *net, FsmTalker *self) {
+    if (net->journal) return journal_pick(net->journal, &net->idle, &self->rng, self->id);
+    return idle_index_pick(&net->idle, &self->rng, self->id);
+}
+
+static bool claim(FsmNetwork *net, LineWord *line, uint64_t expected, uint64_t desired) {
+    if (net->journal) return journal_claim(net->journal, line, expected, desired);
+    return line_claim(line, expected, desired);
+}
+
+static bool should_leave(FsmNetwork *net, FsmTalker *self) {
+    const Config *cfg = net->config;
+    if (cfg->stop_after_calls > 0 && self->conversations >= cfg->stop_after_calls) {
+        return true;
+    }
+    if (net->journal) return journal_chance(net->journal, &self->rng, cfg->leave_probability);
+    return random_chance(&self->rng, cfg->leave_probability);
+}
+
+static void mark_idle(FsmNetwork *net, FsmTalker *t) {
+    idle_line_release(&net->idle, &t->line, t->id);
+}
+
+static void mark_taken(FsmNetwork *net, FsmTalker *t) {
+    idle_line_taken(&net->idle, &t->line, t->id);
+}
+
+bool fsm_should_stop(const FsmNetwork *net, long now_ms) {
+    if (stop_requested()) return true;
+    return net->deadline_ms >= 0 && now_ms >= net->deadline_ms;
+}
+
+static void answer(FsmNetwork *net, FsmTalker *self, uint64_t line, long now) {
+    FsmTalker *caller = &net->talkers[line_from(line)];
+    int duration = line_duration(line);
+    atomic_store(&self->line, line_make(LINE_BUSY, 0, 0));
+
+    log_event_at(net->logger, now, EVT_ANSWER, self->id, caller->id, 0);
+    log_event_at(net->logger, now, EVT_TALK, caller->id, self->id, duration);
+    log_event_at(net->logger, now, EVT_TALK, caller->id, self->id, duration);
+
+    // звонящий «припаркован» без событий, поэтому его поля пишет отвечающий
+    caller->peer = self->id;
+    caller->duration_ms = duration;
+    self->peer = caller->id;
+    self->duration_ms = duration;
+    schedule(net, self->id, now + duration, FSM_CALL_END);
+    schedule(net, caller->id, now + duration, FSM_CALL_END);
+}
+
+static void after_action(FsmNetwork *net, FsmTalker *self, long now) {
+    const Config *cfg = net->config;
+    if (should_leave(net, self)) {
+        uint64_t line = atomic_load(&self->line);
+        if (line_state(line) == LINE_RINGING || !claim(net, &self->line, line, line_make(LINE_LEFT, 0, 0))) {
+            // пока решали уйти, позвонили — сначала отвечаем
+            answer(net, self, atomic_load(&self->line), now);
+            return;
+        }
+        mark_taken(net, self);
+        int left = atomic_fetch_sub(&net->active_count, 1) - 1;
+        log_event_at(net->logger, now, EVT_LEAVE, self->id, left, 0);
+        if (left == 0) {
+            log_event_at(net->logger, now, EVT_LAST, -1, -1, 0);
+        }
+        return;
+    }
+    int pause_ms = draw_range(net, self, cfg->min_idle_ms, cfg->max_idle_ms);
+    stats_on_idle((int64_t)pause_ms * 1000);
+    schedule(net, self->id, now + pause_ms, FSM_WAKE);
+}
+
+static bool try_call(FsmNetwork *net, FsmTalker *self, long now) {
+    const Config *cfg = net->config;
+    int duration = draw_range(net, self, cfg->min_call_ms, cfg->max_call_ms);
+
+    uint64_t idle = line_make(LINE_IDLE, 0, 0);
+    if (!claim(net, &self->line, idle, line_make(LINE_BUSY, 0, 0))) {
+        answer(net, self, atomic_load(&self->line), now);
+        return true;
+    }
+    mark_taken(net, self);
+
+    int attempts = 0;
+    while (attempts < net->count * 2 && !fsm_should_stop(net, now)) {
+        int target = pick_callee(net, self);
+        if (target < 0) {
+            log_event_at(net->logger, now, EVT_NO_LINE, self->id, -1, 0);
+            break;
+        }
+        FsmTalker *callee = &net->talkers[target];
+
+        if (claim(net, &callee->line, idle, line_make(LINE_RINGING, self->id, duration))) {
+            mark_taken(net, callee);
+            log_event_at(net->logger, now, EVT_DIAL, self->id, target, 0);
+            return true;
+        }
+        idle_index_note_miss(&net->idle);
+        log_event_at(net->logger, now, EVT_BUSY, self->id, target, 0);
+        attempts++;
+    }
+    mark_idle(net, self);
+    return false;
+}
+
+static void on_wake(FsmNetwork *net, FsmTalker *self, long now) {
+    uint64_t line = atomic_load(&self->line);
+    if (line_state(line) == LINE_RINGING) {
+        answer(net, self, line, now);
+        return;
+    }
+
+    if (draw_range(net, self, 0, 1) == 0) {
+        // ждём входящих: за нулевое время никто не позвонит
+    } else if (try_call(net, self, now)) {
+        return;
+    }
+    after_action(net, self, now);
+}
+
+static void on_call_end(FsmNetwork *net, FsmTalker *self, long now) {
+    log_event_at(net->logger, now, EVT_FINISH, self->id, self->peer, self->duration_ms);
+    mark_idle(net, self);
+    self->conversations++;
+    after_action(net, self, now);
+}
+
+bool fsm_init(FsmNetwork *net, const Config *config, Logger *logger, FsmDriver driver) {
+    net->config = config;
+    net->logger = logger;
+    net->count = config->talkers;
+    net->driver = driver;
+    net->deadline_ms = config->duration_seconds > 0 ? config->duration_seconds * 1000L : -1;
+    net->journal = NULL;
+    atomic_init(&net->active_count, config->talkers);
+    net->talkers = calloc((size_t)config->talkers, sizeof(FsmTalker));
+    if (!net->talkers) return false;
+    if (!idle_index_init(&net->idle, config->talkers)) {
+        free(net->talkers);
+        idle_index_destroy(&net->idle);
+        return false;
+    }
+    if (config->record_path[0]) {
+        net->journal = malloc(sizeof(Journal));
+        if (!net->journal || !journal_open_record(net->journal, config)) {
+            free(net->journal);
+            free(net->talkers);
+            idle_index_destroy(&net->idle);
+            return false;
+        }
+    }
+    idle_index_set_shards(&net->idle, config->shards);
+
+    for (int i = 0; i < net->count; ++i) {
+        FsmTalker *t = &net->talkers[i];
+        t->id = i;
+        t->peer = -1;
+        rng_seed(&t->rng, config->seed, (uint64_t)i);
+        atomic_init(&t->line, line_make(LINE_IDLE, 0, 0));
+        idle_index_set(&net->idle, i);
+    }
+    return true;
+}
+
+// Закрывает только журнал записи: журнал воспроизведения принадлежит
+// replay_mode.c и отвязывается им до вызова.
+bool fsm_destroy(FsmNetwork *net) {
+    bool ok = true;
+    if (net->journal) {
+        log_message(net->logger, "Журнал %s: событий %lu, записей %lu", net->config->record_path,
+                    net->journal->dispatches, net->journal->entries);
+        ok = journal_close(net->journal);
+        if (!ok) {
+            fprintf(stderr, "Ошибка записи журнала %s: журнал оборван\n", net->config->record_path);
+            log_message(net->logger, "Ошибка записи журнала %s: журнал оборван", net->config->record_path);
+        }
+        free(net->journal);
+        net->journal = NULL;
+    }
+    idle_index_report(&net->idle, net->logger);
+    idle_index_destroy(&net->idle);
+    free(net->talkers);
+    net->talkers = NULL;
+    return ok;
+}
+
+void fsm_start(FsmNetwork *net) {
+    const Config *cfg = net->config;
+    long now = net->driver.now_ms(net->driver.ctx);
+    if (net->journal) journal_begin(net->journal, -1, 0, now);
+    for (int i = 0; i < net->count; ++i) {
+        FsmTalker *t = &net->talkers[i];
+        log_event_at(net->logger, now, EVT_CONNECT, i, -1, 0);
+        schedule(net, i, now + draw_range(net, t, cfg->min_idle_ms, cfg->max_idle_ms), FSM_WAKE);
+    }
+    if (net->journal) journal_end(net->journal);
+}
+
+void fsm_dispatch(FsmNetwork *net, int talker_id, FsmEventKind kind) {
+    long now = net->driver.now_ms(net->driver.ctx);
+    if (fsm_should_stop(net, now)) return;
+
+    // при записи события исполняются по одному: их порядок и есть журнал
+    if (net->journal) journal_begin(net->journal, talker_id, (int)kind, now);
+    FsmTalker *self = &net->talkers[talker_id];
+    if (kind == FSM_CALL_END) {
+        on_call_end(net, self, now);
+    } else {
+        on_wake(net, self, now);
+    }
+    if (net->journal) journal_end(net->journal);
+}
@@ -0,0 +1,49 @@
+#ifndef FSM_H
+#define FSM_H
+
+#include "common.h"
+#include "idle_index.h"
+#include "line.h"
+
+// Болтун как конечный автомат. Используется режимами, в которых болтуны
+// не имеют собственного потока: автомат получает события «проснулся» и
+// «разговор окончен», а время и планирование предоставляет драйвер режима.
+typedef enum {
+    FSM_WAKE,
+    FSM_CALL_END,
+} FsmEventKind;
+
+typedef struct {
+    LineWord line;
+    int id;
+    int peer;
+    int duration_ms;
+    int conversations;
+    Rng rng;
+} FsmTalker;
+
+typedef struct {
+    void *ctx;
+    long (*now_ms)(void *ctx);
+    void (*schedule)(void *ctx, int talker_id, long at_ms, FsmEventKind kind);
+} FsmDriver;
+
+typedef struct {
+    const Config *config;
+    Logger *logger;
+    FsmTalker *talkers;
+    int count;
+    IdleIndex idle;
+    _Atomic int active_count;
+    long deadline_ms; // <0 — без ограничения
+    FsmDriver driver;
+    struct Journal *journal; // NULL — без записи и воспроизведения (journal.h)
+} FsmNetwork;
+
+bool fsm_init(FsmNetwork *net, const Config *config, Logger *logger, FsmDriver driver);
+bool fsm_destroy(FsmNetwork *net); // false — журнал записи не дописан
+void fsm_start(FsmNetwork *net);
+void fsm_dispatch(FsmNetwork *net, int talker_id, FsmEventKind kind);
+bool fsm_should_stop(const FsmNetwork *net, long now_ms);
+
+#endif // FSM_H
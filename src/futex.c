@@ -0,0 +1,26 @@
+#define _GNU_SOURCE
+
+#include "futex.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+bool futex_wait(_Atomic uint32_t *word, uint32_t expected, long timeout_ms) {
+    struct timespec ts;
+    struct timespec *tsp = NULL;
+    if (timeout_ms >= 0) {
+        ts.tv_sec = timeout_ms / 1000;
+        ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+        tsp = &ts;
+    }
+    long rc = syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT_PRIVATE, expected, tsp, NULL, 0);
+    return !(rc == -1 && errno == ETIMEDOUT);
+}
+
+void futex_wake(_Atomic uint32_t *word, int count) {
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE_PRIVATE, count > 0 ? count : INT_MAX, NULL, NULL, 0);
+}
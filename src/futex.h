@@ -0,0 +1,12 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Тонкая обёртка над futex(2). futex_wait возвращает false по тайм-ауту.
+bool futex_wait(_Atomic uint32_t *word, uint32_t expected, long timeout_ms);
+void futex_wake(_Atomic uint32_t *word, int count);
+
+#endif // FUTEX_H
@@ -0,0 +1,361 @@
+#include "common.h"
+#include "affinity.h"
+#include "call_queue.h"
+#include "futex.h"
+#include "idle_index.h"
+#include "line.h"
+#include "stop.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Линия — одно атомарное слово (line.h), занимается CAS без мьютексов.
+// Звонящий и отвечающий будят друг друга через futex по счётчикам.
+// Слово линии и счётчики — на отдельной строке кэша: их CAS-ят и ждут
+// чужие потоки, а ГПСЧ владельца меняется на каждом шаге.
+typedef struct {
+    CACHE_ALIGNED LineWord line;
+    _Atomic uint32_t incoming_seq; // растёт при каждом входящем звонке
+    _Atomic uint32_t answer_seq;   // растёт, когда адресат ответил
+    CallWaiter wait_word;          // своё ожидание в чужой очереди
+    CallQueue waiting;             // кто ждёт нашей линии (--call-waiting)
+    CACHE_ALIGNED int id;
+    int conversations;
+    bool accepting; // false — уходим, очередь больше не обслуживаем
+    Rng rng;
+    pthread_t thread;
+    struct SharedFutexState *shared;
+} Talker;
+
+typedef struct SharedFutexState {
+    const Config *config;
+    Logger *logger;
+    Talker talkers[MAX_TALKERS];
+    IdleIndex idle;
+    _Atomic int active_count;
+    struct timespec start_ts;
+    bool call_waiting;
+} SharedFutex;
+
+static bool timed_out(const SharedFutex *shared) {
+    if (shared->config->duration_seconds <= 0) return false;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long ms = (now.tv_sec - shared->start_ts.tv_sec) * 1000
+        + (now.tv_nsec - shared->start_ts.tv_nsec) / 1000000;
+    return ms >= shared->config->duration_seconds * 1000L;
+}
+
+static bool should_leave(const Config *cfg, Talker *self) {
+    if (cfg->stop_after_calls > 0 && self->conversations >= cfg->stop_after_calls) {
+        return true;
+    }
+    return random_chance(&self->rng, cfg->leave_probability);
+}
+
+// Отдаёт свободную линию первому живому ждущему из очереди. Звонящий
+// встаёт в очередь до проверки линии, а мы пишем IDLE до проверки
+// очереди (пара Деккера), так что ждущий не останется спать при свободной
+// линии: либо мы увидим его запись, либо он — IDLE.
+static void serve_waiting(SharedFutex *shared, Talker *self) {
+    uint64_t idle = line_make(LINE_IDLE, 0, 0);
+    while (shared->call_waiting && self->accepting && !call_queue_empty(&self->waiting)) {
+        // не вышло — нам звонят напрямую; очередь дождётся конца разговора
+        if (!line_claim(&self->line, idle, line_make(LINE_BUSY, 0, 0))) return;
+        idle_line_taken(&shared->idle, &self->line, self->id);
+        int caller;
+        uint32_t ticket;
+        while (call_queue_pop(&self->waiting, &caller, &ticket)) {
+            // линию придерживаем до ответа: звонящий сразу пойдёт её занимать
+            atomic_store(&self->line, line_held_for(caller));
+            if (call_wait_resolve(&shared->talkers[caller].wait_word, ticket, WAIT_OFFERED)) return;
+        }
+        // в очереди были только ушедшие по тайм-ауту
+        idle_line_release(&shared->idle, &self->line, self->id);
+    }
+}
+
+static void release_line(SharedFutex *shared, Talker *self) {
+    idle_line_release(&shared->idle, &self->line, self->id);
+    serve_waiting(shared, self);
+}
+
+// Линия больше не освободится: ждущим отказываем.
+static void drop_waiting(SharedFutex *shared, Talker *self) {
+    int caller;
+    uint32_t ticket;
+    while (shared->call_waiting && call_queue_pop(&self->waiting, &caller, &ticket)) {
+        call_wait_resolve(&shared->talkers[caller].wait_word, ticket, WAIT_DROPPED);
+    }
+}
+
+static void finish_conversation(SharedFutex *shared, Talker *self, int other_id, int duration_ms) {
+    log_event(shared->logger, EVT_FINISH, self->id, other_id, duration_ms);
+    release_line(shared, self);
+    self->conversations++;
+}
+
+static void handle_incoming(SharedFutex *shared, Talker *self) {
+    uint64_t line = atomic_load(&self->line);
+    if (line_state(line) == LINE_IDLE) serve_waiting(shared, self);
+    if (line_state(line) != LINE_RINGING) return;
+
+    // из RINGING линию выводит только её владелец
+    atomic_store(&self->line, line_make(LINE_BUSY, 0, 0));
+    Talker *caller = &shared->talkers[line_from(line)];
+    int duration = line_duration(line);
+
+    log_event(shared->logger, EVT_ANSWER, self->id, caller->id, 0);
+    atomic_fetch_add(&caller->answer_seq, 1);
+    futex_wake(&caller->answer_seq, 1);
+
+    log_event(shared->logger, EVT_TALK, caller->id, self->id, duration);
+    stop_sleep(duration);
+    finish_conversation(shared, self, caller->id, duration);
+}
+
+static void wait_incoming(SharedFutex *shared, Talker *self, long timeout_ms);
+
+static void leave_network(SharedFutex *shared, Talker *self) {
+    self->accepting = false;
+    // пока линия звонит, уйти нельзя: сначала отвечаем, чтобы звонящий не завис;
+    // придержанную линию вот-вот займёт звонящий из очереди
+    while (!line_claim(&self->line, line_make(LINE_IDLE, 0, 0), line_make(LINE_LEFT, 0, 0))) {
+        if (line_is_held(atomic_load(&self->line))) wait_incoming(shared, self, 1);
+        handle_incoming(shared, self);
+    }
+    idle_line_taken(&shared->idle, &self->line, self->id);
+    drop_waiting(shared, self);
+    int left = atomic_fetch_sub(&shared->active_count, 1) - 1;
+    log_event(shared->logger, EVT_LEAVE, self->id, left, 0);
+}
+
+// Завершившийся болтун не уходит из сети, но и звонков больше не ждёт:
+// звонящему, успевшему занять его линию, отвечаем, иначе тот прождал бы
+// ответа до своей проверки остановки.
+static void hang_up(SharedFutex *shared, Talker *self) {
+    uint64_t idle = line_make(LINE_IDLE, 0, 0);
+    uint64_t left = line_make(LINE_LEFT, 0, 0);
+    self->accepting = false;
+    for (;;) {
+        uint64_t line = atomic_load(&self->line);
+        if (line_state(line) == LINE_RINGING) {
+            handle_incoming(shared, self);
+        } else if (line_is_held(line)) {
+            wait_incoming(shared, self, 1);
+        } else if (line != idle || line_claim(&self->line, idle, left)) {
+            break;
+        }
+    }
+    idle_line_taken(&shared->idle, &self->line, self->id);
+    drop_waiting(shared, self);
+}
+
+static void wait_incoming(SharedFutex *shared, Talker *self, long timeout_ms) {
+    uint32_t seq = atomic_load(&self->incoming_seq);
+    uint64_t line = atomic_load(&self->line);
+    // придержанную линию ждём и при остановке: звонящий из очереди уже идёт
+    if (line_state(line) == LINE_RINGING || (stop_requested() && !line_is_held(line))) return;
+    futex_wait(&self->incoming_seq, seq, timeout_ms);
+    (void)shared;
+}
+
+// Ждущий входящего спит на incoming_seq: сдвигаем его, как при звонке.
+// Ждущего в чужой очереди снимаем с ожидания.
+static void wake_on_stop(void *arg) {
+    SharedFutex *shared = (SharedFutex *)arg;
+    for (int i = 0; i < shared->config->talkers; ++i) {
+        atomic_fetch_add(&shared->talkers[i].incoming_seq, 1);
+        futex_wake(&shared->talkers[i].incoming_seq, 1);
+        call_wait_drop(&shared->talkers[i].wait_word);
+    }
+}
+
+// Встаём в очередь занятого адресата и ждём, пока он придержит для нас
+// линию; своя линия всё это время занята, так что нам не звонят.
+static bool wait_for_line(SharedFutex *shared, Talker *self, Talker *callee) {
+    uint32_t ticket = call_wait_begin(&self->wait_word);
+    uint32_t depth = 0;
+    if (!call_queue_push(&callee->waiting, self->id, ticket, &depth)) {
+        call_wait_resolve(&self->wait_word, ticket, WAIT_DROPPED);
+        return false;
+    }
+    // адресат освободился или ушёл, не заметив нас в очереди
+    unsigned state = line_state(atomic_load(&callee->line));
+    if (state == LINE_IDLE || state == LINE_LEFT || stop_requested()) {
+        call_wait_resolve(&self->wait_word, ticket, WAIT_DROPPED);
+    }
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    bool served = call_wait_park(&self->wait_word, ticket, shared->config->call_wait_ms) == WAIT_OFFERED;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats_on_call_wait(depth, (end.tv_sec - begin.tv_sec) * 1000000LL + (end.tv_nsec - begin.tv_nsec) / 1000, served);
+    return served;
+}
+
+// Занимает линию адресата из состояния expected (свободна или придержана
+// для нас), звонит и проводит разговор. false — линия занята или звонок
+// отозван по тайм-ауту прогона.
+static bool ring(SharedFutex *shared, Talker *self, Talker *callee, uint64_t expected, int duration) {
+    uint32_t answered = atomic_load(&self->answer_seq);
+    if (!line_claim(&callee->line, expected, line_make(LINE_RINGING, self->id, duration))) return false;
+    idle_line_taken(&shared->idle, &callee->line, callee->id);
+    log_event(shared->logger, EVT_DIAL, self->id, callee->id, 0);
+    atomic_fetch_add(&callee->incoming_seq, 1);
+    futex_wake(&callee->incoming_seq, 1);
+
+    // адресат отвечает и при остановке (hang_up), так что тайм-аут —
+    // лишь страховка: по нему отзываем звонок, пока линия ещё звонит.
+    // Не вышло — адресат уже ответил, и ответ вот-вот придёт.
+    uint64_t ringing = line_make(LINE_RINGING, self->id, duration);
+    while (atomic_load(&self->answer_seq) == answered) {
+        if (timed_out(shared) && line_claim(&callee->line, ringing, line_make(LINE_IDLE, 0, 0))) {
+            idle_index_set(&shared->idle, callee->id);
+            return false;
+        }
+        futex_wait(&self->answer_seq, answered, 100);
+    }
+    log_event(shared->logger, EVT_TALK, self->id, callee->id, duration);
+    stop_sleep(duration);
+    finish_conversation(shared, self, callee->id, duration);
+    return true;
+}
+
+// придержанную за нами линию никто, кроме нас, не займёт
+static bool wait_and_ring(SharedFutex *shared, Talker *self, Talker *callee, int duration) {
+    return wait_for_line(shared, self, callee) && ring(shared, self, callee, line_held_for(self->id), duration);
+}
+
+static bool try_call(SharedFutex *shared, Talker *self) {
+    const Config *cfg = shared->config;
+    int duration = random_range(&self->rng, cfg->min_call_ms, cfg->max_call_ms);
+
+    uint64_t idle = line_make(LINE_IDLE, 0, 0);
+    if (!line_claim(&self->line, idle, line_make(LINE_BUSY, 0, 0))) {
+        handle_incoming(shared, self);
+        return true;
+    }
+    idle_line_taken(&shared->idle, &self->line, self->id);
+
+    int attempts = 0;
+    while (attempts < cfg->talkers * 2 && !stop_requested() && !timed_out(shared)) {
+        int target = idle_index_pick(&shared->idle, &self->rng, self->id);
+        if (target < 0) {
+            log_event(shared->logger, EVT_NO_LINE, self->id, -1, 0);
+            // свободных нет: ждём случайного занятого, а не пробуем позже
+            if (shared->call_waiting && cfg->talkers > 1) {
+                target = random_range(&self->rng, 0, cfg->talkers - 2);
+                if (target >= self->id) target++;
+                if (wait_and_ring(shared, self, &shared->talkers[target], duration)) return true;
+            }
+            break;
+        }
+        Talker *callee = &shared->talkers[target];
+        if (ring(shared, self, callee, idle, duration)) return true;
+        if (timed_out(shared)) break; // звонок отозван, а не занято
+        idle_index_note_miss(&shared->idle);
+        log_event(shared->logger, EVT_BUSY, self->id, target, 0);
+        if (shared->call_waiting && wait_and_ring(shared, self, callee, duration)) return true;
+        attempts++;
+    }
+    release_line(shared, self);
+    return false;
+}
+
+static void *talker_thread(void *arg) {
+    Talker *self = (Talker *)arg;
+    SharedFutex *shared = self->shared;
+    const Config *cfg = shared->config;
+    affinity_pin_talker(cfg, self->id);
+
+    while (!stop_requested() && !timed_out(shared)) {
+        int pause_ms = random_range(&self->rng, cfg->min_idle_ms, cfg->max_idle_ms);
+        stop_sleep(pause_ms);
+        stats_on_idle((int64_t)pause_ms * 1000);
+
+        handle_incoming(shared, self);
+        if (stop_requested() || timed_out(shared)) break;
+
+        if (random_range(&self->rng, 0, 1) == 0) {
+            // предпочтение ожиданию
+            wait_incoming(shared, self, 100);
+            handle_incoming(shared, self);
+        } else {
+            try_call(shared, self);
+        }
+
+        if (should_leave(cfg, self)) {
+            leave_network(shared, self);
+            break;
+        }
+    }
+    hang_up(shared, self);
+
+    if (atomic_load(&shared->active_count) == 0) {
+        log_event(shared->logger, EVT_LAST, -1, -1, 0);
+    }
+    return NULL;
+}
+
+static void destroy_queues(SharedFutex *shared, int count) {
+    for (int i = 0; shared->call_waiting && i < count; ++i) {
+        call_queue_destroy(&shared->talkers[i].waiting);
+    }
+}
+
+int run_futex_mode(const Config *config, Logger *logger) {
+    // calloc не гарантирует выравнивание по строке кэша
+    SharedFutex *shared = aligned_alloc(CACHE_LINE, sizeof(SharedFutex));
+    if (shared) memset(shared, 0, sizeof(*shared));
+    if (!shared || !idle_index_init(&shared->idle, config->talkers)) {
+        fprintf(stderr, "Недостаточно памяти для болтунов\n");
+        free(shared);
+        return 1;
+    }
+    idle_index_set_shards(&shared->idle, config->shards);
+    shared->config = config;
+    shared->logger = logger;
+    atomic_init(&shared->active_count, config->talkers);
+    clock_gettime(CLOCK_MONOTONIC, &shared->start_ts);
+    shared->call_waiting = config->call_waiting > 0;
+
+    for (int i = 0; i < config->talkers; ++i) {
+        Talker *t = &shared->talkers[i];
+        t->id = i;
+        t->shared = shared;
+        t->conversations = 0;
+        rng_seed(&t->rng, config->seed, (uint64_t)i);
+        atomic_init(&t->line, line_make(LINE_IDLE, 0, 0));
+        atomic_init(&t->incoming_seq, 0);
+        atomic_init(&t->answer_seq, 0);
+        atomic_init(&t->wait_word, WAIT_IDLE);
+        t->accepting = true;
+        if (shared->call_waiting && !call_queue_init(&t->waiting, config->call_waiting)) {
+            fprintf(stderr, "Недостаточно памяти для очередей ожидания\n");
+            destroy_queues(shared, i);
+            idle_index_destroy(&shared->idle);
+            free(shared);
+            return 1;
+        }
+        idle_index_set(&shared->idle, i);
+    }
+    stop_watch_add(wake_on_stop, shared);
+
+    for (int i = 0; i < config->talkers; ++i) {
+        pthread_create(&shared->talkers[i].thread, NULL, talker_thread, &shared->talkers[i]);
+        log_event(logger, EVT_CONNECT, i, -1, 0);
+    }
+
+    for (int i = 0; i < config->talkers; ++i) {
+        pthread_join(shared->talkers[i].thread, NULL);
+    }
+    stop_watch_remove(wake_on_stop, shared);
+    destroy_queues(shared, config->talkers);
+
+    idle_index_report(&shared->idle, logger);
+    idle_index_destroy(&shared->idle);
+    free(shared);
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include "histogram.h"
+
+static unsigned bucket_index(uint64_t value) {
+    if (value < 2 * HIST_SUB_BUCKETS) return (unsigned)value;
+    unsigned msb = 63u - (unsigned)__builtin_clzll(value);
+    unsigned shift = msb - 5;
+    return (shift + 1) * HIST_SUB_BUCKETS + (unsigned)((value >> shift) - HIST_SUB_BUCKETS);
+}
+
+static uint64_t bucket_value(unsigned index) {
+    if (index < 2 * HIST_SUB_BUCKETS) return index;
+    unsigned shift = index / HIST_SUB_BUCKETS - 1;
+    return (uint64_t)(index % HIST_SUB_BUCKETS + HIST_SUB_BUCKETS) << shift;
+}
+
+// единственный писатель: обычные load/store без атомарного RMW
+static inline void bump(_Atomic uint64_t *counter, uint64_t delta) {
+    uint64_t v = atomic_load_explicit(counter, memory_order_relaxed);
+    atomic_store_explicit(counter, v + delta, memory_order_relaxed);
+}
+
+void histogram_record(Histogram *hist, uint64_t value) {
+    bump(&hist->counts[bucket_index(value)], 1);
+    bump(&hist->total, 1);
+    if (value > atomic_load_explicit(&hist->max, memory_order_relaxed)) {
+        atomic_store_explicit(&hist->max, value, memory_order_relaxed);
+    }
+}
+
+void histogram_merge(Histogram *dst, const Histogram *src) {
+    for (unsigned i = 0; i < HIST_BUCKETS; ++i) {
+        uint64_t c = atomic_load_explicit(&src->counts[i], memory_order_relaxed);
+        if (c) bump(&dst->counts[i], c);
+    }
+    bump(&dst->total, atomic_load_explicit(&src->total, memory_order_relaxed));
+    uint64_t max = atomic_load_explicit(&src->max, memory_order_relaxed);
+    if (max > atomic_load_explicit(&dst->max, memory_order_relaxed)) {
+        atomic_store_explicit(&dst->max, max, memory_order_relaxed);
+    }
+}
+
+uint64_t histogram_percentile(const Histogram *hist, double percent) {
+    uint64_t total = 0;
+    for (unsigned i = 0; i < HIST_BUCKETS; ++i) {
+        total += atomic_load_explicit(&hist->counts[i], memory_order_relaxed);
+    }
+    if (!total) return 0;
+    uint64_t rank = (uint64_t)(percent / 100.0 * (double)total + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < HIST_BUCKETS; ++i) {
+        seen += atomic_load_explicit(&hist->counts[i], memory_order_relaxed);
+        if (seen >= rank) return bucket_value(i);
+    }
+    return atomic_load_explicit(&hist->max, memory_order_relaxed);
+}
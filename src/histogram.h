@@ -0,0 +1,23 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+// Логарифмически-линейная гистограмма в духе HDR: 32 поддиапазона на
+// каждую степень двойки (погрешность ~3%). Пишет один поток-владелец,
+// читать и сливать можно из любого потока в любой момент.
+#define HIST_SUB_BUCKETS 32
+#define HIST_BUCKETS 1920
+
+typedef struct {
+    _Atomic uint64_t counts[HIST_BUCKETS];
+    _Atomic uint64_t total;
+    _Atomic uint64_t max;
+} Histogram;
+
+void histogram_record(Histogram *hist, uint64_t value);
+void histogram_merge(Histogram *dst, const Histogram *src);
+uint64_t histogram_percentile(const Histogram *hist, double percent);
+
+#endif // HISTOGRAM_H
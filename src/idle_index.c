@@ -0,0 +1,168 @@
+#include "idle_index.h"
+#include "affinity.h"
+
+#include <stdlib.h>
+
+static inline uint64_t bit(int i) {
+    return 1ull << (i & 63);
+}
+
+static inline uint64_t rotr(uint64_t x, unsigned k) {
+    k &= 63;
+    return k ? (x >> k) | (x << (64 - k)) : x;
+}
+
+// случайный взведённый бит: поворачиваем слово и берём младший
+static int random_bit(uint64_t word, Rng *rng) {
+    unsigned r = (unsigned)(rng_next(rng) >> 58);
+    return (int)((__builtin_ctzll(rotr(word, r)) + r) & 63);
+}
+
+static void init_counters(IdleIndex *index, int count) {
+    index->count = count;
+    index->word_count = ((size_t)count + 63) / 64;
+    index->summary_count = (index->word_count + 63) / 64;
+    index->shards = 1;
+}
+
+bool idle_index_init(IdleIndex *index, int count) {
+    init_counters(index, count);
+    index->owned = true;
+    index->words = calloc(index->word_count, sizeof(*index->words));
+    index->summary = calloc(index->summary_count, sizeof(*index->summary));
+    return index->words && index->summary;
+}
+
+size_t idle_index_storage_size(int count) {
+    size_t words = ((size_t)count + 63) / 64;
+    return (words + (words + 63) / 64) * sizeof(uint64_t);
+}
+
+// storage — обнулённый блок размера idle_index_storage_size(count),
+// например в общей памяти процессов
+void idle_index_init_at(IdleIndex *index, int count, void *storage) {
+    init_counters(index, count);
+    index->owned = false;
+    index->words = storage;
+    index->summary = index->words + index->word_count;
+}
+
+void idle_index_set_shards(IdleIndex *index, int shards) {
+    index->shards = shards > 1 ? shards : 1;
+}
+
+void idle_index_destroy(IdleIndex *index) {
+    if (index->owned) {
+        free((void *)index->words);
+        free((void *)index->summary);
+    }
+    index->words = NULL;
+    index->summary = NULL;
+}
+
+void idle_index_set(IdleIndex *index, int id) {
+    size_t w = (size_t)id / 64;
+    uint64_t old = atomic_fetch_or(&index->words[w], bit(id));
+    if (!old) atomic_fetch_or(&index->summary[w / 64], bit((int)(w & 63)));
+}
+
+void idle_index_clear(IdleIndex *index, int id) {
+    size_t w = (size_t)id / 64;
+    uint64_t old = atomic_fetch_and(&index->words[w], ~bit(id));
+    if (old == bit(id)) {
+        atomic_fetch_and(&index->summary[w / 64], ~bit((int)(w & 63)));
+        // параллельный set мог успеть между двумя операциями
+        if (atomic_load(&index->words[w])) {
+            atomic_fetch_or(&index->summary[w / 64], bit((int)(w & 63)));
+        }
+    }
+}
+
+// Оценка сэкономленных проб: случайный перебор при k свободных из n
+// в среднем промахивается (n - k) / k раз и не более 2n раз. Долю
+// свободных даёт слово, где нашлась линия (idle бит из span): общий
+// счётчик свободных на горячем пути не нужен, а до 64 болтунов оценка точна.
+static void account_pick(IdleIndex *index, int found, uint64_t idle, uint64_t span) {
+    unsigned long n = (unsigned long)index->count;
+    unsigned long saved = 2 * n;
+    if (found >= 0) {
+        int k = __builtin_popcountll(idle);
+        int width = __builtin_popcountll(span);
+        saved = (unsigned long)(width - k) / (unsigned long)k;
+        if (saved > 2 * n) saved = 2 * n;
+    }
+    stats_on_index_pick(found >= 0, saved);
+}
+
+// Биты слова w, лежащие в [lo, hi), без звонящего.
+static uint64_t word_mask(size_t w, int lo, int hi, int exclude) {
+    uint64_t mask = ~0ull;
+    if (w == (size_t)lo / 64) mask &= ~0ull << (lo & 63);
+    if (w == (size_t)(hi - 1) / 64 && (hi & 63)) mask &= ~(~0ull << (hi & 63));
+    if (exclude >= 0 && (size_t)exclude / 64 == w) mask &= ~bit(exclude);
+    return mask;
+}
+
+// Свободная линия в диапазоне [lo, hi): шард занимает подряд идущие слова,
+// обходим их с случайного слова, обрезая крайние по границам шарда.
+static int pick_range(IdleIndex *index, Rng *rng, int exclude, int lo, int hi) {
+    size_t first = (size_t)lo / 64;
+    size_t words = ((size_t)hi + 63) / 64 - first;
+    size_t start = (size_t)(((rng_next(rng) >> 32) * words) >> 32);
+    for (size_t i = 0; i < words; ++i) {
+        size_t w = first + (start + i) % words;
+        uint64_t mask = word_mask(w, lo, hi, exclude);
+        uint64_t word = atomic_load_explicit(&index->words[w], memory_order_relaxed) & mask;
+        if (word) {
+            int found = (int)(w * 64) + random_bit(word, rng);
+            account_pick(index, found, word, mask);
+            return found;
+        }
+    }
+    return -1;
+}
+
+int idle_index_pick(IdleIndex *index, Rng *rng, int exclude) {
+    if (index->shards > 1 && exclude >= 0) {
+        int shard = shard_of(exclude, index->count, index->shards);
+        int found = pick_range(index, rng, exclude, shard_begin(shard, index->count, index->shards),
+                               shard_begin(shard + 1, index->count, index->shards));
+        if (found >= 0) return found;
+    }
+    size_t start = (size_t)(((rng_next(rng) >> 32) * index->summary_count) >> 32);
+    for (size_t i = 0; i < index->summary_count; ++i) {
+        size_t s = (start + i) % index->summary_count;
+        uint64_t summary = atomic_load_explicit(&index->summary[s], memory_order_relaxed);
+        while (summary) {
+            int sb = random_bit(summary, rng);
+            summary &= ~bit(sb);
+            size_t w = s * 64 + (size_t)sb;
+            uint64_t mask = word_mask(w, 0, index->count, exclude);
+            uint64_t word = atomic_load_explicit(&index->words[w], memory_order_relaxed) & mask;
+            if (!word) continue;
+            int found = (int)(w * 64) + random_bit(word, rng);
+            account_pick(index, found, word, mask);
+            return found;
+        }
+    }
+    account_pick(index, -1, 0, 0);
+    return -1;
+}
+
+void idle_index_note_miss(IdleIndex *index) {
+    (void)index;
+    stats_on_index_miss();
+}
+
+// Свободные линии считаются по битсету только здесь, при отчёте.
+void idle_index_report(const IdleIndex *index, Logger *logger) {
+    int idle = 0;
+    for (size_t w = 0; w < index->word_count; ++w) {
+        idle += __builtin_popcountll(atomic_load_explicit(&index->words[w], memory_order_relaxed));
+    }
+    IndexStats totals = stats_index_totals();
+    log_message(logger, "Индекс свободных линий: выборов %llu, промахов %llu, без линии %llu, "
+                "сэкономлено проб ~%llu, свободно %d",
+                (unsigned long long)totals.picks, (unsigned long long)totals.misses,
+                (unsigned long long)totals.no_line, (unsigned long long)totals.probes_saved, idle);
+}
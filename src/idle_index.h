@@ -0,0 +1,52 @@
+#ifndef IDLE_INDEX_H
+#define IDLE_INDEX_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "line.h"
+#include "rng.h"
+
+// Индекс свободных линий: двухуровневый атомарный битсет. Бит болтуна
+// взведён, пока его линия свободна; слово сводки отмечает непустые слова.
+// Индекс — подсказка: захват линии всё равно проверяется под мьютексом или CAS.
+typedef struct {
+    _Atomic uint64_t *words;
+    _Atomic uint64_t *summary;
+    size_t word_count;
+    size_t summary_count;
+    int count;
+    bool owned; // false — слова лежат в чужой (общей) памяти
+    int shards; // >1 — сначала ищем свободную линию в шарде звонящего
+} IdleIndex; // счётчики выборов ведутся в шардах статистики (stats_on_index_*)
+
+bool idle_index_init(IdleIndex *index, int count);
+size_t idle_index_storage_size(int count);
+void idle_index_init_at(IdleIndex *index, int count, void *storage);
+void idle_index_set_shards(IdleIndex *index, int shards);
+void idle_index_destroy(IdleIndex *index);
+void idle_index_set(IdleIndex *index, int id);
+void idle_index_clear(IdleIndex *index, int id);
+int idle_index_pick(IdleIndex *index, Rng *rng, int exclude);
+void idle_index_note_miss(IdleIndex *index);
+void idle_index_report(const IdleIndex *index, Logger *logger);
+
+// Для режимов со словом линии из line.h: индекс обновляется вслед за CAS.
+// После снятия бита состояние перепроверяется, иначе запоздавший clear
+// мог бы скрыть уже освободившуюся линию.
+static inline void idle_line_release(IdleIndex *index, LineWord *line, int id) {
+    atomic_store(line, line_make(LINE_IDLE, 0, 0));
+    idle_index_set(index, id);
+}
+
+static inline void idle_line_taken(IdleIndex *index, LineWord *line, int id) {
+    idle_index_clear(index, id);
+    if (line_state(atomic_load(line)) == LINE_IDLE) {
+        idle_index_set(index, id);
+    }
+}
+
+#endif // IDLE_INDEX_H
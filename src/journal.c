@@ -0,0 +1,301 @@
+#include "journal.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+enum {
+    J_DISPATCH = 1, // talker, kind, прирост времени
+    J_DRAW,         // случайное значение
+    J_PICK,         // выбранный адресат, -1 — свободных нет
+    J_CLAIM_OK,
+    J_CLAIM_FAIL,
+    J_START, // время fsm_start
+};
+
+static const char *const tag_names[] = {
+    [0] = "?",
+    [J_DISPATCH] = "событие",
+    [J_DRAW] = "случайное значение",
+    [J_PICK] = "выбор адресата",
+    [J_CLAIM_OK] = "захват линии",
+    [J_CLAIM_FAIL] = "неудачный захват линии",
+    [J_START] = "старт сети",
+};
+
+static void put_varint(FILE *out, uint64_t v) {
+    while (v >= 0x80) {
+        fputc((int)(v & 0x7f) | 0x80, out);
+        v >>= 7;
+    }
+    fputc((int)v, out);
+}
+
+static void put_signed(FILE *out, int64_t v) {
+    put_varint(out, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+}
+
+static void put_entry(Journal *journal, int tag, int64_t value) {
+    fputc(tag, journal->out);
+    if (tag == J_DRAW || tag == J_PICK) put_signed(journal->out, value);
+    journal->entries++;
+}
+
+static void diverge(Journal *journal, const char *fmt, const char *a, const char *b) {
+    if (journal->diverged) return;
+    journal->diverged = true;
+    snprintf(journal->divergence, sizeof(journal->divergence), fmt, a, b);
+    journal->divergence[sizeof(journal->divergence) - 1] = '\0';
+}
+
+static bool get_varint(Journal *journal, uint64_t *v) {
+    *v = 0;
+    for (int shift = 0; shift < 64 && journal->pos < journal->size; shift += 7) {
+        unsigned char b = journal->data[journal->pos++];
+        *v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+    }
+    diverge(journal, "%s%s", "журнал оборван посреди записи", "");
+    return false;
+}
+
+static bool get_signed(Journal *journal, int64_t *v) {
+    uint64_t raw;
+    if (!get_varint(journal, &raw)) return false;
+    *v = (int64_t)(raw >> 1) ^ -(int64_t)(raw & 1);
+    return true;
+}
+
+// Следующая запись должна быть с тегом tag, иначе код разошёлся с журналом.
+static bool expect(Journal *journal, int tag) {
+    if (journal->diverged) return false;
+    if (journal->pos >= journal->size) {
+        diverge(journal, "ожидалось: %s, а журнал кончился%s", tag_names[tag], "");
+        return false;
+    }
+    int found = journal->data[journal->pos];
+    if (found == tag || (tag == J_CLAIM_OK && found == J_CLAIM_FAIL)) {
+        journal->pos++;
+        journal->entries++;
+        return true;
+    }
+    diverge(journal, "ожидалось: %s, в журнале: %s", tag_names[tag],
+            found >= J_DISPATCH && found <= J_START ? tag_names[found] : tag_names[0]);
+    return false;
+}
+
+static void fill_header(JournalHeader *h, const Config *config) {
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, JOURNAL_MAGIC, sizeof(h->magic));
+    h->version = JOURNAL_VERSION;
+    h->talkers = config->talkers;
+    h->min_idle_ms = config->min_idle_ms;
+    h->max_idle_ms = config->max_idle_ms;
+    h->min_call_ms = config->min_call_ms;
+    h->max_call_ms = config->max_call_ms;
+    h->stop_after_calls = config->stop_after_calls;
+    h->duration_seconds = config->duration_seconds;
+    h->shards = config->shards;
+    h->leave_probability = config->leave_probability;
+    h->seed = config->seed;
+    snprintf(h->mode, sizeof(h->mode), "%s", config->mode);
+}
+
+static bool read_header(const char *path, JournalHeader *h) {
+    FILE *in = fopen(path, "rb");
+    if (!in) {
+        perror("open journal");
+        return false;
+    }
+    bool ok = fread(h, sizeof(*h), 1, in) == 1 && memcmp(h->magic, JOURNAL_MAGIC, sizeof(h->magic)) == 0
+        && h->version == JOURNAL_VERSION;
+    fclose(in);
+    if (!ok) fprintf(stderr, "Не журнал talkers или неподходящая версия: %s\n", path);
+    h->mode[sizeof(h->mode) - 1] = '\0';
+    return ok;
+}
+
+// Параметры прогона берутся из журнала: воспроизведение обязано совпасть
+// с записанным прогоном, ключи CLI их не переопределяют.
+bool journal_load_config(const char *path, Config *config) {
+    JournalHeader h;
+    if (!read_header(path, &h)) return false;
+    config->talkers = h.talkers;
+    config->min_idle_ms = h.min_idle_ms;
+    config->max_idle_ms = h.max_idle_ms;
+    config->min_call_ms = h.min_call_ms;
+    config->max_call_ms = h.max_call_ms;
+    config->stop_after_calls = h.stop_after_calls;
+    config->duration_seconds = h.duration_seconds;
+    config->shards = h.shards;
+    config->leave_probability = h.leave_probability;
+    config->seed = h.seed;
+    strcpy(config->mode, h.mode);
+    return true;
+}
+
+bool journal_open_record(Journal *journal, const Config *config) {
+    memset(journal, 0, sizeof(*journal));
+    journal->out = fopen(config->record_path, "wb");
+    if (!journal->out) {
+        perror("open journal");
+        return false;
+    }
+    setvbuf(journal->out, NULL, _IOFBF, 1 << 20);
+    JournalHeader h;
+    fill_header(&h, config);
+    if (fwrite(&h, sizeof(h), 1, journal->out) != 1) {
+        perror("write journal");
+        fclose(journal->out);
+        return false;
+    }
+    pthread_mutex_init(&journal->lock, NULL);
+    return true;
+}
+
+bool journal_open_replay(Journal *journal, const char *path) {
+    memset(journal, 0, sizeof(*journal));
+    journal->replaying = true;
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(JournalHeader)) {
+        fprintf(stderr, "Не удалось прочитать журнал %s\n", path);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    journal->size = (size_t)st.st_size;
+    void *mem = mmap(NULL, journal->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        perror("mmap journal");
+        return false;
+    }
+    journal->data = mem;
+    journal->pos = sizeof(JournalHeader);
+    return true;
+}
+
+// Записи идут через буфер stdio без проверки каждой: ошибка потока
+// запоминается в ferror и вместе с итогом fclose проверяется здесь.
+bool journal_close(Journal *journal) {
+    if (journal->replaying) {
+        if (journal->data) munmap((void *)journal->data, journal->size);
+        journal->data = NULL;
+        return true;
+    }
+    bool ok = true;
+    if (journal->out) {
+        ok = !ferror(journal->out);
+        if (fclose(journal->out) != 0) ok = false;
+        journal->out = NULL;
+        pthread_mutex_destroy(&journal->lock);
+    }
+    return ok;
+}
+
+void journal_begin(Journal *journal, int talker, int kind, long now_ms) {
+    if (journal->replaying) return;
+    pthread_mutex_lock(&journal->lock);
+    if (talker < 0) { // fsm_start: время старта, дальше только случайные значения
+        fputc(J_START, journal->out);
+        put_signed(journal->out, now_ms);
+        journal->last_ms = now_ms;
+        journal->entries++;
+        return;
+    }
+    fputc(J_DISPATCH, journal->out);
+    put_varint(journal->out, (uint64_t)talker);
+    fputc(kind, journal->out);
+    put_signed(journal->out, now_ms - journal->last_ms);
+    journal->last_ms = now_ms;
+    journal->dispatches++;
+    journal->entries++;
+}
+
+void journal_end(Journal *journal) {
+    if (!journal->replaying) pthread_mutex_unlock(&journal->lock);
+}
+
+bool journal_next_start(Journal *journal, long *at_ms) {
+    int64_t start;
+    if (!expect(journal, J_START) || !get_signed(journal, &start)) return false;
+    journal->now_ms = (long)start;
+    *at_ms = journal->now_ms;
+    return true;
+}
+
+bool journal_next_dispatch(Journal *journal, int *talker, int *kind, long *at_ms) {
+    if (journal->diverged || journal->pos >= journal->size) return false;
+    if (!expect(journal, J_DISPATCH)) return false;
+    uint64_t id;
+    int64_t delta;
+    if (!get_varint(journal, &id) || journal->pos >= journal->size) {
+        diverge(journal, "%s%s", "журнал оборван посреди записи", "");
+        return false;
+    }
+    *kind = journal->data[journal->pos++];
+    if (!get_signed(journal, &delta)) return false;
+    journal->now_ms += (long)delta;
+    *talker = (int)id;
+    *at_ms = journal->now_ms;
+    journal->dispatches++;
+    return true;
+}
+
+int journal_range(Journal *journal, Rng *rng, int min, int max) {
+    int64_t value;
+    if (!journal->replaying) {
+        int drawn = random_range(rng, min, max);
+        put_entry(journal, J_DRAW, drawn);
+        return drawn;
+    }
+    if (!expect(journal, J_DRAW) || !get_signed(journal, &value)) return random_range(rng, min, max);
+    return (int)value;
+}
+
+bool journal_chance(Journal *journal, Rng *rng, double probability) {
+    int64_t value;
+    if (!journal->replaying) {
+        bool drawn = random_chance(rng, probability);
+        put_entry(journal, J_DRAW, drawn);
+        return drawn;
+    }
+    if (!expect(journal, J_DRAW) || !get_signed(journal, &value)) return random_chance(rng, probability);
+    return value != 0;
+}
+
+// Выбор адресата зависит от того, чьи линии свободны в этот момент, поэтому
+// в журнал идёт сам выбор, а не сырые значения ГПСЧ.
+int journal_pick(Journal *journal, IdleIndex *idle, Rng *rng, int exclude) {
+    int64_t value;
+    if (!journal->replaying) {
+        int target = idle_index_pick(idle, rng, exclude);
+        put_entry(journal, J_PICK, target);
+        return target;
+    }
+    if (!expect(journal, J_PICK) || !get_signed(journal, &value)) return -1;
+    if (value < -1 || value >= idle->count || value == exclude) {
+        diverge(journal, "%s%s", "адресат из журнала вне сети", "");
+        return -1;
+    }
+    return (int)value;
+}
+
+bool journal_claim(Journal *journal, LineWord *line, uint64_t expected, uint64_t desired) {
+    bool claimed = line_claim(line, expected, desired);
+    if (!journal->replaying) {
+        put_entry(journal, claimed ? J_CLAIM_OK : J_CLAIM_FAIL, 0);
+        return claimed;
+    }
+    size_t at = journal->pos;
+    if (!expect(journal, J_CLAIM_OK)) return claimed;
+    bool recorded = journal->data[at] == J_CLAIM_OK;
+    if (recorded != claimed) {
+        diverge(journal, "захват линии удался %s, но не %s", recorded ? "в журнале" : "при воспроизведении",
+                recorded ? "при воспроизведении" : "в журнале");
+    }
+    return claimed;
+}
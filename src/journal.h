@@ -0,0 +1,74 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "common.h"
+#include "idle_index.h"
+#include "line.h"
+
+#define JOURNAL_MAGIC "TLKJRNL1"
+#define JOURNAL_VERSION 1
+
+// Журнал решений автоматов (--record / --replay). Запись сериализует
+// обработку событий fsm.c и пишет по порядку: какое событие какого болтуна
+// в какой момент исполнено, все случайные значения, выбранные адресаты и
+// исходы захвата линий. Воспроизведение прогоняет те же события через тот
+// же автомат в одном потоке, подставляя значения из журнала, и сверяет
+// исходы захватов: первое расхождение останавливает прогон.
+//
+// Заголовок фиксированного размера хранит параметры прогона, за ним идут
+// записи: байт тега и varint-поля.
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    int32_t talkers;
+    int32_t min_idle_ms;
+    int32_t max_idle_ms;
+    int32_t min_call_ms;
+    int32_t max_call_ms;
+    int32_t stop_after_calls;
+    int32_t duration_seconds;
+    int32_t shards;
+    int32_t reserved;
+    double leave_probability;
+    uint64_t seed;
+    char mode[16];
+} JournalHeader;
+
+typedef struct Journal {
+    bool replaying;
+    // запись
+    FILE *out;
+    pthread_mutex_t lock;
+    long last_ms;
+    // воспроизведение
+    const unsigned char *data;
+    size_t size;
+    size_t pos;
+    long now_ms;
+    bool diverged;
+    char divergence[160];
+    // общее
+    unsigned long dispatches;
+    unsigned long entries;
+} Journal;
+
+bool journal_load_config(const char *path, Config *config);
+bool journal_open_record(Journal *journal, const Config *config);
+bool journal_open_replay(Journal *journal, const char *path);
+// false — запись журнала не удалась (ошибка ввода-вывода, диск полон):
+// журнал оборван и воспроизводить его нельзя.
+bool journal_close(Journal *journal);
+
+// Обработка события автомата: при записи держит замок журнала и пишет
+// заголовок события; при воспроизведении ничего не делает.
+void journal_begin(Journal *journal, int talker, int kind, long now_ms);
+void journal_end(Journal *journal);
+bool journal_next_start(Journal *journal, long *at_ms);
+bool journal_next_dispatch(Journal *journal, int *talker, int *kind, long *at_ms);
+
+int journal_range(Journal *journal, Rng *rng, int min, int max);
+bool journal_chance(Journal *journal, Rng *rng, double probability);
+int journal_pick(Journal *journal, IdleIndex *idle, Rng *rng, int exclude);
+bool journal_claim(Journal *journal, LineWord *line, uint64_t expected, uint64_t desired);
+
+#endif // JOURNAL_H
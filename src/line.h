@@ -0,0 +1,54 @@
+#ifndef LINE_H
+#define LINE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Состояние линии упаковано в одно 64-битное слово, чтобы захват линии
+// и передача заявки (кто звонит и сколько говорить) выполнялись одним CAS.
+//   биты 0-1   — состояние (LINE_*)
+//   биты 2-32  — номер звонящего (для LINE_RINGING)
+//   биты 33-63 — длительность разговора, мс (для LINE_RINGING)
+// LINE_BUSY с ненулевой длительностью — линия придержана владельцем для
+// звонящего from из очереди ожидания вызова (call_queue.h).
+enum {
+    LINE_IDLE = 0,
+    LINE_BUSY = 1,
+    LINE_RINGING = 2,
+    LINE_LEFT = 3,
+};
+
+typedef _Atomic uint64_t LineWord;
+
+static inline uint64_t line_make(unsigned state, int from_id, int duration_ms) {
+    return (uint64_t)state
+        | ((uint64_t)(uint32_t)from_id & 0x7fffffffu) << 2
+        | ((uint64_t)(uint32_t)duration_ms & 0x7fffffffu) << 33;
+}
+
+static inline unsigned line_state(uint64_t word) {
+    return (unsigned)(word & 3u);
+}
+
+static inline int line_from(uint64_t word) {
+    return (int)((word >> 2) & 0x7fffffffu);
+}
+
+static inline int line_duration(uint64_t word) {
+    return (int)((word >> 33) & 0x7fffffffu);
+}
+
+static inline uint64_t line_held_for(int caller_id) {
+    return line_make(LINE_BUSY, caller_id, 1);
+}
+
+static inline bool line_is_held(uint64_t word) {
+    return line_state(word) == LINE_BUSY && line_duration(word) != 0;
+}
+
+static inline bool line_claim(LineWord *line, uint64_t expected, uint64_t desired) {
+    return atomic_compare_exchange_strong(line, &expected, desired);
+}
+
+#endif // LINE_H
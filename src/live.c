@@ -0,0 +1,157 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+
+#include "common.h"
+#include "futex.h"
+#include "live.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Состояние болтуна в одном слове: биты 0-1 — LIVE_*, 2-31 — число
+// разговоров, 32-63 — собеседник + 1. Слово пишет поток, логирующий событие
+// болтуна, простой записью: события одного болтуна причинно упорядочены
+// (ответ адресата приходит, пока звонящий ждёт), так что RMW не нужен.
+static _Atomic uint64_t *words;
+static _Atomic int64_t *active;
+static size_t table_bytes;
+static int talker_count;
+
+static LiveHeader *snapshot;
+static size_t snapshot_bytes;
+static Logger *publish_logger;
+static pthread_t publisher;
+static bool publisher_running;
+static _Atomic uint32_t closing;
+
+static inline uint64_t pack(unsigned state, uint32_t conversations, int peer) {
+    return (uint64_t)state | (uint64_t)(conversations & 0x3fffffffu) << 2 | (uint64_t)(uint32_t)(peer + 1) << 32;
+}
+
+static void set_state(int talker, unsigned state, int peer, bool finished) {
+    if (talker < 0 || talker >= talker_count) return;
+    uint64_t word = atomic_load_explicit(&words[talker], memory_order_relaxed);
+    uint32_t conversations = (uint32_t)(word >> 2) & 0x3fffffffu;
+    if (finished) conversations++;
+    atomic_store_explicit(&words[talker], pack(state, conversations, peer), memory_order_relaxed);
+}
+
+void live_on_event(EventType type, int talker, int peer) {
+    if (!words) return;
+    switch (type) {
+    case EVT_CONNECT:
+        set_state(talker, LIVE_IDLE, -1, false);
+        break;
+    case EVT_DIAL:
+        set_state(talker, LIVE_DIALING, peer, false);
+        break;
+    case EVT_ANSWER:
+        set_state(talker, LIVE_TALKING, peer, false);
+        set_state(peer, LIVE_TALKING, talker, false);
+        break;
+    case EVT_FINISH:
+        set_state(talker, LIVE_IDLE, -1, true);
+        break;
+    case EVT_LEAVE:
+        set_state(talker, LIVE_LEFT, -1, false);
+        atomic_store_explicit(active, peer, memory_order_relaxed);
+        break;
+    default:
+        break;
+    }
+}
+
+// Таблица в общей анонимной памяти, как шарды статистики: в режиме process
+// её пишут воркеры, а снимок публикует родитель.
+bool live_init(const Config *config) {
+    if (!config->live_path[0]) return true;
+    talker_count = config->talkers;
+    table_bytes = sizeof(*active) + (size_t)talker_count * sizeof(*words);
+    void *table = mmap(NULL, table_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED) {
+        perror("mmap live table");
+        return false;
+    }
+
+    snapshot_bytes = live_snapshot_size((uint32_t)talker_count);
+    int fd = open(config->live_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    void *mem = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, (off_t)snapshot_bytes) == 0) {
+        mem = mmap(NULL, snapshot_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mem == MAP_FAILED) {
+        fprintf(stderr, "Не удалось открыть живой снимок %s\n", config->live_path);
+        if (fd >= 0) close(fd);
+        munmap(table, table_bytes);
+        return false;
+    }
+    close(fd);
+
+    active = table;
+    words = (_Atomic uint64_t *)((char *)table + sizeof(*active));
+    atomic_store(active, talker_count);
+    for (int i = 0; i < talker_count; ++i) atomic_store(&words[i], pack(LIVE_IDLE, 0, -1));
+
+    snapshot = mem;
+    memcpy(snapshot->magic, LIVE_MAGIC, sizeof(snapshot->magic));
+    snapshot->version = LIVE_VERSION;
+    snapshot->talkers = (uint32_t)talker_count;
+    snapshot->pid = (int32_t)getpid();
+    snapshot->refresh_ms = LIVE_REFRESH_MS;
+    snprintf(snapshot->mode, sizeof(snapshot->mode), "%s", config->mode);
+    return true;
+}
+
+static void publish(bool finished) {
+    LiveTalker *rows = (LiveTalker *)(snapshot + 1);
+    uint32_t seq = atomic_load_explicit(&snapshot->seq, memory_order_relaxed);
+    atomic_store_explicit(&snapshot->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    for (int i = 0; i < talker_count; ++i) {
+        uint64_t word = atomic_load_explicit(&words[i], memory_order_relaxed);
+        rows[i].state = (uint32_t)(word & 3u);
+        rows[i].conversations = (uint32_t)(word >> 2) & 0x3fffffffu;
+        rows[i].peer = (int32_t)(uint32_t)(word >> 32) - 1;
+    }
+    snapshot->active = atomic_load_explicit(active, memory_order_relaxed);
+    snapshot->updated_ms = elapsed_ms_since(publish_logger);
+    snapshot->publishes++;
+    snapshot->finished = finished;
+    atomic_store_explicit(&snapshot->seq, seq + 2, memory_order_release);
+}
+
+static void *publisher_thread(void *arg) {
+    (void)arg;
+    while (!atomic_load(&closing)) {
+        publish(false);
+        futex_wait(&closing, 0, LIVE_REFRESH_MS);
+    }
+    return NULL;
+}
+
+void live_start_publisher(Logger *logger) {
+    if (!snapshot) return;
+    publish_logger = logger;
+    atomic_store(&closing, 0);
+    publisher_running = pthread_create(&publisher, NULL, publisher_thread, NULL) == 0;
+    if (!publisher_running) perror("pthread_create live snapshot");
+}
+
+// Последний снимок помечается завершённым: talkers-top по нему выходит.
+void live_stop_publisher(void) {
+    if (!snapshot) return;
+    if (publisher_running) {
+        atomic_store(&closing, 1);
+        futex_wake(&closing, 1);
+        pthread_join(publisher, NULL);
+        publisher_running = false;
+    }
+    publish(true);
+    munmap(snapshot, snapshot_bytes);
+    snapshot = NULL;
+    words = NULL; // события после остановки (итоги, конец лога) уже не пишутся
+    munmap(active, table_bytes);
+    active = NULL;
+}
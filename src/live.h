@@ -0,0 +1,67 @@
+#ifndef LIVE_H
+#define LIVE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define LIVE_MAGIC "TLKLIVE1"
+#define LIVE_VERSION 1
+#define LIVE_REFRESH_MS 100
+
+// Живой снимок (--live-snapshot): файл, отображённый в память, — заголовок и
+// массив записей болтунов. Симуляция переписывает его раз в LIVE_REFRESH_MS
+// под seqlock: seq нечётный, пока идёт запись. Читатель копирует снимок и
+// повторяет, если seq изменился, — ни блокировок, ни системных вызовов на
+// стороне симуляции.
+enum {
+    LIVE_IDLE = 0,
+    LIVE_DIALING = 1,
+    LIVE_TALKING = 2,
+    LIVE_LEFT = 3,
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t talkers;
+    _Atomic uint32_t seq;
+    uint32_t finished;   // симуляция завершилась, снимок последний
+    int32_t pid;
+    uint32_t refresh_ms;
+    int64_t updated_ms;  // время лога на момент снимка
+    int64_t active;      // болтунов в сети
+    uint64_t publishes;
+    char mode[16];
+} LiveHeader;
+
+typedef struct {
+    uint32_t state;      // LIVE_*
+    int32_t peer;        // собеседник или адресат набора, -1 — нет
+    uint32_t conversations;
+    uint32_t reserved;
+} LiveTalker;
+
+static inline size_t live_snapshot_size(uint32_t talkers) {
+    return sizeof(LiveHeader) + (size_t)talkers * sizeof(LiveTalker);
+}
+
+// Копирует согласованный снимок в head и rows (до max_rows записей).
+// false — писатель так и не отпустил seq за отведённые попытки.
+static inline bool live_read(const LiveHeader *shared, LiveHeader *head, LiveTalker *rows, uint32_t max_rows) {
+    const LiveTalker *src = (const LiveTalker *)(shared + 1);
+    for (int attempt = 0; attempt < 1000; ++attempt) {
+        uint32_t before = atomic_load_explicit(&shared->seq, memory_order_acquire);
+        if (before & 1u) continue;
+        memcpy(head, shared, sizeof(*head));
+        uint32_t count = head->talkers < max_rows ? head->talkers : max_rows;
+        memcpy(rows, src, (size_t)count * sizeof(*rows));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shared->seq, memory_order_relaxed) == before) return true;
+    }
+    return false;
+}
+
+#endif // LIVE_H
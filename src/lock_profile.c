@@ -0,0 +1,297 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+
+#include "lock_profile.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define MAX_HELD 4 // вложенных захватов на поток: больше в режимах не бывает
+
+typedef struct {
+    _Atomic uint64_t acquired;
+    _Atomic uint64_t contended; // захват пришлось ждать
+    _Atomic uint64_t wait_ns;
+    _Atomic uint64_t wait_max_ns;
+    _Atomic uint64_t hold_ns;
+    _Atomic uint64_t hold_max_ns;
+} SiteCounters;
+
+// Строка на поток болтуна пишется только им самим, без атомарных RMW, как
+// шарды статистики. Последняя строка общая для служебных потоков (колесо,
+// сторож остановки) и пишется RMW.
+typedef struct {
+    CACHE_ALIGNED SiteCounters sites[LOCK_SITE_COUNT];
+} ProfileRow;
+
+typedef struct {
+    pthread_mutex_t *mutex;
+    LockSite site;
+    uint64_t since;
+} Held;
+
+static const char *const site_names[LOCK_SITE_COUNT] = {
+    [LOCK_SEM_SELF] = "semaphore: своя линия",
+    [LOCK_SEM_PROBE] = "semaphore: проба адресата",
+    [LOCK_SEM_ANSWER] = "semaphore: приём запроса",
+    [LOCK_SEM_CALL_WAIT] = "semaphore: ожидание вызова",
+    [LOCK_COND_SELF] = "condition: своя линия",
+    [LOCK_COND_PROBE] = "condition: проба адресата",
+    [LOCK_COND_TIMER] = "condition: таймер паузы",
+    [LOCK_COND_STOP] = "condition: остановка",
+    [LOCK_SEM_ANSWER_WAIT] = "semaphore: ответ адресата",
+    [LOCK_SEM_INCOMING_WAIT] = "semaphore: запрос при уходе",
+    [LOCK_COND_INCOMING_WAIT] = "condition: входящий звонок",
+    [LOCK_COND_RENDEZVOUS] = "condition: барьер встречи",
+    [LOCK_COND_PAUSE] = "condition: пауза и разговор",
+};
+
+bool lock_profile_enabled;
+static bool heat_map;
+static int row_count; // болтуны + служебная строка
+static ProfileRow *rows;
+static _Atomic uint64_t *heat; // [строка захватившего][болтун-владелец], нс ожидания
+static void *mapping;
+static size_t mapping_bytes;
+
+static _Thread_local int bound_row = -1;
+static _Thread_local Held held[MAX_HELD];
+static _Thread_local int held_count;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int current_row(void) {
+    return bound_row >= 0 ? bound_row : row_count - 1;
+}
+
+static bool shared_row(int row) {
+    return row == row_count - 1;
+}
+
+static void add(_Atomic uint64_t *counter, uint64_t value, bool shared) {
+    if (shared) {
+        atomic_fetch_add_explicit(counter, value, memory_order_relaxed);
+    } else {
+        uint64_t v = atomic_load_explicit(counter, memory_order_relaxed);
+        atomic_store_explicit(counter, v + value, memory_order_relaxed);
+    }
+}
+
+static void raise_max(_Atomic uint64_t *counter, uint64_t value) {
+    uint64_t seen = atomic_load_explicit(counter, memory_order_relaxed);
+    while (seen < value
+           && !atomic_compare_exchange_weak_explicit(counter, &seen, value, memory_order_relaxed,
+                                                     memory_order_relaxed)) {
+    }
+}
+
+static void note_acquired(LockSite site, uint64_t wait_ns, bool contended, int owner) {
+    int row = current_row();
+    bool shared = shared_row(row);
+    SiteCounters *c = &rows[row].sites[site];
+    add(&c->acquired, 1, shared);
+    if (!contended) return;
+    add(&c->contended, 1, shared);
+    add(&c->wait_ns, wait_ns, shared);
+    raise_max(&c->wait_max_ns, wait_ns);
+    if (heat && owner >= 0 && owner < row_count - 1) {
+        add(&heat[(size_t)row * (size_t)(row_count - 1) + (size_t)owner], wait_ns, shared);
+    }
+}
+
+static void note_held(LockSite site, uint64_t hold_ns) {
+    int row = current_row();
+    SiteCounters *c = &rows[row].sites[site];
+    add(&c->hold_ns, hold_ns, shared_row(row));
+    raise_max(&c->hold_max_ns, hold_ns);
+}
+
+static void push_held(pthread_mutex_t *mutex, LockSite site) {
+    if (held_count < MAX_HELD) held[held_count++] = (Held){ mutex, site, now_ns() };
+}
+
+static Held *find_held(pthread_mutex_t *mutex) {
+    for (int i = held_count - 1; i >= 0; --i) {
+        if (held[i].mutex == mutex) return &held[i];
+    }
+    return NULL;
+}
+
+// Снимает захват со стека потока и учитывает удержание.
+static void pop_held(Held *h) {
+    note_held(h->site, now_ns() - h->since);
+    *h = held[--held_count];
+}
+
+// Таблица в общей анонимной памяти: в режиме process её заполняют
+// процессы-воркеры, а отчёт печатает родитель.
+bool lock_profile_init(const Config *config) {
+    if (strcmp(config->lock_profile, "off") == 0) return true;
+    row_count = config->talkers + 1;
+    heat_map = strcmp(config->lock_profile, "talkers") == 0;
+    size_t rows_bytes = (size_t)row_count * sizeof(ProfileRow);
+    size_t heat_bytes = heat_map ? (size_t)row_count * (size_t)config->talkers * sizeof(*heat) : 0;
+    mapping_bytes = rows_bytes + heat_bytes;
+    mapping = mmap(NULL, mapping_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        perror("mmap lock profile");
+        mapping = NULL;
+        return false;
+    }
+    rows = mapping;
+    heat = heat_map ? (_Atomic uint64_t *)((char *)mapping + rows_bytes) : NULL;
+    lock_profile_enabled = true;
+    return true;
+}
+
+void lock_profile_bind(int talker) {
+    if (lock_profile_enabled && talker >= 0 && talker < row_count - 1) bound_row = talker;
+}
+
+void lock_profile_shutdown(void) {
+    lock_profile_enabled = false;
+    if (mapping) munmap(mapping, mapping_bytes);
+    mapping = NULL;
+    rows = NULL;
+    heat = NULL;
+}
+
+// Сначала trylock: неоспоренный захват стоит одного вызова часов, а время
+// ожидания меряется только у тех, кому пришлось ждать.
+void lock_profile_mutex_lock(pthread_mutex_t *mutex, LockSite site, int owner) {
+    if (pthread_mutex_trylock(mutex) == 0) {
+        note_acquired(site, 0, false, owner);
+    } else {
+        uint64_t begin = now_ns();
+        pthread_mutex_lock(mutex);
+        note_acquired(site, now_ns() - begin, true, owner);
+    }
+    push_held(mutex, site);
+}
+
+void lock_profile_mutex_unlock(pthread_mutex_t *mutex) {
+    Held *h = find_held(mutex);
+    if (h) pop_held(h);
+    pthread_mutex_unlock(mutex);
+}
+
+// На время ожидания мьютекс отпущен: удержание прерывается и начинается
+// заново после пробуждения, под местом, где мьютекс брали.
+int lock_profile_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *until,
+                           LockSite site) {
+    Held *h = find_held(mutex);
+    LockSite held_site = h ? h->site : site;
+    if (h) pop_held(h);
+    uint64_t begin = now_ns();
+    int rc = until ? pthread_cond_timedwait(cond, mutex, until) : pthread_cond_wait(cond, mutex);
+    note_acquired(site, now_ns() - begin, true, -1);
+    if (h) push_held(mutex, held_site);
+    return rc;
+}
+
+int lock_profile_sem_wait(sem_t *sem, LockSite site) {
+    if (sem_trywait(sem) == 0) {
+        note_acquired(site, 0, false, -1);
+        return 0;
+    }
+    uint64_t begin = now_ns();
+    int rc;
+    while ((rc = sem_wait(sem)) != 0 && errno == EINTR) {
+    }
+    note_acquired(site, now_ns() - begin, true, -1);
+    return rc;
+}
+
+int lock_profile_barrier_wait(pthread_barrier_t *barrier, LockSite site) {
+    uint64_t begin = now_ns();
+    int rc = pthread_barrier_wait(barrier);
+    note_acquired(site, now_ns() - begin, true, -1);
+    return rc;
+}
+
+static void sum_site(LockSite site, SiteCounters *total) {
+    memset(total, 0, sizeof(*total));
+    for (int r = 0; r < row_count; ++r) {
+        SiteCounters *c = &rows[r].sites[site];
+        atomic_fetch_add(&total->acquired, atomic_load(&c->acquired));
+        atomic_fetch_add(&total->contended, atomic_load(&c->contended));
+        atomic_fetch_add(&total->wait_ns, atomic_load(&c->wait_ns));
+        atomic_fetch_add(&total->hold_ns, atomic_load(&c->hold_ns));
+        raise_max(&total->wait_max_ns, atomic_load(&c->wait_max_ns));
+        raise_max(&total->hold_max_ns, atomic_load(&c->hold_max_ns));
+    }
+}
+
+// Места из [first, last) по убыванию суммарного ожидания.
+static void report_sites(Logger *logger, const char *title, int first, int last, bool holds) {
+    SiteCounters totals[LOCK_SITE_COUNT];
+    int order[LOCK_SITE_COUNT];
+    int n = 0;
+    for (int s = first; s < last; ++s) {
+        sum_site((LockSite)s, &totals[s]);
+        if (atomic_load(&totals[s].acquired) == 0) continue;
+        int i = n++;
+        while (i > 0 && atomic_load(&totals[order[i - 1]].wait_ns) < atomic_load(&totals[s].wait_ns)) {
+            order[i] = order[i - 1];
+            i--;
+        }
+        order[i] = s;
+    }
+    if (n == 0) return;
+    log_message(logger, "%s", title);
+    for (int i = 0; i < n; ++i) {
+        SiteCounters *t = &totals[order[i]];
+        unsigned long long acquired = atomic_load(&t->acquired);
+        unsigned long long contended = atomic_load(&t->contended);
+        double wait_ms = (double)atomic_load(&t->wait_ns) / 1e6;
+        double wait_max_us = (double)atomic_load(&t->wait_max_ns) / 1e3;
+        if (holds) {
+            log_message(logger, "  %s: захватов %llu, с ожиданием %llu (%.1f%%), ожидание %.2f мс (max %.0f мкс), "
+                        "удержание %.2f мс (max %.0f мкс)",
+                        site_names[order[i]], acquired, contended, 100.0 * (double)contended / (double)acquired,
+                        wait_ms, wait_max_us, (double)atomic_load(&t->hold_ns) / 1e6,
+                        (double)atomic_load(&t->hold_max_ns) / 1e3);
+        } else {
+            log_message(logger, "  %s: ожиданий %llu, уснули %llu, ожидание %.2f мс (max %.0f мкс)",
+                        site_names[order[i]], acquired, contended, wait_ms, wait_max_us);
+        }
+    }
+}
+
+// Карта: строка — чей мьютекс, колонка — кто его ждал (последняя —
+// служебные потоки). Яркость — доля от самой горячей клетки.
+static void report_heat_map(Logger *logger) {
+    static const char shades[] = " .:-=+*#%@";
+    int talkers = row_count - 1;
+    uint64_t peak = 0;
+    for (size_t i = 0; i < (size_t)row_count * (size_t)talkers; ++i) {
+        uint64_t v = atomic_load(&heat[i]);
+        if (v > peak) peak = v;
+    }
+    if (peak == 0) return;
+    log_message(logger, "Карта ожидания мьютексов: строка — владелец, колонка — ждавший (последняя — служебные "
+                "потоки), '@' = %.2f мс", (double)peak / 1e6);
+    char line[MAX_TALKERS + 2];
+    for (int owner = 0; owner < talkers; ++owner) {
+        uint64_t total = 0;
+        for (int row = 0; row < row_count; ++row) {
+            uint64_t v = atomic_load(&heat[(size_t)row * (size_t)talkers + (size_t)owner]);
+            total += v;
+            line[row] = shades[(v * (sizeof(shades) - 2) + peak - 1) / peak];
+        }
+        line[row_count] = '\0';
+        log_message(logger, "  %3d |%s| %.2f мс", owner, line, (double)total / 1e6);
+    }
+}
+
+void lock_profile_report(Logger *logger) {
+    if (!rows) return;
+    report_sites(logger, "Профиль блокировок, мьютексы по суммарному ожиданию:", 0, LOCK_MUTEX_SITES, true);
+    report_sites(logger, "Профиль блокировок, ожидания сигнала:", LOCK_MUTEX_SITES, LOCK_SITE_COUNT, false);
+    if (heat) report_heat_map(logger);
+}
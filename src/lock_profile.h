@@ -0,0 +1,83 @@
+#ifndef LOCK_PROFILE_H
+#define LOCK_PROFILE_H
+
+#include "common.h"
+
+// Профиль блокировок (--lock-profile): обёртки над мьютексами, семафорами,
+// условными переменными и барьерами режимов semaphore, condition и
+// process. Для каждого места захвата считаются захваты, ожидание и
+// удержание. Выключенный профиль — одна проверка флага перед обычным
+// вызовом pthread/sem.
+typedef enum {
+    // мьютексы: ожидание — конкуренция за блокировку
+    LOCK_SEM_SELF,      // semaphore: своя линия (занять, освободить, уйти)
+    LOCK_SEM_PROBE,     // semaphore: проба линии адресата
+    LOCK_SEM_ANSWER,    // semaphore: взять запрос при ответе
+    LOCK_SEM_CALL_WAIT, // semaphore: очередь ожидания вызова
+    LOCK_COND_SELF,     // condition: своя линия и входящие
+    LOCK_COND_PROBE,    // condition: проба линии адресата
+    LOCK_COND_TIMER,    // condition: пауза и её пробуждение колесом
+    LOCK_COND_STOP,     // condition: пробуждение при остановке
+    LOCK_MUTEX_SITES,
+    // ожидания сигнала: семафоры, условные переменные, барьеры
+    LOCK_SEM_ANSWER_WAIT = LOCK_MUTEX_SITES, // semaphore: ответа адресата
+    LOCK_SEM_INCOMING_WAIT, // semaphore: запроса придержавшего линию
+    LOCK_COND_INCOMING_WAIT, // condition: входящего звонка
+    LOCK_COND_RENDEZVOUS,   // condition: барьер встречи
+    LOCK_COND_PAUSE,        // condition: пауза и разговор по колесу
+    LOCK_SITE_COUNT,
+} LockSite;
+
+extern bool lock_profile_enabled;
+
+bool lock_profile_init(const Config *config);
+void lock_profile_bind(int talker); // поток болтуна: его строка и колонка карты
+void lock_profile_report(Logger *logger);
+void lock_profile_shutdown(void);
+
+void lock_profile_mutex_lock(pthread_mutex_t *mutex, LockSite site, int owner);
+void lock_profile_mutex_unlock(pthread_mutex_t *mutex);
+int lock_profile_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, const struct timespec *until,
+                           LockSite site);
+int lock_profile_sem_wait(sem_t *sem, LockSite site);
+int lock_profile_barrier_wait(pthread_barrier_t *barrier, LockSite site);
+
+// owner — болтун, чей это мьютекс (строка карты), -1 — ничей.
+static inline void prof_mutex_lock(pthread_mutex_t *mutex, LockSite site, int owner) {
+    if (__builtin_expect(lock_profile_enabled, 0)) {
+        lock_profile_mutex_lock(mutex, site, owner);
+    } else {
+        pthread_mutex_lock(mutex);
+    }
+}
+
+static inline void prof_mutex_unlock(pthread_mutex_t *mutex) {
+    if (__builtin_expect(lock_profile_enabled, 0)) {
+        lock_profile_mutex_unlock(mutex);
+    } else {
+        pthread_mutex_unlock(mutex);
+    }
+}
+
+static inline int prof_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex, LockSite site) {
+    if (__builtin_expect(lock_profile_enabled, 0)) return lock_profile_cond_wait(cond, mutex, NULL, site);
+    return pthread_cond_wait(cond, mutex);
+}
+
+static inline int prof_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                                      const struct timespec *until, LockSite site) {
+    if (__builtin_expect(lock_profile_enabled, 0)) return lock_profile_cond_wait(cond, mutex, until, site);
+    return pthread_cond_timedwait(cond, mutex, until);
+}
+
+static inline int prof_sem_wait(sem_t *sem, LockSite site) {
+    if (__builtin_expect(lock_profile_enabled, 0)) return lock_profile_sem_wait(sem, site);
+    return sem_wait(sem);
+}
+
+static inline int prof_barrier_wait(pthread_barrier_t *barrier, LockSite site) {
+    if (__builtin_expect(lock_profile_enabled, 0)) return lock_profile_barrier_wait(barrier, site);
+    return pthread_barrier_wait(barrier);
+}
+
+#endif // LOCK_PROFILE_H
@@ -0,0 +1,193 @@
+#include "common.h"
+#include "affinity.h"
+#include "event_queue.h"
+#include "fsm.h"
+#include "stop.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+// M:N: болтуны — автоматы из fsm.c, их события исполняет фиксированный
+// пул потоков. Болтун закреплён за потоком (id % workers), у каждого потока
+// свой календарь таймеров в реальном времени.
+struct PoolState;
+
+typedef struct {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    EventQueue timers;
+    unsigned long processed;
+    struct PoolState *pool;
+} Worker;
+
+typedef struct PoolState {
+    FsmNetwork net;
+    Logger *logger;
+    Worker *workers;
+    int worker_count;
+    _Atomic long pending; // запланированные, но не исполненные события
+    _Atomic bool done;
+    _Atomic bool out_of_memory;
+} Pool;
+
+static long pool_now(void *ctx) {
+    return elapsed_ms_since(((Pool *)ctx)->logger);
+}
+
+// с шардами болтуны одного шарда живут на одном потоке
+static Worker *home_worker(Pool *pool, int talker_id) {
+    const Config *cfg = pool->net.config;
+    int slot = cfg->shards > 1 ? shard_of(talker_id, cfg->talkers, cfg->shards) : talker_id;
+    return &pool->workers[slot % pool->worker_count];
+}
+
+static void pool_schedule(void *ctx, int talker_id, long at_ms, FsmEventKind kind) {
+    Pool *pool = (Pool *)ctx;
+    Worker *w = home_worker(pool, talker_id);
+    atomic_fetch_add(&pool->pending, 1);
+    pthread_mutex_lock(&w->lock);
+    const SimEvent *top = event_queue_peek(&w->timers);
+    bool earliest = !top || at_ms < top->at_ms;
+    if (!event_queue_push(&w->timers, at_ms, talker_id, (int)kind)) {
+        atomic_store(&pool->out_of_memory, true);
+        atomic_store(&pool->done, true);
+    }
+    pthread_mutex_unlock(&w->lock);
+    if (earliest) pthread_cond_signal(&w->wake);
+}
+
+static void finish_pool(Pool *pool) {
+    atomic_store(&pool->done, true);
+    for (int i = 0; i < pool->worker_count; ++i) {
+        Worker *w = &pool->workers[i];
+        pthread_mutex_lock(&w->lock);
+        pthread_cond_broadcast(&w->wake);
+        pthread_mutex_unlock(&w->lock);
+    }
+}
+
+// Остановку воркер проверяет под своим lock, так что будить под ним же
+// достаточно: пробуждение не потеряется.
+static void wake_workers(void *arg) {
+    Pool *pool = (Pool *)arg;
+    for (int i = 0; i < pool->worker_count; ++i) {
+        Worker *w = &pool->workers[i];
+        pthread_mutex_lock(&w->lock);
+        pthread_cond_broadcast(&w->wake);
+        pthread_mutex_unlock(&w->lock);
+    }
+}
+
+static void deadline_to_timespec(const Logger *logger, long at_ms, struct timespec *ts) {
+    *ts = logger->start_ts;
+    ts->tv_sec += at_ms / 1000;
+    ts->tv_nsec += (at_ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) { ts->tv_nsec -= 1000000000L; ts->tv_sec += 1; }
+}
+
+static void *worker_thread(void *arg) {
+    Worker *self = (Worker *)arg;
+    Pool *pool = self->pool;
+    FsmNetwork *net = &pool->net;
+    affinity_pin_worker((int)(self - pool->workers));
+
+    pthread_mutex_lock(&self->lock);
+    while (!atomic_load(&pool->done)) {
+        long now = pool_now(pool);
+        if (fsm_should_stop(net, now)) {
+            pthread_mutex_unlock(&self->lock);
+            finish_pool(pool);
+            pthread_mutex_lock(&self->lock);
+            break;
+        }
+
+        const SimEvent *top = event_queue_peek(&self->timers);
+        if (!top || top->at_ms > now) {
+            // спим до ближайшего таймера или дедлайна; SIGINT будит wake_workers
+            long wake_at = top ? top->at_ms : -1;
+            if (net->deadline_ms >= 0 && (wake_at < 0 || wake_at > net->deadline_ms)) wake_at = net->deadline_ms;
+            if (wake_at < 0) {
+                pthread_cond_wait(&self->wake, &self->lock);
+                continue;
+            }
+            struct timespec ts;
+            deadline_to_timespec(pool->logger, wake_at, &ts);
+            pthread_cond_timedwait(&self->wake, &self->lock, &ts);
+            continue;
+        }
+
+        SimEvent ev;
+        event_queue_pop(&self->timers, &ev);
+        pthread_mutex_unlock(&self->lock);
+
+        fsm_dispatch(net, ev.talker, (FsmEventKind)ev.kind);
+        self->processed++;
+        if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+            finish_pool(pool);
+        }
+
+        pthread_mutex_lock(&self->lock);
+    }
+    pthread_mutex_unlock(&self->lock);
+    return NULL;
+}
+
+int run_pool_mode(const Config *config, Logger *logger) {
+    Pool pool = { .logger = logger };
+    pool.worker_count = config->workers > 0 ? config->workers : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (pool.worker_count < 1) pool.worker_count = 1;
+    if (pool.worker_count > config->talkers) pool.worker_count = config->talkers;
+    atomic_init(&pool.pending, 0);
+    atomic_init(&pool.done, false);
+    atomic_init(&pool.out_of_memory, false);
+
+    FsmDriver driver = { .ctx = &pool, .now_ms = pool_now, .schedule = pool_schedule };
+    pool.workers = calloc((size_t)pool.worker_count, sizeof(Worker));
+    if (!pool.workers || !fsm_init(&pool.net, config, logger, driver)) {
+        fprintf(stderr, "Недостаточно памяти для болтунов\n");
+        free(pool.workers);
+        return 1;
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    size_t per_worker = (size_t)config->talkers / (size_t)pool.worker_count + 1;
+    for (int i = 0; i < pool.worker_count; ++i) {
+        Worker *w = &pool.workers[i];
+        w->pool = &pool;
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->wake, &attr);
+        event_queue_init(&w->timers, per_worker * 2);
+    }
+    pthread_condattr_destroy(&attr);
+
+    stop_watch_add(wake_workers, &pool);
+    fsm_start(&pool.net);
+    for (int i = 0; i < pool.worker_count; ++i) {
+        pthread_create(&pool.workers[i].thread, NULL, worker_thread, &pool.workers[i]);
+    }
+
+    unsigned long processed = 0;
+    for (int i = 0; i < pool.worker_count; ++i) {
+        pthread_join(pool.workers[i].thread, NULL);
+        processed += pool.workers[i].processed;
+    }
+    stop_watch_remove(wake_workers, &pool);
+    log_message(logger, "Пул: %d потоков, обработано событий: %lu", pool.worker_count, processed);
+
+    int rc = 0;
+    if (atomic_load(&pool.out_of_memory)) {
+        fprintf(stderr, "Недостаточно памяти для календаря событий\n");
+        rc = 1;
+    }
+    for (int i = 0; i < pool.worker_count; ++i) {
+        pthread_mutex_destroy(&pool.workers[i].lock);
+        pthread_cond_destroy(&pool.workers[i].wake);
+        event_queue_destroy(&pool.workers[i].timers);
+    }
+    free(pool.workers);
+    if (!fsm_destroy(&pool.net)) rc = 1;
+    return rc;
+}
@@ -0,0 +1,80 @@
+#include "common.h"
+#include "fsm.h"
+#include "journal.h"
+#include "stop.h"
+
+// Воспроизведение журнала --record: события автоматов идут в записанном
+// порядке и в записанные моменты, в одном потоке. Без --replay-speed время
+// сжато — пауз нет вовсе; со скоростью k прогон идёт в k раз быстрее
+// записанного.
+typedef struct {
+    long now_ms;
+} Replayer;
+
+static long replay_now(void *ctx) {
+    return ((Replayer *)ctx)->now_ms;
+}
+
+// Порядок задаёт журнал, календарь не нужен.
+static void replay_schedule(void *ctx, int talker_id, long at_ms, FsmEventKind kind) {
+    (void)ctx;
+    (void)talker_id;
+    (void)at_ms;
+    (void)kind;
+}
+
+int run_replay_mode(const Config *config, Logger *logger) {
+    Journal journal;
+    if (!journal_open_replay(&journal, config->replay_path)) return 1;
+    Replayer replayer = { .now_ms = 0 };
+    FsmNetwork net;
+    FsmDriver driver = { .ctx = &replayer, .now_ms = replay_now, .schedule = replay_schedule };
+    if (!fsm_init(&net, config, logger, driver)) {
+        fprintf(stderr, "Недостаточно памяти для болтунов\n");
+        journal_close(&journal);
+        return 1;
+    }
+    net.journal = &journal;
+    log_message(logger, "Воспроизведение журнала %s (записан в режиме %s)", config->replay_path, config->mode);
+
+    int talker, kind;
+    long at_ms;
+    if (journal_next_start(&journal, &at_ms)) {
+        replayer.now_ms = at_ms;
+        fsm_start(&net);
+    }
+    long started_ms = elapsed_ms_since(logger);
+    while (!stop_requested() && journal_next_dispatch(&journal, &talker, &kind, &at_ms)) {
+        if (talker < 0 || talker >= net.count || (kind != FSM_WAKE && kind != FSM_CALL_END)) {
+            snprintf(journal.divergence, sizeof(journal.divergence), "событие из журнала вне сети");
+            journal.diverged = true;
+            break;
+        }
+        if (config->replay_speed > 0) {
+            // темп держится от начала прогона, а не от события к событию:
+            // иначе округление коротких пауз копится
+            long due = started_ms + (long)((double)at_ms / config->replay_speed);
+            long wait = due - elapsed_ms_since(logger);
+            if (wait > 0) stop_sleep((int)wait);
+        }
+        replayer.now_ms = at_ms;
+        fsm_dispatch(&net, talker, (FsmEventKind)kind);
+    }
+
+    int rc = 0;
+    if (journal.diverged) {
+        log_message_at(logger, replayer.now_ms, "Расхождение с журналом на событии %lu: %s", journal.dispatches,
+                       journal.divergence);
+        rc = 3;
+    } else if (journal.pos < journal.size) {
+        log_message_at(logger, replayer.now_ms, "Воспроизведение прервано на событии %lu из журнала",
+                       journal.dispatches);
+    } else {
+        log_message_at(logger, replayer.now_ms, "Воспроизведено событий %lu (записей %lu), расхождений нет",
+                       journal.dispatches, journal.entries);
+    }
+    net.journal = NULL;
+    fsm_destroy(&net);
+    journal_close(&journal);
+    return rc;
+}
@@ -0,0 +1,49 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// xoshiro256** — у каждого болтуна свой генератор, общего состояния нет.
+// Поток генератора определяется парой (seed, stream): при одинаковом зерне
+// болтун получает ту же последовательность в любом запуске.
+typedef struct {
+    uint64_t s[4];
+} Rng;
+
+static inline uint64_t rng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_splitmix(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+static inline void rng_seed(Rng *rng, uint64_t seed, uint64_t stream) {
+    uint64_t state = seed ^ rng_splitmix(&stream);
+    for (int i = 0; i < 4; ++i) {
+        rng->s[i] = rng_splitmix(&state);
+    }
+}
+
+static inline uint64_t rng_next(Rng *rng) {
+    uint64_t *s = rng->s;
+    uint64_t result = rng_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 45);
+    return result;
+}
+
+// равномерно в [0, 1)
+static inline double rng_unit(Rng *rng) {
+    return (double)(rng_next(rng) >> 11) * 0x1.0p-53;
+}
+
+#endif // RNG_H
@@ -1,7 +1,18 @@
 #include "common.h"
+#include "affinity.h"
+#include "call_queue.h"
+#include "idle_index.h"
+#include "lock_profile.h"
+#include "stop.h"
+#include "timer_wheel.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -11,16 +22,26 @@ typedef struct {
     bool has_request;
 } CallRequest;
 
+// Поля сгруппированы по тому, кто их трогает: пробы звонящих читают
+// мьютекс и флаги, семафоры постят чужие потоки, остальное — только свой.
+// Каждая группа на своей строке кэша, так что проба линии не спорит ни
+// с соседними болтунами, ни с ГПСЧ и таймером владельца.
 typedef struct {
-    int id;
-    pthread_t thread;
-    pthread_mutex_t mutex;
-    sem_t incoming_sem;
-    sem_t answer_sem;
-    CallRequest incoming;
+    CACHE_ALIGNED pthread_mutex_t mutex;
     bool active;
     bool busy;
+    int held_for; // линия придержана для звонящего из очереди, -1 — нет
+    CallRequest incoming;
+    CallQueue waiting; // кто ждёт нашей линии (--call-waiting)
+    CACHE_ALIGNED sem_t incoming_sem;
+    sem_t answer_sem;
+    CallWaiter wait_word; // своё ожидание в чужой очереди
+    CACHE_ALIGNED sem_t timer_sem;
+    TimerEntry timer;
+    int id;
     int conversations;
+    Rng rng;
+    pthread_t thread;
     struct SharedState *shared;
 } Talker;
 
@@ -28,33 +49,80 @@ typedef struct SharedState {
     const Config *config;
     Logger *logger;
     Talker talkers[MAX_TALKERS];
+    IdleIndex idle;
+    TimerWheel *wheel; // NULL — каждый болтун спит сам (режим process)
     _Atomic int active_count;
     struct timespec start_ts;
+    bool call_waiting;
 } Shared;
 
-static void msleep(int ms) {
-    struct timespec ts;
-    ts.tv_sec = ms / 1000;
-    ts.tv_nsec = (ms % 1000) * 1000000L;
-    nanosleep(&ts, NULL);
+static void wake_sleeper(void *arg) {
+    sem_post((sem_t *)arg);
+}
+
+// Пауза через общее колесо таймеров: один поток колеса будит болтуна
+// семафором вместо отдельного nanosleep в каждом потоке. При остановке
+// колесо срабатывает сразу, так что разговор не дотягивается до конца.
+static void talker_sleep(Talker *self, int ms) {
+    if (!self->shared->wheel) {
+        stop_sleep(ms);
+        return;
+    }
+    timer_wheel_add(self->shared->wheel, &self->timer, ms);
+    // пауза — не ожидание блокировки, в профиль её не пишем
+    while (sem_wait(&self->timer_sem) != 0) {
+    }
 }
 
 static bool timed_out(const Shared *shared) {
     if (shared->config->duration_seconds <= 0) return false;
-    struct timespec now;
-    clock_gettime(CLOCK_MONOTONIC, &now);
-    long sec = now.tv_sec - shared->start_ts.tv_sec;
-    return sec >= shared->config->duration_seconds;
+    long ms;
+    if (shared->wheel) {
+        // болтуны просыпаются по колесу, так что его тик свежий
+        ms = timer_wheel_now(shared->wheel);
+    } else {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        ms = (now.tv_sec - shared->start_ts.tv_sec) * 1000
+            + (now.tv_nsec - shared->start_ts.tv_nsec) / 1000000;
+    }
+    return ms >= shared->config->duration_seconds * 1000L;
+}
+
+// Вызывается под мутексом: отдаёт освободившуюся линию первому ещё
+// ждущему из очереди. Звонящий встаёт в очередь до проверки линии под тем
+// же мутексом, так что его запись здесь уже видна.
+static bool hold_for_waiting(Talker *self) {
+    if (!self->shared->call_waiting || !self->active) return false;
+    int caller;
+    uint32_t ticket;
+    while (call_queue_pop(&self->waiting, &caller, &ticket)) {
+        if (call_wait_resolve(&self->shared->talkers[caller].wait_word, ticket, WAIT_OFFERED)) {
+            self->held_for = caller;
+            return true;
+        }
+    }
+    return false;
 }
 
 static void release_self(Talker *self) {
-    pthread_mutex_lock(&self->mutex);
-    self->busy = false;
-    pthread_mutex_unlock(&self->mutex);
+    prof_mutex_lock(&self->mutex, LOCK_SEM_SELF, self->id);
+    self->busy = hold_for_waiting(self);
+    if (!self->busy && self->active) idle_index_set(&self->shared->idle, self->id);
+    prof_mutex_unlock(&self->mutex);
+}
+
+// Линия больше не освободится: ждущим отказываем.
+static void drop_waiting(Shared *shared, Talker *self) {
+    int caller;
+    uint32_t ticket;
+    while (shared->call_waiting && call_queue_pop(&self->waiting, &caller, &ticket)) {
+        call_wait_resolve(&shared->talkers[caller].wait_word, ticket, WAIT_DROPPED);
+    }
 }
 
 static void finish_conversation(Shared *shared, Talker *self, int other_id, int duration_ms) {
-    log_message(shared->logger, "Болтун %d завершил разговор с %d (%d мс)", self->id, other_id, duration_ms);
+    log_event(shared->logger, EVT_FINISH, self->id, other_id, duration_ms);
     release_self(self);
     self->conversations++;
 }
@@ -63,75 +131,158 @@ static bool should_leave(const Config *cfg, Talker *self) {
     if (cfg->stop_after_calls > 0 && self->conversations >= cfg->stop_after_calls) {
         return true;
     }
-    double r = rand() / (double)RAND_MAX;
-    return r < cfg->leave_probability;
+    return random_chance(&self->rng, cfg->leave_probability);
 }
 
 static void leave_network(Shared *shared, Talker *self) {
-    pthread_mutex_lock(&self->mutex);
+    prof_mutex_lock(&self->mutex, LOCK_SEM_SELF, self->id);
     self->active = false;
-    pthread_mutex_unlock(&self->mutex);
+    idle_index_clear(&shared->idle, self->id);
+    prof_mutex_unlock(&self->mutex);
     int left = atomic_fetch_sub(&shared->active_count, 1) - 1;
-    log_message(shared->logger, "Болтун %d отключился (осталось %d)", self->id, left);
+    log_event(shared->logger, EVT_LEAVE, self->id, left, 0);
+}
+
+static void answer_call(Shared *shared, Talker *self) {
+    prof_mutex_lock(&self->mutex, LOCK_SEM_ANSWER, self->id);
+    CallRequest req = self->incoming;
+    self->incoming.has_request = false;
+    prof_mutex_unlock(&self->mutex);
+
+    Talker *caller = &shared->talkers[req.from_id];
+    log_event(shared->logger, EVT_ANSWER, self->id, caller->id, 0);
+    sem_post(&caller->answer_sem);
+
+    log_event(shared->logger, EVT_TALK, caller->id, self->id, req.duration_ms);
+    talker_sleep(self, req.duration_ms);
+
+    finish_conversation(shared, self, caller->id, req.duration_ms);
 }
 
 static void handle_incoming(Shared *shared, Talker *self) {
     while (sem_trywait(&self->incoming_sem) == 0) {
-        pthread_mutex_lock(&self->mutex);
-        CallRequest req = self->incoming;
-        self->incoming.has_request = false;
-        pthread_mutex_unlock(&self->mutex);
+        answer_call(shared, self);
+    }
+}
+
+// Завершившийся болтун больше не принимает звонков, но звонящий, успевший
+// занять его линию, ждёт ответа на answer_sem: отвечаем ему, иначе он
+// зависнет навсегда. Звонящий, для которого линия придержана, вот-вот
+// позвонит: его тоже дожидаемся.
+static void hang_up(Shared *shared, Talker *self) {
+    prof_mutex_lock(&self->mutex, LOCK_SEM_SELF, self->id);
+    self->active = false;
+    bool pending = self->incoming.has_request || self->held_for >= 0;
+    prof_mutex_unlock(&self->mutex);
+    drop_waiting(shared, self);
+    if (pending) {
+        prof_sem_wait(&self->incoming_sem, LOCK_SEM_INCOMING_WAIT);
+        answer_call(shared, self);
+    }
+}
+
+// Свою линию занимаем до чужой: иначе двое, одновременно позвонившие
+// друг другу, оба ждали бы ответа на answer_sem и не дождались.
+static bool claim_self(Shared *shared, Talker *self) {
+    prof_mutex_lock(&self->mutex, LOCK_SEM_SELF, self->id);
+    bool free = !self->busy;
+    if (free) {
+        self->busy = true;
+        idle_index_clear(&shared->idle, self->id);
+    }
+    prof_mutex_unlock(&self->mutex);
+    return free;
+}
 
-        Talker *caller = &shared->talkers[req.from_id];
-        log_message(shared->logger, "Болтун %d отвечает на звонок %d", self->id, caller->id);
-        sem_post(&caller->answer_sem);
+// Вызывается под мутексом адресата, чья линия уже занята за нами:
+// оставляет запрос, отпускает мутекс и проводит разговор.
+static bool dial(Shared *shared, Talker *self, Talker *callee, int duration) {
+    callee->incoming.from_id = self->id;
+    callee->incoming.duration_ms = duration;
+    callee->incoming.has_request = true;
+    prof_mutex_unlock(&callee->mutex);
 
-        log_message(shared->logger, "Разговор %d ↔ %d (%d мс)", caller->id, self->id, req.duration_ms);
-        msleep(req.duration_ms);
+    log_event(shared->logger, EVT_DIAL, self->id, callee->id, 0);
+    sem_post(&callee->incoming_sem);
+    prof_sem_wait(&self->answer_sem, LOCK_SEM_ANSWER_WAIT);
+    if (!self->active) {
+        release_self(self);
+        return false;
+    }
+    log_event(shared->logger, EVT_TALK, self->id, callee->id, duration);
+    talker_sleep(self, duration);
+    finish_conversation(shared, self, callee->id, duration);
+    return true;
+}
 
-        finish_conversation(shared, self, caller->id, req.duration_ms);
+// Встаём в очередь занятого адресата и ждём, пока он придержит для нас
+// линию; своя линия всё это время занята, так что нам не звонят.
+static bool wait_for_line(Shared *shared, Talker *self, Talker *callee) {
+    uint32_t ticket = call_wait_begin(&self->wait_word);
+    uint32_t depth = 0;
+    if (!call_queue_push(&callee->waiting, self->id, ticket, &depth)) {
+        call_wait_resolve(&self->wait_word, ticket, WAIT_DROPPED);
+        return false;
+    }
+    // адресат освободился или ушёл, не заметив нас в очереди
+    prof_mutex_lock(&callee->mutex, LOCK_SEM_CALL_WAIT, callee->id);
+    if (!callee->busy || !callee->active || stop_requested()) {
+        call_wait_resolve(&self->wait_word, ticket, WAIT_DROPPED);
     }
+    prof_mutex_unlock(&callee->mutex);
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    bool served = call_wait_park(&self->wait_word, ticket, shared->config->call_wait_ms) == WAIT_OFFERED;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats_on_call_wait(depth, (end.tv_sec - begin.tv_sec) * 1000000LL + (end.tv_nsec - begin.tv_nsec) / 1000, served);
+    return served;
+}
+
+// придержанную за нами линию никто, кроме нас, не займёт
+static bool dial_held(Shared *shared, Talker *self, Talker *callee, int duration) {
+    prof_mutex_lock(&callee->mutex, LOCK_SEM_CALL_WAIT, callee->id);
+    callee->held_for = -1;
+    return dial(shared, self, callee, duration);
 }
 
 static bool try_start_call(Shared *shared, Talker *self) {
     const Config *cfg = shared->config;
-    int duration = random_range(cfg->min_call_ms, cfg->max_call_ms);
+    int duration = random_range(&self->rng, cfg->min_call_ms, cfg->max_call_ms);
+    // нам уже звонят: ответим на следующем handle_incoming
+    if (!claim_self(shared, self)) return false;
 
     int attempts = 0;
     while (attempts < cfg->talkers * 2 && !stop_requested() && !timed_out(shared)) {
-        int target = random_range(0, cfg->talkers - 1);
-        if (target == self->id) { attempts++; continue; }
+        int target = idle_index_pick(&shared->idle, &self->rng, self->id);
+        if (target < 0) {
+            log_event(shared->logger, EVT_NO_LINE, self->id, -1, 0);
+            // свободных нет: ждём случайного занятого, а не пробуем позже
+            if (shared->call_waiting && cfg->talkers > 1) {
+                target = random_range(&self->rng, 0, cfg->talkers - 2);
+                if (target >= self->id) target++;
+                Talker *callee = &shared->talkers[target];
+                if (wait_for_line(shared, self, callee)) return dial_held(shared, self, callee, duration);
+            }
+            break;
+        }
         Talker *callee = &shared->talkers[target];
 
-        pthread_mutex_lock(&callee->mutex);
+        prof_mutex_lock(&callee->mutex, LOCK_SEM_PROBE, callee->id);
         bool available = callee->active && !callee->busy;
         if (available) {
             callee->busy = true;
-            callee->incoming.from_id = self->id;
-            callee->incoming.duration_ms = duration;
-            callee->incoming.has_request = true;
-            pthread_mutex_unlock(&callee->mutex);
-
-            pthread_mutex_lock(&self->mutex);
-            self->busy = true;
-            pthread_mutex_unlock(&self->mutex);
-
-            log_message(shared->logger, "Болтун %d набирает %d", self->id, target);
-            sem_post(&callee->incoming_sem);
-            sem_wait(&self->answer_sem);
-            if (!self->active) {
-                release_self(self);
-                return false;
-            }
-            log_message(shared->logger, "Разговор %d ↔ %d (%d мс)", self->id, target, duration);
-            msleep(duration);
-            finish_conversation(shared, self, target, duration);
-            return true;
+            idle_index_clear(&shared->idle, target);
+            return dial(shared, self, callee, duration);
+        }
+        prof_mutex_unlock(&callee->mutex);
+        idle_index_note_miss(&shared->idle);
+        log_event(shared->logger, EVT_BUSY, self->id, target, 0);
+        if (shared->call_waiting && wait_for_line(shared, self, callee)) {
+            return dial_held(shared, self, callee, duration);
         }
-        pthread_mutex_unlock(&callee->mutex);
-        log_message(shared->logger, "Линия %d занята для %d", target, self->id);
         attempts++;
     }
+    release_self(self);
     return false;
 }
 
@@ -139,15 +290,18 @@ static void *talker_thread(void *arg) {
     Talker *self = (Talker *)arg;
     Shared *shared = self->shared;
     const Config *cfg = shared->config;
+    affinity_pin_talker(cfg, self->id);
+    lock_profile_bind(self->id);
 
     while (self->active && !stop_requested() && !timed_out(shared)) {
-        int pause_ms = random_range(cfg->min_idle_ms, cfg->max_idle_ms);
-        msleep(pause_ms);
+        int pause_ms = random_range(&self->rng, cfg->min_idle_ms, cfg->max_idle_ms);
+        talker_sleep(self, pause_ms);
+        stats_on_idle((int64_t)pause_ms * 1000);
 
         handle_incoming(shared, self);
         if (!self->active || stop_requested() || timed_out(shared)) break;
 
-        if (random_range(0, 1) == 0) {
+        if (random_range(&self->rng, 0, 1) == 0) {
             // предпочитаем дождаться входящих
             handle_incoming(shared, self);
         } else {
@@ -159,46 +313,212 @@ static void *talker_thread(void *arg) {
             break;
         }
     }
+    hang_up(shared, self);
 
     if (atomic_load(&shared->active_count) == 0) {
-        log_message(shared->logger, "Последний болтун завершил работу");
+        log_event(shared->logger, EVT_LAST, -1, -1, 0);
     }
     return NULL;
 }
 
-int run_semaphore_mode(const Config *config, Logger *logger) {
-    Shared shared = { .config = config, .logger = logger };
-    shared.active_count = config->talkers;
-    clock_gettime(CLOCK_MONOTONIC, &shared.start_ts);
-    srand((unsigned)time(NULL));
-
+// pshared != 0 — мьютекс и семафоры доступны из других процессов
+static void init_talkers(Shared *shared, int pshared) {
+    const Config *config = shared->config;
+    pthread_mutexattr_t attr;
+    idle_index_set_shards(&shared->idle, config->shards);
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, pshared ? PTHREAD_PROCESS_SHARED : PTHREAD_PROCESS_PRIVATE);
     for (int i = 0; i < config->talkers; ++i) {
-        Talker *t = &shared.talkers[i];
+        Talker *t = &shared->talkers[i];
         t->id = i;
-        t->shared = &shared;
+        t->shared = shared;
         t->active = true;
         t->busy = false;
         t->conversations = 0;
+        rng_seed(&t->rng, config->seed, (uint64_t)i);
+        t->held_for = -1;
         t->incoming.has_request = false;
-        pthread_mutex_init(&t->mutex, NULL);
-        sem_init(&t->incoming_sem, 0, 0);
-        sem_init(&t->answer_sem, 0, 0);
+        atomic_init(&t->wait_word, WAIT_IDLE);
+        pthread_mutex_init(&t->mutex, &attr);
+        sem_init(&t->incoming_sem, pshared, 0);
+        sem_init(&t->answer_sem, pshared, 0);
+        sem_init(&t->timer_sem, pshared, 0);
+        t->timer.fire = wake_sleeper;
+        t->timer.arg = &t->timer_sem;
+        idle_index_set(&shared->idle, i);
     }
+    pthread_mutexattr_destroy(&attr);
+}
 
-    for (int i = 0; i < config->talkers; ++i) {
-        pthread_create(&shared.talkers[i].thread, NULL, talker_thread, &shared.talkers[i]);
-        log_message(logger, "Болтун %d подключился", i);
+static void destroy_talkers(Shared *shared) {
+    for (int i = 0; i < shared->config->talkers; ++i) {
+        pthread_mutex_destroy(&shared->talkers[i].mutex);
+        sem_destroy(&shared->talkers[i].incoming_sem);
+        sem_destroy(&shared->talkers[i].answer_sem);
+        sem_destroy(&shared->talkers[i].timer_sem);
     }
+}
 
-    for (int i = 0; i < config->talkers; ++i) {
-        pthread_join(shared.talkers[i].thread, NULL);
+// Очереди ожидания только у потоков одного процесса: кольцо выделяется
+// в куче, в общей памяти режима process его нет.
+static bool init_queues(Shared *shared) {
+    for (int i = 0; shared->call_waiting && i < shared->config->talkers; ++i) {
+        if (!call_queue_init(&shared->talkers[i].waiting, shared->config->call_waiting)) {
+            while (i-- > 0) call_queue_destroy(&shared->talkers[i].waiting);
+            return false;
+        }
     }
+    return true;
+}
 
-    for (int i = 0; i < config->talkers; ++i) {
-        pthread_mutex_destroy(&shared.talkers[i].mutex);
-        sem_destroy(&shared.talkers[i].incoming_sem);
-        sem_destroy(&shared.talkers[i].answer_sem);
+static void destroy_queues(Shared *shared) {
+    for (int i = 0; shared->call_waiting && i < shared->config->talkers; ++i) {
+        call_queue_destroy(&shared->talkers[i].waiting);
+    }
+}
+
+// Ждущего в чужой очереди при остановке снимаем с ожидания.
+static void drop_parked(void *arg) {
+    Shared *shared = (Shared *)arg;
+    for (int i = 0; i < shared->config->talkers; ++i) {
+        call_wait_drop(&shared->talkers[i].wait_word);
+    }
+}
+
+// Запускает потоки болтунов first, first + step, ... и дожидается их.
+static void run_talkers(Shared *shared, int first, int step) {
+    for (int i = first; i < shared->config->talkers; i += step) {
+        pthread_create(&shared->talkers[i].thread, NULL, talker_thread, &shared->talkers[i]);
+        log_event(shared->logger, EVT_CONNECT, i, -1, 0);
+    }
+    for (int i = first; i < shared->config->talkers; i += step) {
+        pthread_join(shared->talkers[i].thread, NULL);
+    }
+}
+
+int run_semaphore_mode(const Config *config, Logger *logger) {
+    Shared shared = { .config = config, .logger = logger };
+    shared.active_count = config->talkers;
+    shared.call_waiting = config->call_waiting > 0;
+    clock_gettime(CLOCK_MONOTONIC, &shared.start_ts);
+    if (!idle_index_init(&shared.idle, config->talkers)) {
+        fprintf(stderr, "Недостаточно памяти для индекса линий\n");
+        return 1;
+    }
+    if (!init_queues(&shared)) {
+        fprintf(stderr, "Недостаточно памяти для очередей ожидания\n");
+        idle_index_destroy(&shared.idle);
+        return 1;
     }
+    TimerWheel wheel;
+    if (timer_wheel_start(&wheel, &shared.start_ts)) shared.wheel = &wheel;
+
+    init_talkers(&shared, 0);
+    if (shared.call_waiting) stop_watch_add(drop_parked, &shared);
+    run_talkers(&shared, 0, 1);
+    if (shared.call_waiting) stop_watch_remove(drop_parked, &shared);
+    if (shared.wheel) {
+        timer_wheel_stop(shared.wheel);
+        timer_wheel_report(shared.wheel, logger);
+    }
+    destroy_talkers(&shared);
+    destroy_queues(&shared);
+    idle_index_report(&shared.idle, logger);
+    idle_index_destroy(&shared.idle);
     return 0;
 }
 
+static Shared *map_shared_segment(size_t bytes) {
+    char name[64];
+    snprintf(name, sizeof(name), "/talkers-%ld", (long)getpid());
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        perror("shm_open");
+        return NULL;
+    }
+    void *mem = MAP_FAILED;
+    if (ftruncate(fd, (off_t)bytes) == 0) {
+        mem = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (mem == MAP_FAILED) perror("mmap shm");
+    // имя больше не нужно: сегмент живёт, пока отображён хотя бы в одном процессе
+    close(fd);
+    shm_unlink(name);
+    return mem == MAP_FAILED ? NULL : mem;
+}
+
+typedef struct {
+    const pid_t *pids;
+    int count;
+    _Atomic int reaped; // воркеры ждём по порядку: первые reaped уже собраны
+} Workers;
+
+// Сигнал мог прийти одному родителю (kill по pid при перезапуске), а
+// дедлайн у воркеров свой: пересылаем остановку ещё живым воркерам.
+static void forward_stop(void *arg) {
+    Workers *w = (Workers *)arg;
+    for (int k = atomic_load(&w->reaped); k < w->count; ++k) {
+        if (w->pids[k] > 0) kill(w->pids[k], SIGINT);
+    }
+}
+
+// Та же схема, что в run_semaphore_mode, но таблица болтунов лежит в общей
+// памяти POSIX, а болтуны i % processes == k живут в процессе-воркере k.
+// Указатели внутри сегмента и на config/logger одинаковы во всех процессах,
+// так как сегмент отображён до fork.
+int run_process_mode(const Config *config, Logger *logger) {
+    size_t bytes = sizeof(Shared) + idle_index_storage_size(config->talkers);
+    Shared *shared = map_shared_segment(bytes);
+    if (!shared) return 1;
+    shared->config = config;
+    shared->logger = logger;
+    atomic_init(&shared->active_count, config->talkers);
+    clock_gettime(CLOCK_MONOTONIC, &shared->start_ts);
+    idle_index_init_at(&shared->idle, config->talkers, shared + 1);
+    init_talkers(shared, 1);
+
+    int workers = config->processes;
+    pid_t pids[MAX_TALKERS];
+    log_message(logger, "Процессов-воркеров: %d", workers);
+    for (int k = 0; k < workers; ++k) {
+        pids[k] = fork();
+        if (pids[k] == 0) {
+            if (!logger_after_fork(logger)) _exit(1);
+            stop_watch_after_fork();
+            stats_after_fork();
+            run_talkers(shared, k, workers);
+            close_logger(logger);
+            _exit(0);
+        }
+        if (pids[k] < 0) perror("fork");
+    }
+    Workers alive = { .pids = pids, .count = workers };
+    stop_watch_add(forward_stop, &alive);
+
+    int rc = 0;
+    for (int k = 0; k < workers; ++k) {
+        if (pids[k] < 0) {
+            // без процесса его болтуны работают в родителе, иначе звонящие им зависнут
+            run_talkers(shared, k, workers);
+            continue;
+        }
+        int status = 0;
+        while (waitpid(pids[k], &status, 0) < 0 && errno == EINTR) {
+        }
+        atomic_store(&alive.reaped, k + 1);
+        if (WIFSIGNALED(status)) {
+            log_message(logger, "Процесс-воркер %d (pid %ld) завершён сигналом %d", k, (long)pids[k],
+                        WTERMSIG(status));
+            rc = 1;
+        } else if (WEXITSTATUS(status) != 0) {
+            rc = 1;
+        }
+    }
+    stop_watch_remove(forward_stop, &alive);
+
+    destroy_talkers(shared);
+    idle_index_report(&shared->idle, logger);
+    idle_index_destroy(&shared->idle);
+    munmap(shared, bytes);
+    return rc;
+}
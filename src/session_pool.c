@@ -0,0 +1,73 @@
+#include "session_pool.h"
+
+#include <stdlib.h>
+
+static void push(SessionPool *pool, uint32_t index) {
+    uint64_t head = atomic_load(&pool->head);
+    uint64_t desired;
+    do {
+        atomic_store_explicit(&pool->sessions[index].next, (uint32_t)head, memory_order_relaxed);
+        desired = ((head >> 32) + 1) << 32 | (uint64_t)(index + 1);
+    } while (!atomic_compare_exchange_weak(&pool->head, &head, desired));
+}
+
+bool session_pool_init(SessionPool *pool, int capacity) {
+    pool->capacity = (uint32_t)capacity;
+    pool->sessions = calloc((size_t)capacity, sizeof(CallSession));
+    if (!pool->sessions) return false;
+    atomic_init(&pool->head, 0);
+    atomic_init(&pool->in_use, 0);
+    atomic_init(&pool->peak, 0);
+    atomic_init(&pool->acquired, 0);
+    atomic_init(&pool->exhausted, 0);
+    for (uint32_t i = pool->capacity; i-- > 0;) {
+        pthread_barrier_init(&pool->sessions[i].rendezvous, NULL, 2);
+        atomic_init(&pool->sessions[i].refs, 0);
+        atomic_init(&pool->sessions[i].next, 0);
+        push(pool, i);
+    }
+    return true;
+}
+
+void session_pool_destroy(SessionPool *pool) {
+    for (uint32_t i = 0; i < pool->capacity; ++i) {
+        pthread_barrier_destroy(&pool->sessions[i].rendezvous);
+    }
+    free(pool->sessions);
+    pool->sessions = NULL;
+}
+
+CallSession *session_acquire(SessionPool *pool) {
+    uint64_t head = atomic_load(&pool->head);
+    while (true) {
+        uint32_t slot = (uint32_t)head;
+        if (!slot) {
+            atomic_fetch_add_explicit(&pool->exhausted, 1, memory_order_relaxed);
+            return NULL;
+        }
+        CallSession *session = &pool->sessions[slot - 1];
+        uint32_t next = atomic_load_explicit(&session->next, memory_order_relaxed);
+        uint64_t desired = ((head >> 32) + 1) << 32 | next;
+        if (atomic_compare_exchange_weak(&pool->head, &head, desired)) {
+            atomic_store(&session->refs, 2);
+            int in_use = atomic_fetch_add(&pool->in_use, 1) + 1;
+            int peak = atomic_load(&pool->peak);
+            while (in_use > peak && !atomic_compare_exchange_weak(&pool->peak, &peak, in_use)) {
+            }
+            atomic_fetch_add_explicit(&pool->acquired, 1, memory_order_relaxed);
+            return session;
+        }
+    }
+}
+
+void session_release(SessionPool *pool, CallSession *session) {
+    if (atomic_fetch_sub(&session->refs, 1) != 1) return;
+    atomic_fetch_sub(&pool->in_use, 1);
+    push(pool, (uint32_t)(session - pool->sessions));
+}
+
+void session_pool_report(const SessionPool *pool, Logger *logger) {
+    log_message(logger, "Пул сеансов: ёмкость %u, выдано %lu, пик занятости %d, сейчас занято %d, нехватка %lu",
+                pool->capacity, atomic_load(&pool->acquired), atomic_load(&pool->peak),
+                atomic_load(&pool->in_use), atomic_load(&pool->exhausted));
+}
@@ -0,0 +1,34 @@
+#ifndef SESSION_POOL_H
+#define SESSION_POOL_H
+
+#include "common.h"
+
+// Заранее выделенные сеансы звонка для режима condition: барьер встречи
+// создаётся один раз, а сеанс берётся и возвращается через стек Трайбера
+// без блокировок, так что установка звонка не выделяет память.
+typedef struct {
+    pthread_barrier_t rendezvous;
+    int caller_id;
+    int callee_id;
+    int duration_ms;
+    _Atomic int refs; // сеанс возвращается в пул, когда обе стороны прошли барьер
+    _Atomic uint32_t next;
+} CallSession;
+
+typedef struct {
+    CallSession *sessions;
+    uint32_t capacity;
+    _Atomic uint64_t head; // (метка << 32) | (индекс + 1), 0 — пусто
+    _Atomic int in_use;
+    _Atomic int peak;
+    _Atomic unsigned long acquired;
+    _Atomic unsigned long exhausted;
+} SessionPool;
+
+bool session_pool_init(SessionPool *pool, int capacity);
+void session_pool_destroy(SessionPool *pool);
+CallSession *session_acquire(SessionPool *pool);
+void session_release(SessionPool *pool, CallSession *session);
+void session_pool_report(const SessionPool *pool, Logger *logger);
+
+#endif // SESSION_POOL_H
@@ -0,0 +1,427 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS, timeradd
+
+#include "common.h"
+#include "histogram.h"
+#include "affinity.h"
+#include "stop.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+// Счётчики и гистограммы ведутся в шардах по потокам: каждый поток пишет
+// только в свой шард без атомарных RMW, а отчёт сливает шарды по запросу.
+typedef struct StatsShard {
+    _Atomic uint64_t dials;
+    _Atomic uint64_t busy_probes;
+    _Atomic uint64_t no_line;
+    _Atomic uint64_t answered;
+    _Atomic uint64_t departures;
+    _Atomic uint64_t talk_us;     // время в разговорах, по каждому собеседнику
+    _Atomic uint64_t cross_shard; // соединений между шардами
+    _Atomic uint64_t call_waits;  // постановок в очередь ожидания вызова
+    _Atomic uint64_t call_waits_served; // дождались линии
+    _Atomic uint64_t index_picks; // выборы по индексу свободных линий
+    _Atomic uint64_t index_misses;
+    _Atomic uint64_t index_no_line;
+    _Atomic uint64_t index_probes_saved;
+    Histogram setup_us; // от «набирает» до «отвечает»
+    Histogram call_us;  // от ответа до «завершил разговор»
+    Histogram idle_us;  // пауза ожидания
+    Histogram setup_local_us; // набор→ответ внутри шарда (при --shards > 1)
+    Histogram setup_cross_us; // набор→ответ между шардами
+    Histogram call_wait_us; // от постановки в очередь до решения
+    Histogram call_wait_depth; // глубина очереди вместе с вставшим
+    struct StatsShard *next;
+} StatsShard;
+
+static _Atomic(StatsShard *) shards;
+static _Thread_local StatsShard *local_shard;
+static _Atomic int64_t *dial_started_us; // момент набора по номеру звонящего
+static _Atomic int64_t *talk_started_us; // начало разговора по номеру болтуна
+static int talker_slots;
+static int shard_count;
+
+// В режимах process и cluster шарды и метки времени лежат в общей анонимной памяти:
+// процессы-воркеры берут из неё слоты, родитель сливает их в отчёте.
+typedef struct {
+    _Atomic size_t used;
+    size_t capacity;
+    StatsShard slots[];
+} SharedShards;
+
+static SharedShards *shared_shards;
+static size_t shared_bytes;
+
+static pthread_t reporter;
+static bool reporter_running;
+static _Atomic bool reporter_stop;
+
+static inline void bump(_Atomic uint64_t *counter) {
+    uint64_t v = atomic_load_explicit(counter, memory_order_relaxed);
+    atomic_store_explicit(counter, v + 1, memory_order_relaxed);
+}
+
+static inline void add(_Atomic uint64_t *counter, uint64_t delta) {
+    uint64_t v = atomic_load_explicit(counter, memory_order_relaxed);
+    atomic_store_explicit(counter, v + delta, memory_order_relaxed);
+}
+
+static StatsShard *shard(void) {
+    if (local_shard) return local_shard;
+    if (shared_shards) {
+        size_t slot = atomic_fetch_add(&shared_shards->used, 1);
+        if (slot < shared_shards->capacity) {
+            local_shard = &shared_shards->slots[slot];
+            return local_shard;
+        }
+    }
+    StatsShard *s = calloc(1, sizeof(StatsShard));
+    if (!s) abort();
+    StatsShard *head = atomic_load(&shards);
+    do {
+        s->next = head;
+    } while (!atomic_compare_exchange_weak(&shards, &head, s));
+    local_shard = s;
+    return s;
+}
+
+static void merge_shard(StatsShard *total, StatsShard *s) {
+    atomic_fetch_add(&total->dials, atomic_load_explicit(&s->dials, memory_order_relaxed));
+    atomic_fetch_add(&total->busy_probes, atomic_load_explicit(&s->busy_probes, memory_order_relaxed));
+    atomic_fetch_add(&total->no_line, atomic_load_explicit(&s->no_line, memory_order_relaxed));
+    atomic_fetch_add(&total->answered, atomic_load_explicit(&s->answered, memory_order_relaxed));
+    atomic_fetch_add(&total->departures, atomic_load_explicit(&s->departures, memory_order_relaxed));
+    atomic_fetch_add(&total->talk_us, atomic_load_explicit(&s->talk_us, memory_order_relaxed));
+    atomic_fetch_add(&total->cross_shard, atomic_load_explicit(&s->cross_shard, memory_order_relaxed));
+    atomic_fetch_add(&total->call_waits, atomic_load_explicit(&s->call_waits, memory_order_relaxed));
+    atomic_fetch_add(&total->call_waits_served, atomic_load_explicit(&s->call_waits_served, memory_order_relaxed));
+    atomic_fetch_add(&total->index_picks, atomic_load_explicit(&s->index_picks, memory_order_relaxed));
+    atomic_fetch_add(&total->index_misses, atomic_load_explicit(&s->index_misses, memory_order_relaxed));
+    atomic_fetch_add(&total->index_no_line, atomic_load_explicit(&s->index_no_line, memory_order_relaxed));
+    atomic_fetch_add(&total->index_probes_saved, atomic_load_explicit(&s->index_probes_saved, memory_order_relaxed));
+    histogram_merge(&total->setup_us, &s->setup_us);
+    histogram_merge(&total->setup_local_us, &s->setup_local_us);
+    histogram_merge(&total->setup_cross_us, &s->setup_cross_us);
+    histogram_merge(&total->call_us, &s->call_us);
+    histogram_merge(&total->call_wait_us, &s->call_wait_us);
+    histogram_merge(&total->call_wait_depth, &s->call_wait_depth);
+    histogram_merge(&total->idle_us, &s->idle_us);
+}
+
+static StatsShard *merge_shards(void) {
+    StatsShard *total = calloc(1, sizeof(StatsShard));
+    if (!total) return NULL;
+    for (StatsShard *s = atomic_load(&shards); s; s = s->next) {
+        merge_shard(total, s);
+    }
+    if (shared_shards) {
+        size_t used = atomic_load(&shared_shards->used);
+        if (used > shared_shards->capacity) used = shared_shards->capacity;
+        for (size_t i = 0; i < used; ++i) {
+            merge_shard(total, &shared_shards->slots[i]);
+        }
+    }
+    return total;
+}
+
+static bool init_shared(const Config *config) {
+    // по шарду на поток болтуна и на главный поток каждого процесса
+    size_t capacity = (size_t)config->talkers + (size_t)config->processes + 1;
+    size_t stamps = (size_t)config->talkers * sizeof(*dial_started_us);
+    shared_bytes = sizeof(SharedShards) + capacity * sizeof(StatsShard) + 2 * stamps;
+    void *mem = mmap(NULL, shared_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) return false;
+    shared_shards = mem;
+    shared_shards->capacity = capacity;
+    char *tail = (char *)&shared_shards->slots[capacity];
+    dial_started_us = (_Atomic int64_t *)tail;
+    talk_started_us = (_Atomic int64_t *)(tail + stamps);
+    return true;
+}
+
+void stats_init(const Config *config) {
+    talker_slots = config->talkers;
+    shard_count = config->shards;
+    bool forked = strcmp(config->mode, MODE_PROCESS) == 0 || strcmp(config->mode, MODE_CLUSTER) == 0;
+    if (!forked || !init_shared(config)) {
+        dial_started_us = calloc((size_t)talker_slots, sizeof(*dial_started_us));
+        talk_started_us = calloc((size_t)talker_slots, sizeof(*talk_started_us));
+    }
+
+    // SIGUSR1 принимает только поток отчёта: блокируем до создания других потоков
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+void stats_shutdown(void) {
+    StatsShard *s = atomic_exchange(&shards, NULL);
+    while (s) {
+        StatsShard *next = s->next;
+        free(s);
+        s = next;
+    }
+    if (shared_shards) {
+        munmap(shared_shards, shared_bytes);
+        shared_shards = NULL;
+    } else {
+        free((void *)dial_started_us);
+        free((void *)talk_started_us);
+    }
+    dial_started_us = talk_started_us = NULL;
+    talker_slots = 0;
+}
+
+// Дочерний процесс унаследовал указатель на шард родителя: берёт свой слот.
+void stats_after_fork(void) {
+    local_shard = NULL;
+}
+
+static bool valid(int talker) {
+    return talker >= 0 && talker < talker_slots;
+}
+
+// Счётчики снимаются с тех же событий, что пишутся в журнал,
+// поэтому одинаково работают во всех режимах.
+void stats_on_event(EventType type, int talker, int peer, int64_t ts_us) {
+    StatsShard *s = shard();
+    switch (type) {
+    case EVT_DIAL:
+        bump(&s->dials);
+        if (valid(talker)) atomic_store_explicit(&dial_started_us[talker], ts_us, memory_order_relaxed);
+        break;
+    case EVT_BUSY:
+        bump(&s->busy_probes);
+        break;
+    case EVT_NO_LINE:
+        bump(&s->no_line);
+        break;
+    case EVT_ANSWER:
+        bump(&s->answered);
+        if (valid(peer)) {
+            int64_t started = atomic_load_explicit(&dial_started_us[peer], memory_order_relaxed);
+            uint64_t setup = ts_us > started ? (uint64_t)(ts_us - started) : 0;
+            histogram_record(&s->setup_us, setup);
+            if (shard_count > 1 && valid(talker)) {
+                bool cross = shard_of(talker, talker_slots, shard_count) != shard_of(peer, talker_slots, shard_count);
+                if (cross) bump(&s->cross_shard);
+                histogram_record(cross ? &s->setup_cross_us : &s->setup_local_us, setup);
+            }
+            atomic_store_explicit(&talk_started_us[peer], ts_us, memory_order_relaxed);
+        }
+        if (valid(talker)) atomic_store_explicit(&talk_started_us[talker], ts_us, memory_order_relaxed);
+        break;
+    case EVT_FINISH:
+        if (valid(talker)) {
+            int64_t started = atomic_load_explicit(&talk_started_us[talker], memory_order_relaxed);
+            uint64_t talked = ts_us > started ? (uint64_t)(ts_us - started) : 0;
+            histogram_record(&s->call_us, talked);
+            add(&s->talk_us, talked);
+        }
+        break;
+    case EVT_LEAVE:
+        bump(&s->departures);
+        break;
+    default:
+        break;
+    }
+}
+
+void stats_on_idle(int64_t us) {
+    histogram_record(&shard()->idle_us, us > 0 ? (uint64_t)us : 0);
+}
+
+void stats_on_call_wait(uint32_t depth, int64_t wait_us, bool served) {
+    StatsShard *s = shard();
+    bump(&s->call_waits);
+    if (served) bump(&s->call_waits_served);
+    histogram_record(&s->call_wait_us, wait_us > 0 ? (uint64_t)wait_us : 0);
+    histogram_record(&s->call_wait_depth, depth);
+}
+
+void stats_on_index_pick(bool found, uint64_t probes_saved) {
+    StatsShard *s = shard();
+    bump(found ? &s->index_picks : &s->index_no_line);
+    add(&s->index_probes_saved, probes_saved);
+}
+
+void stats_on_index_miss(void) {
+    bump(&shard()->index_misses);
+}
+
+IndexStats stats_index_totals(void) {
+    IndexStats totals = { 0 };
+    StatsShard *total = merge_shards();
+    if (!total) return totals;
+    totals.picks = atomic_load(&total->index_picks);
+    totals.misses = atomic_load(&total->index_misses);
+    totals.no_line = atomic_load(&total->index_no_line);
+    totals.probes_saved = atomic_load(&total->index_probes_saved);
+    free(total);
+    return totals;
+}
+
+static void log_histogram(Logger *logger, const char *name, const Histogram *hist) {
+    log_message(logger, "  %s: n=%llu p50=%llu p90=%llu p99=%llu p99.9=%llu max=%llu мкс", name,
+                (unsigned long long)atomic_load(&hist->total),
+                (unsigned long long)histogram_percentile(hist, 50),
+                (unsigned long long)histogram_percentile(hist, 90),
+                (unsigned long long)histogram_percentile(hist, 99),
+                (unsigned long long)histogram_percentile(hist, 99.9),
+                (unsigned long long)atomic_load(&hist->max));
+}
+
+void stats_dump(Logger *logger) {
+    StatsShard *total = merge_shards();
+    if (!total) return;
+    uint64_t dials = atomic_load(&total->dials);
+    uint64_t busy = atomic_load(&total->busy_probes);
+    log_message(logger, "Статистика: наборов %llu, занятых линий %llu (%.1f%%), соединений %llu, ушло %llu",
+                (unsigned long long)dials, (unsigned long long)busy,
+                dials + busy ? 100.0 * (double)busy / (double)(dials + busy) : 0.0,
+                (unsigned long long)atomic_load(&total->answered),
+                (unsigned long long)atomic_load(&total->departures));
+    log_histogram(logger, "набор→ответ", &total->setup_us);
+    log_histogram(logger, "разговор", &total->call_us);
+    log_histogram(logger, "пауза", &total->idle_us);
+    if (atomic_load(&total->call_waits)) log_histogram(logger, "ожидание вызова", &total->call_wait_us);
+    free(total);
+}
+
+static void *reporter_thread(void *arg) {
+    Logger *logger = (Logger *)arg;
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR1);
+    while (true) {
+        int sig;
+        if (sigwait(&set, &sig) != 0) continue;
+        if (atomic_load(&reporter_stop)) break;
+        stats_dump(logger);
+    }
+    return NULL;
+}
+
+void stats_start_reporter(Logger *logger) {
+    atomic_store(&reporter_stop, false);
+    reporter_running = pthread_create(&reporter, NULL, reporter_thread, logger) == 0;
+}
+
+void stats_stop_reporter(void) {
+    if (!reporter_running) return;
+    atomic_store(&reporter_stop, true);
+    pthread_kill(reporter, SIGUSR1);
+    pthread_join(reporter, NULL);
+    reporter_running = false;
+}
+
+static double seconds(struct timeval tv) {
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static void append_csv(const Config *config, const StatsShard *total, double wall_s, const struct rusage *ru) {
+    FILE *f = fopen(config->summary_path, "a+");
+    if (!f) {
+        perror("fopen summary");
+        return;
+    }
+    fseek(f, 0, SEEK_END);
+    if (ftell(f) == 0) {
+        fprintf(f, "mode,talkers,min_idle_ms,max_idle_ms,min_call_ms,max_call_ms,seed,wall_s,"
+                   "calls,calls_per_s,dials,busy_probes,busy_ratio,no_line,departures,"
+                   "setup_p50_us,setup_p90_us,setup_p99_us,setup_max_us,"
+                   "cpu_user_s,cpu_sys_s,vol_ctx_switches,invol_ctx_switches,"
+                   "call_waits,call_waits_served,call_wait_p50_us,call_wait_p99_us,call_wait_depth_max,"
+                   "talk_s,stop_to_exit_ms\n");
+    }
+    unsigned long long calls = atomic_load(&total->answered);
+    unsigned long long dials = atomic_load(&total->dials);
+    unsigned long long busy = atomic_load(&total->busy_probes);
+    fprintf(f, "%s,%d,%d,%d,%d,%d,%llu,%.3f,%llu,%.1f,%llu,%llu,%.4f,%llu,%llu,%llu,%llu,%llu,%llu,%.3f,%.3f,%ld,%ld,%llu,%llu,%llu,%llu,%llu,",
+            config->mode, config->talkers, config->min_idle_ms, config->max_idle_ms,
+            config->min_call_ms, config->max_call_ms, (unsigned long long)config->seed, wall_s,
+            calls, wall_s > 0 ? (double)calls / wall_s : 0.0, dials, busy,
+            dials + busy ? (double)busy / (double)(dials + busy) : 0.0,
+            (unsigned long long)atomic_load(&total->no_line),
+            (unsigned long long)atomic_load(&total->departures),
+            (unsigned long long)histogram_percentile(&total->setup_us, 50),
+            (unsigned long long)histogram_percentile(&total->setup_us, 90),
+            (unsigned long long)histogram_percentile(&total->setup_us, 99),
+            (unsigned long long)atomic_load(&total->setup_us.max),
+            seconds(ru->ru_utime), seconds(ru->ru_stime), ru->ru_nvcsw, ru->ru_nivcsw,
+            (unsigned long long)atomic_load(&total->call_waits),
+            (unsigned long long)atomic_load(&total->call_waits_served),
+            (unsigned long long)histogram_percentile(&total->call_wait_us, 50),
+            (unsigned long long)histogram_percentile(&total->call_wait_us, 99),
+            (unsigned long long)atomic_load(&total->call_wait_depth.max));
+    fprintf(f, "%.3f,", (double)atomic_load(&total->talk_us) / 1e6);
+    // прогон, дошедший до конца сам, оставляет колонку пустой
+    if (stop_latency_ms() >= 0) fprintf(f, "%.1f", stop_latency_ms());
+    fputc('\n', f);
+    fclose(f);
+}
+
+void stats_report(const Config *config, Logger *logger) {
+    double wall_s = (double)elapsed_ms_since(logger) / 1000.0;
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    if (shared_shards) {
+        // процессы-воркеры уже дождались родителем, их время тоже наше
+        struct rusage kids;
+        getrusage(RUSAGE_CHILDREN, &kids);
+        timeradd(&ru.ru_utime, &kids.ru_utime, &ru.ru_utime);
+        timeradd(&ru.ru_stime, &kids.ru_stime, &ru.ru_stime);
+        ru.ru_nvcsw += kids.ru_nvcsw;
+        ru.ru_nivcsw += kids.ru_nivcsw;
+    }
+    StatsShard *total = merge_shards();
+    if (!total) return;
+
+    unsigned long long calls = atomic_load(&total->answered);
+    unsigned long long dials = atomic_load(&total->dials);
+    unsigned long long busy = atomic_load(&total->busy_probes);
+    log_message(logger, "Итоги: звонков %llu (%.1f/с), наборов %llu, занятых линий %llu (%.1f%%)",
+                calls, wall_s > 0 ? (double)calls / wall_s : 0.0, dials, busy,
+                dials + busy ? 100.0 * (double)busy / (double)(dials + busy) : 0.0);
+    log_message(logger, "Установка звонка p50/p90/p99 %llu/%llu/%llu мкс, CPU %.2f+%.2f с, переключений %ld+%ld",
+                (unsigned long long)histogram_percentile(&total->setup_us, 50),
+                (unsigned long long)histogram_percentile(&total->setup_us, 90),
+                (unsigned long long)histogram_percentile(&total->setup_us, 99),
+                seconds(ru.ru_utime), seconds(ru.ru_stime), ru.ru_nvcsw, ru.ru_nivcsw);
+    uint64_t talked = atomic_load(&total->call_us.total);
+    log_message(logger, "Ушло %llu, в разговорах %.1f с (в среднем %.0f мс на собеседника)",
+                (unsigned long long)atomic_load(&total->departures), (double)atomic_load(&total->talk_us) / 1e6,
+                talked ? (double)atomic_load(&total->talk_us) / 1e3 / (double)talked : 0.0);
+    if (shard_count > 1) {
+        unsigned long long cross = atomic_load(&total->cross_shard);
+        log_message(logger, "Шарды: %d, соединений внутри шарда %llu, между шардами %llu (%.1f%%)",
+                    shard_count, calls - cross, cross, calls ? 100.0 * (double)cross / (double)calls : 0.0);
+        log_message(logger, "Установка звонка p50/p99: внутри шарда %llu/%llu мкс, между шардами %llu/%llu мкс",
+                    (unsigned long long)histogram_percentile(&total->setup_local_us, 50),
+                    (unsigned long long)histogram_percentile(&total->setup_local_us, 99),
+                    (unsigned long long)histogram_percentile(&total->setup_cross_us, 50),
+                    (unsigned long long)histogram_percentile(&total->setup_cross_us, 99));
+    }
+
+    unsigned long long waits = atomic_load(&total->call_waits);
+    if (waits) {
+        unsigned long long served = atomic_load(&total->call_waits_served);
+        log_message(logger, "Ожидание вызова: в очередь %llu раз, дождались %llu (%.1f%%), ожидание p50/p99 %llu/%llu мкс, "
+                    "глубина очереди p50/max %llu/%llu",
+                    waits, served, 100.0 * (double)served / (double)waits,
+                    (unsigned long long)histogram_percentile(&total->call_wait_us, 50),
+                    (unsigned long long)histogram_percentile(&total->call_wait_us, 99),
+                    (unsigned long long)histogram_percentile(&total->call_wait_depth, 50),
+                    (unsigned long long)atomic_load(&total->call_wait_depth.max));
+    }
+
+    if (config->summary_path[0]) {
+        append_csv(config, total, wall_s, &ru);
+    }
+    free(total);
+}
@@ -0,0 +1,202 @@
+#include "stop.h"
+#include "futex.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_STOP_HOOKS 16
+
+enum { STOP_NONE, STOP_SIGNAL, STOP_DEADLINE };
+
+static _Atomic uint32_t stop_word;  // 1 — остановка; на нём спят stop_sleep
+static _Atomic uint32_t watch_word; // растёт, чтобы разбудить сторожа
+static _Atomic int stop_cause;
+static struct timespec stop_ts;     // пишется до stop_word, читается после
+static struct timespec deadline_ts;
+static bool has_deadline;
+static _Atomic bool watch_closing;
+static bool watch_running;
+static pthread_t watch_thread;
+static double latency_ms = -1;
+
+static pthread_mutex_t hooks_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct {
+    StopHook fn;
+    void *arg;
+} hooks[MAX_STOP_HOOKS];
+static int hook_count;
+static bool hooks_fired;
+
+// Остаток до at в миллисекундах с округлением вверх, чтобы не проснуться
+// на долю миллисекунды раньше и не крутиться впустую.
+static long ms_until(const struct timespec *at) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long ns = (long long)(at->tv_sec - now.tv_sec) * 1000000000LL + (at->tv_nsec - now.tv_nsec);
+    return ns > 0 ? (long)((ns + 999999) / 1000000) : 0;
+}
+
+static void add_ms(struct timespec *ts, long ms) {
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_nsec -= 1000000000L;
+        ts->tv_sec += 1;
+    }
+}
+
+// Вызывается и из обработчика сигнала: только атомики и системные вызовы.
+// at == NULL — моментом остановки считается текущий.
+static void request_stop(int cause, const struct timespec *at) {
+    int expected = STOP_NONE;
+    if (!atomic_compare_exchange_strong(&stop_cause, &expected, cause)) return;
+    if (at) {
+        stop_ts = *at;
+    } else {
+        clock_gettime(CLOCK_MONOTONIC, &stop_ts);
+    }
+    atomic_store(&stop_word, 1);
+    futex_wake(&stop_word, 0);
+    atomic_fetch_add(&watch_word, 1);
+    futex_wake(&watch_word, 1);
+}
+
+static void on_signal(int signum) {
+    (void)signum;
+    int saved = errno;
+    request_stop(STOP_SIGNAL, NULL);
+    errno = saved;
+}
+
+void watch_stop_signal(void) {
+    signal(SIGINT, on_signal);
+}
+
+bool stop_requested(void) {
+    return atomic_load(&stop_word) != 0;
+}
+
+static void fire_hooks(void) {
+    pthread_mutex_lock(&hooks_lock);
+    hooks_fired = true;
+    for (int i = 0; i < hook_count; ++i) hooks[i].fn(hooks[i].arg);
+    pthread_mutex_unlock(&hooks_lock);
+}
+
+// Сторож спит на watch_word до дедлайна; сигнал и stop_watch_finish
+// будят его раньше. Обработчики вызываются здесь, а не в обработчике
+// сигнала: им нужны мьютексы.
+static void *watch_main(void *arg) {
+    (void)arg;
+    while (!stop_requested() && !atomic_load(&watch_closing)) {
+        uint32_t seen = atomic_load(&watch_word);
+        long wait_ms = -1;
+        if (has_deadline) {
+            wait_ms = ms_until(&deadline_ts);
+            if (wait_ms == 0) {
+                request_stop(STOP_DEADLINE, &deadline_ts);
+                break;
+            }
+        }
+        if (stop_requested() || atomic_load(&watch_closing)) break;
+        futex_wait(&watch_word, seen, wait_ms);
+    }
+    if (stop_requested()) fire_hooks();
+    return NULL;
+}
+
+static void launch_watch(void) {
+    atomic_store(&watch_closing, false);
+    watch_running = pthread_create(&watch_thread, NULL, watch_main, NULL) == 0;
+    if (!watch_running) perror("pthread_create stop watch");
+}
+
+// Дедлайн отсчитывается от начала лога, как и в режимах. В модельном
+// времени (des) и при воспроизведении журнала дедлайна по часам нет: прогон
+// остановит только сигнал.
+void stop_watch_start(const Config *config, const Logger *logger) {
+    has_deadline = config->duration_seconds > 0 && strcmp(config->mode, MODE_DES) != 0 && !config->replay_path[0];
+    if (has_deadline) {
+        deadline_ts = logger->start_ts;
+        add_ms(&deadline_ts, config->duration_seconds * 1000L);
+    }
+    launch_watch();
+}
+
+// В дочернем процессе нет ни сторожа, ни чужих обработчиков, а мьютекс
+// мог остаться занятым потоком родителя.
+void stop_watch_after_fork(void) {
+    pthread_mutex_init(&hooks_lock, NULL);
+    hook_count = 0;
+    hooks_fired = false;
+    launch_watch();
+}
+
+void stop_watch_finish(Logger *logger) {
+    // режим мог заметить дедлайн раньше сторожа
+    if (has_deadline && ms_until(&deadline_ts) == 0) request_stop(STOP_DEADLINE, &deadline_ts);
+    if (stop_requested()) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        latency_ms = (double)(now.tv_sec - stop_ts.tv_sec) * 1e3 + (double)(now.tv_nsec - stop_ts.tv_nsec) / 1e6;
+        if (latency_ms < 0) latency_ms = 0;
+    }
+    if (watch_running) {
+        atomic_store(&watch_closing, true);
+        atomic_fetch_add(&watch_word, 1);
+        futex_wake(&watch_word, 1);
+        pthread_join(watch_thread, NULL);
+        watch_running = false;
+    }
+    if (latency_ms >= 0) {
+        log_message(logger, "Остановка по %s: до выхода %.1f мс",
+                    atomic_load(&stop_cause) == STOP_SIGNAL ? "сигналу" : "тайм-ауту", latency_ms);
+    }
+}
+
+// После остановки обработчик вызывается сразу: режим, начавший ждать
+// позже сторожа, тоже не должен уснуть.
+bool stop_watch_add(StopHook hook, void *arg) {
+    pthread_mutex_lock(&hooks_lock);
+    bool fired = hooks_fired;
+    bool added = !fired && hook_count < MAX_STOP_HOOKS;
+    if (added) {
+        hooks[hook_count].fn = hook;
+        hooks[hook_count].arg = arg;
+        hook_count++;
+    }
+    pthread_mutex_unlock(&hooks_lock);
+    if (fired) hook(arg);
+    return added || fired;
+}
+
+// Обработчики вызываются под hooks_lock, так что после возврата этот
+// уже не выполняется и его аргумент можно освобождать.
+void stop_watch_remove(StopHook hook, void *arg) {
+    pthread_mutex_lock(&hooks_lock);
+    for (int i = 0; i < hook_count; ++i) {
+        if (hooks[i].fn == hook && hooks[i].arg == arg) {
+            hooks[i] = hooks[--hook_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&hooks_lock);
+}
+
+bool stop_sleep(int ms) {
+    struct timespec until;
+    clock_gettime(CLOCK_MONOTONIC, &until);
+    add_ms(&until, ms > 0 ? ms : 0);
+    while (!stop_requested()) {
+        long left = ms_until(&until);
+        if (left == 0) return true;
+        futex_wait(&stop_word, 0, left);
+    }
+    return false;
+}
+
+double stop_latency_ms(void) {
+    return latency_ms;
+}
@@ -0,0 +1,21 @@
+#ifndef STOP_H
+#define STOP_H
+
+#include "common.h"
+
+// Остановка прогона: Ctrl+C или истёкший --duration. Слово остановки —
+// futex, поэтому stop_sleep прерывается сразу. Остальные точки блокировки
+// (семафоры, условные переменные, eventfd) будят обработчики, которые
+// режимы регистрируют на время работы: их вызывает поток-сторож, ждущий
+// сигнала или дедлайна.
+typedef void (*StopHook)(void *arg);
+
+void stop_watch_start(const Config *config, const Logger *logger);
+void stop_watch_after_fork(void);
+void stop_watch_finish(Logger *logger);
+bool stop_watch_add(StopHook hook, void *arg);
+void stop_watch_remove(StopHook hook, void *arg);
+bool stop_sleep(int ms); // false — пауза прервана остановкой
+double stop_latency_ms(void); // от остановки до выхода из режима, <0 — не было
+
+#endif // STOP_H
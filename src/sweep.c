@@ -0,0 +1,366 @@
+#define _DEFAULT_SOURCE // d_type
+
+#include "common.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Прогон набора сценариев: конфиги из каталогов и файлов (--sweep),
+// умноженные на сетку значений ключей (--grid). Каждый сценарий — свой
+// дочерний процесс со своим логгером и статистикой, одновременно идёт
+// не больше --jobs процессов. Итоги сценариев сводятся в одну таблицу.
+#define SWEEP_MAX_AXES 8
+#define SWEEP_MAX_VALUES 32
+#define SWEEP_VALUE_LEN 64
+#define SWEEP_NAME_LEN 160
+
+typedef struct {
+    char key[32];
+    char values[SWEEP_MAX_VALUES][SWEEP_VALUE_LEN];
+    int count;
+} GridAxis;
+
+typedef struct {
+    char (*files)[MAX_PATH_LEN];
+    int file_count;
+    int file_capacity;
+    GridAxis axes[SWEEP_MAX_AXES];
+    int axis_count;
+    int jobs;
+    char out_dir[MAX_PATH_LEN - 32]; // запас под имена NNN.log и sweep.csv
+} Sweep;
+
+typedef struct {
+    char name[SWEEP_NAME_LEN];
+    pid_t pid;
+    char status[16]; // код выхода, "sigN", "invalid", "skipped"
+    struct timespec started;
+    double wall_s;
+} SweepRun;
+
+bool sweep_requested(int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--sweep") == 0 || strcmp(argv[i], "--grid") == 0) return true;
+    }
+    return false;
+}
+
+static bool add_file(Sweep *sweep, const char *path) {
+    if (sweep->file_count == sweep->file_capacity) {
+        int capacity = sweep->file_capacity ? sweep->file_capacity * 2 : 16;
+        void *grown = realloc(sweep->files, (size_t)capacity * sizeof(*sweep->files));
+        if (!grown) return false;
+        sweep->files = grown;
+        sweep->file_capacity = capacity;
+    }
+    snprintf(sweep->files[sweep->file_count++], MAX_PATH_LEN, "%s", path);
+    return true;
+}
+
+static int compare_paths(const void *a, const void *b) {
+    return strcmp((const char *)a, (const char *)b);
+}
+
+// Каталог — все *.conf в нём по имени, иначе сам файл.
+static bool add_source(Sweep *sweep, const char *path) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Нет такого сценария: %s\n", path);
+        return false;
+    }
+    if (!S_ISDIR(st.st_mode)) return add_file(sweep, path);
+
+    DIR *dir = opendir(path);
+    if (!dir) {
+        perror("opendir");
+        return false;
+    }
+    int first = sweep->file_count;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len <= 5 || strcmp(entry->d_name + len - 5, ".conf") != 0) continue;
+        char full[MAX_PATH_LEN];
+        if (snprintf(full, sizeof(full), "%s/%s", path, entry->d_name) >= (int)sizeof(full)) continue;
+        if (!add_file(sweep, full)) {
+            closedir(dir);
+            return false;
+        }
+    }
+    closedir(dir);
+    qsort(sweep->files + first, (size_t)(sweep->file_count - first), sizeof(*sweep->files), compare_paths);
+    return true;
+}
+
+// "talkers=4,16,64" → ось сетки; ключ проверяется на пробном конфиге.
+static bool add_axis(Sweep *sweep, const char *spec) {
+    const char *eq = strchr(spec, '=');
+    if (!eq || eq == spec || sweep->axis_count == SWEEP_MAX_AXES) return false;
+    GridAxis *axis = &sweep->axes[sweep->axis_count];
+    size_t klen = (size_t)(eq - spec);
+    if (klen >= sizeof(axis->key)) return false;
+    memcpy(axis->key, spec, klen);
+    axis->key[klen] = '\0';
+
+    Config probe = { 0 };
+    if (!config_set(&probe, axis->key, "0")) {
+        fprintf(stderr, "Неизвестный ключ сетки: %s\n", axis->key);
+        return false;
+    }
+    axis->count = 0;
+    const char *p = eq + 1;
+    while (*p) {
+        const char *comma = strchr(p, ',');
+        size_t len = comma ? (size_t)(comma - p) : strlen(p);
+        if (len == 0 || len >= SWEEP_VALUE_LEN || axis->count == SWEEP_MAX_VALUES) return false;
+        memcpy(axis->values[axis->count], p, len);
+        axis->values[axis->count][len] = '\0';
+        axis->count++;
+        p += len + (comma ? 1 : 0);
+    }
+    if (axis->count == 0) return false;
+    sweep->axis_count++;
+    return true;
+}
+
+static long scenario_count(const Sweep *sweep) {
+    long count = sweep->file_count > 0 ? sweep->file_count : 1;
+    for (int i = 0; i < sweep->axis_count; ++i) count *= sweep->axes[i].count;
+    return count;
+}
+
+static void append_name(char *name, const char *part) {
+    size_t len = strlen(name);
+    for (const char *p = part; *p && len + 1 < SWEEP_NAME_LEN; ++p) {
+        char c = *p;
+        bool safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+            || c == '.' || c == '=' || c == '-' || c == '_';
+        name[len++] = safe ? c : '-';
+    }
+    name[len] = '\0';
+}
+
+// Сценарий index: файл — внешний цикл, последняя ось сетки — самый
+// внутренний. Как и с --config, файл сценария ложится поверх ключей CLI,
+// а значения сетки — поверх всего.
+static bool build_scenario(const Sweep *sweep, const Config *base, long index, Config *config, char *name) {
+    long grid = scenario_count(sweep) / (sweep->file_count > 0 ? sweep->file_count : 1);
+    long rest = index % grid;
+    *config = *base;
+    name[0] = '\0';
+
+    if (sweep->file_count > 0) {
+        const char *path = sweep->files[index / grid];
+        const char *slash = strrchr(path, '/');
+        char stem[MAX_PATH_LEN];
+        snprintf(stem, sizeof(stem), "%s", slash ? slash + 1 : path);
+        size_t len = strlen(stem);
+        if (len > 5 && strcmp(stem + len - 5, ".conf") == 0) stem[len - 5] = '\0';
+        append_name(name, stem);
+        if (!load_config_file(path, config)) return false;
+    }
+
+    int digits[SWEEP_MAX_AXES];
+    for (int i = sweep->axis_count - 1; i >= 0; --i) {
+        digits[i] = (int)(rest % sweep->axes[i].count);
+        rest /= sweep->axes[i].count;
+    }
+    for (int i = 0; i < sweep->axis_count; ++i) {
+        const GridAxis *axis = &sweep->axes[i];
+        config_set(config, axis->key, axis->values[digits[i]]);
+        if (name[0]) append_name(name, "_");
+        append_name(name, axis->key);
+        append_name(name, "=");
+        append_name(name, axis->values[digits[i]]);
+    }
+    return validate_config(config);
+}
+
+static double since(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) + (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static void run_path(char *out, const Sweep *sweep, long index, const char *suffix) {
+    snprintf(out, MAX_PATH_LEN, "%s/%03ld%s", sweep->out_dir, index + 1, suffix);
+}
+
+// Ребёнок: консольный вывод логгера глушится, иначе прогоны перемешаются.
+static pid_t launch(const Sweep *sweep, Config *config, long index) {
+    run_path(config->output_path, sweep, index,
+             strcmp(config->trace_format, TRACE_FORMAT_BINARY) == 0 ? ".trace" : ".log");
+    run_path(config->summary_path, sweep, index, ".csv");
+    unlink(config->summary_path);
+
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid != 0) return pid;
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) {
+        dup2(null_fd, STDOUT_FILENO);
+        close(null_fd);
+    }
+    _exit(run_scenario(config));
+}
+
+static void record_exit(SweepRun *run, int status) {
+    if (WIFEXITED(status)) {
+        snprintf(run->status, sizeof(run->status), "%d", WEXITSTATUS(status));
+    } else {
+        snprintf(run->status, sizeof(run->status), "sig%d", WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+    }
+    run->wall_s = since(&run->started);
+}
+
+// Сводная таблица: сценарий, статус, время и строка итогов прогона.
+// Итоги каждого ребёнка лежат в NNN.csv (заголовок и одна строка).
+static bool write_table(const Sweep *sweep, const SweepRun *runs, long count, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) {
+        perror("fopen sweep");
+        return false;
+    }
+    bool header_written = false;
+    int columns = 0;
+    char header[1024];
+    char row[1024];
+    for (long i = 0; i < count; ++i) {
+        char csv[MAX_PATH_LEN];
+        run_path(csv, sweep, i, ".csv");
+        FILE *in = fopen(csv, "r");
+        bool have_row = in && fgets(header, sizeof(header), in) && fgets(row, sizeof(row), in);
+        if (in) fclose(in);
+        if (have_row && !header_written) {
+            header[strcspn(header, "\n")] = '\0';
+            fprintf(out, "scenario,status,run_s,%s\n", header);
+            header_written = true;
+            for (const char *p = header; *p; ++p) columns += *p == ',';
+        }
+        if (!have_row) row[0] = '\0';
+        row[strcspn(row, "\n")] = '\0';
+        fprintf(out, "%s,%s,%.2f,%s", runs[i].name, runs[i].status, runs[i].wall_s, row);
+        // у несостоявшихся прогонов столбцы итогов пустые
+        if (!have_row) {
+            for (int c = 0; c < columns; ++c) fputc(',', out);
+        }
+        fputc('\n', out);
+    }
+    fclose(out);
+    if (!header_written) fprintf(stderr, "sweep: ни один прогон не записал итогов\n");
+    return true;
+}
+
+int run_sweep(int argc, char **argv) {
+    Sweep sweep = { .jobs = (int)sysconf(_SC_NPROCESSORS_ONLN) };
+    snprintf(sweep.out_dir, sizeof(sweep.out_dir), "outputs/sweep");
+
+    // свои ключи забираем, остальные задают базовый конфиг
+    char **rest = calloc((size_t)argc + 1, sizeof(char *));
+    if (!rest) return 1;
+    int rest_count = 0;
+    rest[rest_count++] = argv[0];
+    bool ok = true;
+    for (int i = 1; i < argc && ok; ++i) {
+        if (strcmp(argv[i], "--sweep") == 0 && i + 1 < argc) {
+            ok = add_source(&sweep, argv[++i]);
+        } else if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+            ok = add_axis(&sweep, argv[++i]);
+            if (!ok) fprintf(stderr, "Некорректная сетка: ожидается key=v1,v2,...\n");
+        } else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) {
+            sweep.jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--sweep-out") == 0 && i + 1 < argc) {
+            snprintf(sweep.out_dir, sizeof(sweep.out_dir), "%s", argv[++i]);
+        } else {
+            rest[rest_count++] = argv[i];
+        }
+    }
+    Config base;
+    if (ok) ok = parse_args(rest_count, rest, &base);
+    free(rest);
+    if (ok && sweep.jobs < 1) sweep.jobs = 1;
+    if (ok && mkdir(sweep.out_dir, 0755) != 0 && errno != EEXIST) {
+        perror("mkdir sweep");
+        ok = false;
+    }
+    long count = ok ? scenario_count(&sweep) : 0;
+    SweepRun *runs = count > 0 ? calloc((size_t)count, sizeof(SweepRun)) : NULL;
+    if (!runs) {
+        free(sweep.files);
+        return 1;
+    }
+
+    watch_stop_signal();
+    struct timespec sweep_start;
+    clock_gettime(CLOCK_MONOTONIC, &sweep_start);
+    fprintf(stderr, "sweep: сценариев %ld, параллельно до %d, результаты в %s\n", count, sweep.jobs, sweep.out_dir);
+
+    long next = 0;
+    long finished = 0;
+    int running = 0;
+    int failed = 0;
+    while (finished < count) {
+        while (running < sweep.jobs && next < count && !stop_requested()) {
+            long index = next++;
+            SweepRun *run = &runs[index];
+            Config config;
+            clock_gettime(CLOCK_MONOTONIC, &run->started);
+            if (!build_scenario(&sweep, &base, index, &config, run->name)) {
+                snprintf(run->status, sizeof(run->status), "invalid");
+                fprintf(stderr, "sweep: [%ld/%ld] %s — некорректный сценарий\n", ++finished, count, run->name);
+                failed++;
+                continue;
+            }
+            run->pid = launch(&sweep, &config, index);
+            if (run->pid < 0) {
+                perror("fork");
+                snprintf(run->status, sizeof(run->status), "skipped");
+                finished++;
+                failed++;
+                continue;
+            }
+            running++;
+        }
+        if (running == 0) break;
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (long i = 0; i < next; ++i) {
+            if (runs[i].pid != pid) continue;
+            record_exit(&runs[i], status);
+            runs[i].pid = 0;
+            running--;
+            finished++;
+            if (strcmp(runs[i].status, "0") != 0) failed++;
+            fprintf(stderr, "sweep: [%ld/%ld] %s — код %s, %.2f с\n",
+                    finished, count, runs[i].name, runs[i].status, runs[i].wall_s);
+            break;
+        }
+    }
+    for (long i = next; i < count; ++i) {
+        Config config;
+        build_scenario(&sweep, &base, i, &config, runs[i].name);
+        snprintf(runs[i].status, sizeof(runs[i].status), "skipped");
+    }
+
+    char table[MAX_PATH_LEN];
+    snprintf(table, sizeof(table), "%s/sweep.csv", sweep.out_dir);
+    bool written = write_table(&sweep, runs, count, table);
+    fprintf(stderr, "sweep: выполнено %ld из %ld за %.2f с, неудачных и пропущенных %d, таблица %s\n",
+            finished - failed, count, since(&sweep_start), failed + (int)(count - next), table);
+
+    free(runs);
+    free(sweep.files);
+    return written && failed == 0 && next == count ? 0 : 1;
+}
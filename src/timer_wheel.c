@@ -0,0 +1,217 @@
+#include "timer_wheel.h"
+#include "stop.h"
+
+#include <string.h>
+
+#define WHEEL_MASK (WHEEL_SLOTS - 1)
+#define WHEEL_SPAN (1ull << (WHEEL_BITS * WHEEL_LEVELS))
+#define WHEEL_MAX_SLEEP_MS 100 // чтобы now_ms не отставало, когда таймеров нет
+
+static uint64_t clock_tick(const TimerWheel *wheel) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long ms = (now.tv_sec - wheel->start_ts.tv_sec) * 1000
+        + (now.tv_nsec - wheel->start_ts.tv_nsec) / 1000000;
+    return ms > 0 ? (uint64_t)ms : 0;
+}
+
+// Уровень выбирается по расстоянию от base: на уровне L лежат таймеры,
+// до которых меньше 64^(L+1) тиков. Слишком дальние кладутся в последний
+// слот верхнего уровня и перекладываются, когда до него дойдёт каскад.
+static void place(TimerWheel *wheel, TimerEntry *entry, uint64_t base) {
+    uint64_t expires = entry->expires;
+    if (expires - base >= WHEEL_SPAN) expires = base + WHEEL_SPAN - 1;
+    uint64_t delta = expires - base;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 && delta >= 1ull << (WHEEL_BITS * (level + 1))) level++;
+    unsigned slot = (unsigned)(expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    entry->next = wheel->slots[level][slot];
+    wheel->slots[level][slot] = entry;
+    wheel->occupied[level] |= 1ull << slot;
+}
+
+static TimerEntry *take_slot(TimerWheel *wheel, int level, unsigned slot) {
+    TimerEntry *list = wheel->slots[level][slot];
+    wheel->slots[level][slot] = NULL;
+    wheel->occupied[level] &= ~(1ull << slot);
+    return list;
+}
+
+static void cascade(TimerWheel *wheel, int level, uint64_t tick) {
+    unsigned slot = (unsigned)(tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    TimerEntry *list = take_slot(wheel, level, slot);
+    while (list) {
+        TimerEntry *next = list->next;
+        place(wheel, list, tick);
+        wheel->cascaded++;
+        list = next;
+    }
+}
+
+// Продвигает колесо до target и возвращает список сработавших таймеров.
+static TimerEntry *advance(TimerWheel *wheel, uint64_t target) {
+    TimerEntry *due = NULL;
+    while (wheel->tick < target) {
+        uint64_t tick = wheel->tick + 1;
+        for (int level = 1; level < WHEEL_LEVELS; ++level) {
+            if (tick & ((1ull << (WHEEL_BITS * level)) - 1)) break;
+            cascade(wheel, level, tick);
+        }
+        wheel->tick = tick;
+        TimerEntry *list = take_slot(wheel, 0, (unsigned)tick & WHEEL_MASK);
+        while (list) {
+            TimerEntry *next = list->next;
+            list->next = due;
+            due = list;
+            wheel->fired++;
+            list = next;
+        }
+    }
+    atomic_store_explicit(&wheel->now_ms, (long)wheel->tick, memory_order_relaxed);
+    return due;
+}
+
+// Нижний уровень держит таймеры ближе 64 тиков, поэтому ближайший из них
+// находится поворотом битовой маски. Если он пуст, а выше что-то есть,
+// просыпаемся к следующему каскаду.
+static uint64_t next_expiry(const TimerWheel *wheel, uint64_t limit) {
+    uint64_t tick = wheel->tick;
+    uint64_t bits = wheel->occupied[0];
+    if (bits) {
+        unsigned from = (unsigned)(tick + 1) & WHEEL_MASK;
+        uint64_t rotated = from ? (bits >> from) | (bits << (WHEEL_SLOTS - from)) : bits;
+        uint64_t at = tick + 1 + (uint64_t)__builtin_ctzll(rotated);
+        return at < limit ? at : limit;
+    }
+    for (int level = 1; level < WHEEL_LEVELS; ++level) {
+        if (wheel->occupied[level]) {
+            uint64_t at = (tick | WHEEL_MASK) + 1;
+            return at < limit ? at : limit;
+        }
+    }
+    return limit;
+}
+
+static void fire_all(TimerEntry *list) {
+    while (list) {
+        // после fire владелец может освободить запись
+        TimerEntry *next = list->next;
+        list->fire(list->arg);
+        list = next;
+    }
+}
+
+static void *wheel_thread(void *arg) {
+    TimerWheel *wheel = (TimerWheel *)arg;
+    pthread_mutex_lock(&wheel->lock);
+    while (!wheel->stop) {
+        uint64_t now = clock_tick(wheel);
+        TimerEntry *due = advance(wheel, now);
+        if (due) {
+            pthread_mutex_unlock(&wheel->lock);
+            fire_all(due);
+            pthread_mutex_lock(&wheel->lock);
+            continue;
+        }
+
+        wheel->sleep_until = next_expiry(wheel, now + WHEEL_MAX_SLEEP_MS);
+        struct timespec ts = wheel->start_ts;
+        ts.tv_sec += (time_t)(wheel->sleep_until / 1000);
+        ts.tv_nsec += (long)(wheel->sleep_until % 1000) * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) { ts.tv_nsec -= 1000000000L; ts.tv_sec += 1; }
+        pthread_cond_timedwait(&wheel->kick, &wheel->lock, &ts);
+        wheel->wakeups++;
+    }
+    pthread_mutex_unlock(&wheel->lock);
+    return NULL;
+}
+
+static TimerEntry *take_all(TimerWheel *wheel) {
+    TimerEntry *due = NULL;
+    for (int level = 0; level < WHEEL_LEVELS; ++level) {
+        for (unsigned slot = 0; slot < WHEEL_SLOTS; ++slot) {
+            TimerEntry *list = take_slot(wheel, level, slot);
+            while (list) {
+                TimerEntry *next = list->next;
+                list->next = due;
+                due = list;
+                list = next;
+            }
+        }
+    }
+    return due;
+}
+
+// Обработчик остановки: спящие просыпаются сейчас, а не по своему
+// таймеру, и новые паузы тоже не ждут.
+static void drain_on_stop(void *arg) {
+    TimerWheel *wheel = (TimerWheel *)arg;
+    pthread_mutex_lock(&wheel->lock);
+    wheel->draining = true;
+    TimerEntry *due = take_all(wheel);
+    pthread_mutex_unlock(&wheel->lock);
+    fire_all(due);
+}
+
+bool timer_wheel_start(TimerWheel *wheel, const struct timespec *start_ts) {
+    memset(wheel, 0, sizeof(*wheel));
+    wheel->start_ts = *start_ts;
+    wheel->tick = clock_tick(wheel);
+    atomic_init(&wheel->now_ms, (long)wheel->tick);
+    pthread_mutex_init(&wheel->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wheel->kick, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&wheel->thread, NULL, wheel_thread, wheel) != 0) {
+        pthread_cond_destroy(&wheel->kick);
+        pthread_mutex_destroy(&wheel->lock);
+        return false;
+    }
+    stop_watch_add(drain_on_stop, wheel);
+    return true;
+}
+
+// Оставшиеся таймеры срабатывают сразу, чтобы никто не остался спать.
+void timer_wheel_stop(TimerWheel *wheel) {
+    stop_watch_remove(drain_on_stop, wheel);
+    pthread_mutex_lock(&wheel->lock);
+    wheel->stop = true;
+    pthread_cond_signal(&wheel->kick);
+    pthread_mutex_unlock(&wheel->lock);
+    pthread_join(wheel->thread, NULL);
+
+    fire_all(take_all(wheel));
+    pthread_cond_destroy(&wheel->kick);
+    pthread_mutex_destroy(&wheel->lock);
+}
+
+void timer_wheel_add(TimerWheel *wheel, TimerEntry *entry, int delay_ms) {
+    uint64_t expires = clock_tick(wheel) + (uint64_t)(delay_ms > 0 ? delay_ms : 0);
+    pthread_mutex_lock(&wheel->lock);
+    if (wheel->draining) {
+        pthread_mutex_unlock(&wheel->lock);
+        entry->fire(entry->arg);
+        return;
+    }
+    if (expires <= wheel->tick) expires = wheel->tick + 1;
+    entry->expires = expires;
+    place(wheel, entry, wheel->tick);
+    wheel->added++;
+    // будим поток колеса, только если он спит дольше нужного
+    if (expires < wheel->sleep_until) {
+        wheel->sleep_until = expires;
+        pthread_cond_signal(&wheel->kick);
+    }
+    pthread_mutex_unlock(&wheel->lock);
+}
+
+long timer_wheel_now(const TimerWheel *wheel) {
+    return atomic_load_explicit(&wheel->now_ms, memory_order_relaxed);
+}
+
+void timer_wheel_report(const TimerWheel *wheel, Logger *logger) {
+    log_message(logger, "Колесо таймеров: таймеров %lu, сработало %lu, каскадов %lu, пробуждений потока %lu",
+                wheel->added, wheel->fired, wheel->cascaded, wheel->wakeups);
+}
@@ -0,0 +1,45 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include "common.h"
+
+// Иерархическое колесо таймеров с шагом 1 мс: 4 уровня по 64 слота
+// покрывают ~4,6 часа, дальние таймеры перекладываются при каскаде.
+// Вставка и срабатывание — O(1); один поток колеса спит до ближайшего
+// непустого слота и будит владельцев сработавших таймеров.
+#define WHEEL_LEVELS 4
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+
+typedef struct TimerEntry {
+    struct TimerEntry *next;
+    uint64_t expires; // тик (мс от начала лога)
+    void (*fire)(void *arg); // вызывается без блокировки колеса
+    void *arg;
+} TimerEntry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t kick;
+    pthread_t thread;
+    struct timespec start_ts;
+    uint64_t tick; // последний обработанный тик
+    uint64_t sleep_until; // до какого тика спит поток колеса
+    _Atomic long now_ms; // tick для читателей без блокировки
+    TimerEntry *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+    uint64_t occupied[WHEEL_LEVELS]; // непустые слоты уровня
+    bool stop;
+    bool draining; // после остановки прогона таймеры срабатывают сразу
+    unsigned long added;
+    unsigned long fired;
+    unsigned long cascaded;
+    unsigned long wakeups;
+} TimerWheel;
+
+bool timer_wheel_start(TimerWheel *wheel, const struct timespec *start_ts);
+void timer_wheel_stop(TimerWheel *wheel);
+void timer_wheel_add(TimerWheel *wheel, TimerEntry *entry, int delay_ms);
+long timer_wheel_now(const TimerWheel *wheel);
+void timer_wheel_report(const TimerWheel *wheel, Logger *logger);
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,53 @@
+#include "trace.h"
+
+#include <stdio.h>
+
+static const char *const names[EVT_COUNT] = {
+    [EVT_TEXT] = "text",
+    [EVT_START] = "start",
+    [EVT_CONNECT] = "connect",
+    [EVT_DIAL] = "dial",
+    [EVT_BUSY] = "busy",
+    [EVT_ANSWER] = "answer",
+    [EVT_TALK] = "talk",
+    [EVT_FINISH] = "finish",
+    [EVT_LEAVE] = "leave",
+    [EVT_LAST] = "last",
+    [EVT_END] = "end",
+    [EVT_NO_LINE] = "no_line",
+};
+
+const char *event_name(EventType type) {
+    if ((unsigned)type >= EVT_COUNT) return "unknown";
+    return names[type];
+}
+
+int format_event(char *buf, size_t size, const TraceRecord *rec, const char *mode) {
+    switch ((EventType)rec->type) {
+    case EVT_START:
+        return snprintf(buf, size, "Старт симуляции, режим: %s", mode ? mode : "?");
+    case EVT_CONNECT:
+        return snprintf(buf, size, "Болтун %d подключился", rec->talker);
+    case EVT_DIAL:
+        return snprintf(buf, size, "Болтун %d набирает %d", rec->talker, rec->peer);
+    case EVT_BUSY:
+        return snprintf(buf, size, "Линия %d занята для %d", rec->peer, rec->talker);
+    case EVT_ANSWER:
+        return snprintf(buf, size, "Болтун %d отвечает на звонок %d", rec->talker, rec->peer);
+    case EVT_TALK:
+        return snprintf(buf, size, "Разговор %d ↔ %d (%d мс)", rec->talker, rec->peer, rec->duration_ms);
+    case EVT_FINISH:
+        return snprintf(buf, size, "Болтун %d завершил разговор с %d (%d мс)",
+                        rec->talker, rec->peer, rec->duration_ms);
+    case EVT_LEAVE:
+        return snprintf(buf, size, "Болтун %d отключился (осталось %d)", rec->talker, rec->peer);
+    case EVT_LAST:
+        return snprintf(buf, size, "Последний болтун завершил работу");
+    case EVT_END:
+        return snprintf(buf, size, "Завершение симуляции, код %d", rec->peer);
+    case EVT_NO_LINE:
+        return snprintf(buf, size, "Нет свободных линий для %d", rec->talker);
+    default:
+        return snprintf(buf, size, "Неизвестное событие %u", (unsigned)rec->type);
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TRACE_FORMAT_TEXT "text"
+#define TRACE_FORMAT_BINARY "binary"
+
+#define TRACE_MAGIC "TLKTRACE"
+#define TRACE_VERSION 1
+
+// Типы событий журнала. Поля talker/peer/duration_ms трактуются по типу:
+//   EVT_BUSY   — talker звонил, peer — занятая линия;
+//   EVT_TALK   — talker звонящий, peer отвечающий;
+//   EVT_LEAVE  — peer хранит число оставшихся болтунов;
+//   EVT_END    — peer хранит код завершения.
+typedef enum {
+    EVT_TEXT = 0, // произвольное сообщение, в двоичный журнал не пишется
+    EVT_START,
+    EVT_CONNECT,
+    EVT_DIAL,
+    EVT_BUSY,
+    EVT_ANSWER,
+    EVT_TALK,
+    EVT_FINISH,
+    EVT_LEAVE,
+    EVT_LAST,
+    EVT_END,
+    EVT_NO_LINE,
+    EVT_COUNT
+} EventType;
+
+// Запись фиксированного размера: файл журнала — заголовок и массив записей,
+// его можно отобразить в память и читать без разбора.
+typedef struct {
+    int64_t ts_ms;
+    uint16_t type;
+    uint16_t reserved;
+    int32_t talker;
+    int32_t peer;
+    int32_t duration_ms;
+} TraceRecord;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    int64_t start_unix_ms;
+    char mode[16];
+} TraceHeader;
+
+_Static_assert(sizeof(TraceRecord) == 24, "TraceRecord layout");
+_Static_assert(sizeof(TraceHeader) == 40, "TraceHeader layout");
+
+const char *event_name(EventType type);
+int format_event(char *buf, size_t size, const TraceRecord *rec, const char *mode);
+
+#endif // TRACE_H
@@ -0,0 +1,94 @@
+#define _XOPEN_SOURCE 700
+
+#include "../src/trace.h"
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Перевод двоичного журнала talkers в текст лога или CSV.
+static void usage(const char *prog) {
+    printf("Usage: %s <trace> [--format text|csv]\n", prog);
+    printf("  --format text   строки в формате лога talkers (по умолчанию)\n");
+    printf("  --format csv    ts_ms,event,talker,peer,duration_ms\n");
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    bool csv = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            const char *format = argv[++i];
+            csv = strcmp(format, "csv") == 0;
+            if (!csv && strcmp(format, "text") != 0) {
+                fprintf(stderr, "Неизвестный формат: %s\n", format);
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--help") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open trace");
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TraceHeader)) {
+        fprintf(stderr, "Файл слишком мал для журнала\n");
+        close(fd);
+        return 1;
+    }
+
+    size_t size = (size_t)st.st_size;
+    const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        perror("mmap trace");
+        return 1;
+    }
+
+    const TraceHeader *header = (const TraceHeader *)data;
+    if (memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) != 0
+        || header->version != TRACE_VERSION || header->record_size != sizeof(TraceRecord)) {
+        fprintf(stderr, "Неизвестный формат журнала\n");
+        munmap((void *)data, size);
+        return 1;
+    }
+
+    char mode[sizeof(header->mode) + 1];
+    memcpy(mode, header->mode, sizeof(header->mode));
+    mode[sizeof(header->mode)] = '\0';
+
+    const TraceRecord *records = (const TraceRecord *)(data + sizeof(TraceHeader));
+    size_t count = (size - sizeof(TraceHeader)) / sizeof(TraceRecord);
+    char line[256];
+
+    if (csv) printf("ts_ms,event,talker,peer,duration_ms\n");
+    for (size_t i = 0; i < count; ++i) {
+        const TraceRecord *rec = &records[i];
+        if (csv) {
+            printf("%lld,%s,%d,%d,%d\n", (long long)rec->ts_ms, event_name((EventType)rec->type),
+                   rec->talker, rec->peer, rec->duration_ms);
+        } else {
+            format_event(line, sizeof(line), rec, mode);
+            printf("[%6lld ms] %s\n", (long long)rec->ts_ms, line);
+        }
+    }
+
+    munmap((void *)data, size);
+    return 0;
+}
@@ -0,0 +1,496 @@
+#define _DEFAULT_SOURCE // madvise
+
+#include "../src/histogram.h"
+#include "../src/trace.h"
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Однопроходный разбор лога talkers (текст или двоичный журнал): итоги
+// прогона и проверка инвариантов. Файл отображается в память и читается
+// подряд; прочитанные окна отпускаются, поэтому память ограничена
+// состоянием болтунов и гистограммами, а не размером лога.
+#define WINDOW_BYTES ((size_t)64 << 20)
+#define MAX_TALKER_ID (1 << 26)
+
+typedef enum {
+    VIOL_TWO_CALLS,
+    VIOL_DUP_TALK,
+    VIOL_ANSWER_NO_DIAL,
+    VIOL_TALK_NO_ANSWER,
+    VIOL_FINISH_NO_CALL,
+    VIOL_DIAL_IN_CALL,
+    VIOL_LEAVE_IN_CALL,
+    VIOL_COUNT
+} Violation;
+
+static const char *const violation_names[VIOL_COUNT] = {
+    [VIOL_TWO_CALLS] = "два разговора сразу",
+    [VIOL_DUP_TALK] = "лишняя строка «Разговор»",
+    [VIOL_ANSWER_NO_DIAL] = "ответ без набора",
+    [VIOL_TALK_NO_ANSWER] = "разговор без ответа",
+    [VIOL_FINISH_NO_CALL] = "завершение чужого разговора",
+    [VIOL_DIAL_IN_CALL] = "набор посреди разговора",
+    [VIOL_LEAVE_IN_CALL] = "уход посреди разговора",
+};
+
+typedef struct {
+    int64_t dial_ts;
+    int32_t dialing;    // кому звонит, -1 — никому
+    int32_t peer;       // собеседник, -1 — не разговаривает
+    uint32_t talk_lines; // строк «Разговор» текущего разговора (у звонящего)
+    uint32_t conversations;
+} TalkerState;
+
+typedef struct {
+    TalkerState *talkers;
+    int capacity;
+    int count;
+    bool check;
+    char mode[sizeof(((TraceHeader *)0)->mode) + 1];
+    unsigned long long events;
+    unsigned long long dials;
+    unsigned long long busy;
+    unsigned long long no_line;
+    unsigned long long answered;
+    unsigned long long finished;
+    unsigned long long departures;
+    unsigned long long skipped;
+    unsigned long long malformed;
+    int64_t first_ts;
+    int64_t last_ts;
+    Histogram setup_ms;
+    Histogram duration_ms;
+    unsigned long long violations[VIOL_COUNT];
+    unsigned long long reported;
+    unsigned long long max_report;
+} Analyzer;
+
+// Отображение файла; позади курсора окна по WINDOW_BYTES возвращаются ядру.
+typedef struct {
+    const char *data;
+    size_t size;
+    size_t released;
+} Mapping;
+
+static void release_behind(Mapping *map, size_t pos) {
+    if (pos - map->released < WINDOW_BYTES) return;
+    size_t upto = pos & ~(WINDOW_BYTES - 1);
+    madvise((void *)(map->data + map->released), upto - map->released, MADV_DONTNEED);
+    map->released = upto;
+}
+
+static TalkerState *talker(Analyzer *a, int32_t id) {
+    if (id < 0 || id >= MAX_TALKER_ID) return NULL;
+    if (id >= a->capacity) {
+        int capacity = a->capacity ? a->capacity : 1024;
+        while (capacity <= id) capacity *= 2;
+        TalkerState *grown = realloc(a->talkers, (size_t)capacity * sizeof(TalkerState));
+        if (!grown) {
+            perror("realloc");
+            exit(1);
+        }
+        for (int i = a->capacity; i < capacity; ++i) {
+            grown[i] = (TalkerState){ .dialing = -1, .peer = -1 };
+        }
+        a->talkers = grown;
+        a->capacity = capacity;
+    }
+    if (id >= a->count) a->count = id + 1;
+    return &a->talkers[id];
+}
+
+static void violate(Analyzer *a, Violation kind, int64_t ts, const char *fmt, ...) {
+    a->violations[kind]++;
+    if (a->reported++ >= a->max_report) return;
+    printf("[%6lld ms] Нарушение (%s): ", (long long)ts, violation_names[kind]);
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    putchar('\n');
+}
+
+// Лог пишут несколько процессов: строки разных процессов не упорядочены.
+static bool multi_process(const char *mode) {
+    return strcmp(mode, "process") == 0 || strcmp(mode, "cluster") == 0;
+}
+
+static void on_event(Analyzer *a, const TraceRecord *rec) {
+    if (a->events++ == 0) {
+        a->first_ts = rec->ts_ms;
+        // в однопроцессном логе старт всегда первый; иначе строки процессов
+        // перемешаны (в process родитель сбрасывает буфер позже воркеров)
+        if (rec->type != EVT_START) a->check = false;
+    }
+    if (rec->ts_ms > a->last_ts) a->last_ts = rec->ts_ms;
+
+    int64_t ts = rec->ts_ms;
+    switch ((EventType)rec->type) {
+    case EVT_START:
+        // между процессами порядок записей в логе не причинный
+        if (multi_process(a->mode)) a->check = false;
+        break;
+    case EVT_CONNECT:
+        if (!talker(a, rec->talker)) a->malformed++;
+        break;
+    case EVT_DIAL: {
+        TalkerState *caller = talker(a, rec->talker);
+        if (!caller || !talker(a, rec->peer)) {
+            a->malformed++;
+            break;
+        }
+        a->dials++;
+        if (a->check && caller->peer >= 0) {
+            violate(a, VIOL_DIAL_IN_CALL, ts, "болтун %d набирает %d, разговаривая с %d",
+                    rec->talker, rec->peer, caller->peer);
+        }
+        caller->dialing = rec->peer;
+        caller->dial_ts = ts;
+        break;
+    }
+    case EVT_BUSY:
+        a->busy++;
+        break;
+    case EVT_NO_LINE:
+        a->no_line++;
+        break;
+    case EVT_ANSWER: {
+        TalkerState *callee = talker(a, rec->talker);
+        TalkerState *caller = talker(a, rec->peer);
+        if (!callee || !caller) {
+            a->malformed++;
+            break;
+        }
+        a->answered++;
+        if (caller->dialing == rec->talker) {
+            histogram_record(&a->setup_ms, (uint64_t)(ts > caller->dial_ts ? ts - caller->dial_ts : 0));
+        } else if (a->check) {
+            violate(a, VIOL_ANSWER_NO_DIAL, ts, "болтун %d отвечает %d, который его не набирал",
+                    rec->talker, rec->peer);
+        }
+        if (a->check && callee->peer >= 0) {
+            violate(a, VIOL_TWO_CALLS, ts, "болтун %d отвечает %d, разговаривая с %d",
+                    rec->talker, rec->peer, callee->peer);
+        }
+        if (a->check && caller->peer >= 0) {
+            violate(a, VIOL_TWO_CALLS, ts, "болтуну %d ответил %d, а он разговаривает с %d",
+                    rec->peer, rec->talker, caller->peer);
+        }
+        caller->dialing = -1;
+        caller->peer = rec->talker;
+        caller->talk_lines = 0;
+        callee->peer = rec->peer;
+        break;
+    }
+    case EVT_TALK: {
+        // каждую сторону разговора пишет свой поток: строк ровно две
+        TalkerState *caller = talker(a, rec->talker);
+        if (!caller || !talker(a, rec->peer)) {
+            a->malformed++;
+            break;
+        }
+        if (caller->peer != rec->peer) {
+            if (a->check) {
+                violate(a, VIOL_TALK_NO_ANSWER, ts, "разговор %d ↔ %d без ответа", rec->talker, rec->peer);
+            }
+        } else if (++caller->talk_lines == 1) {
+            histogram_record(&a->duration_ms, (uint64_t)(rec->duration_ms > 0 ? rec->duration_ms : 0));
+        } else if (caller->talk_lines > 2 && a->check) {
+            violate(a, VIOL_DUP_TALK, ts, "разговор %d ↔ %d записан %u раз",
+                    rec->talker, rec->peer, caller->talk_lines);
+        }
+        break;
+    }
+    case EVT_FINISH: {
+        TalkerState *self = talker(a, rec->talker);
+        if (!self) {
+            a->malformed++;
+            break;
+        }
+        a->finished++;
+        self->conversations++;
+        if (a->check && self->peer != rec->peer) {
+            violate(a, VIOL_FINISH_NO_CALL, ts, "болтун %d завершил разговор с %d, а разговаривал с %d",
+                    rec->talker, rec->peer, self->peer);
+        }
+        self->peer = -1;
+        break;
+    }
+    case EVT_LEAVE: {
+        TalkerState *self = talker(a, rec->talker);
+        if (!self) {
+            a->malformed++;
+            break;
+        }
+        a->departures++;
+        if (a->check && self->peer >= 0) {
+            violate(a, VIOL_LEAVE_IN_CALL, ts, "болтун %d отключился, разговаривая с %d",
+                    rec->talker, self->peer);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+static bool eat(const char **p, const char *end, const char *literal) {
+    size_t n = strlen(literal);
+    if ((size_t)(end - *p) < n || memcmp(*p, literal, n) != 0) return false;
+    *p += n;
+    return true;
+}
+
+static bool eat_int(const char **p, const char *end, int64_t *out) {
+    const char *s = *p;
+    bool negative = s < end && *s == '-';
+    if (negative) ++s;
+    if (s >= end || *s < '0' || *s > '9') return false;
+    int64_t v = 0;
+    while (s < end && *s >= '0' && *s <= '9') v = v * 10 + (*s++ - '0');
+    *out = negative ? -v : v;
+    *p = s;
+    return true;
+}
+
+static bool eat_int32(const char **p, const char *end, int32_t *out) {
+    int64_t v;
+    if (!eat_int(p, end, &v) || v < INT32_MIN || v > INT32_MAX) return false;
+    *out = (int32_t)v;
+    return true;
+}
+
+// Обратное к format_event: строка "[  ts ms] сообщение" → запись журнала.
+// Служебные строки (итоги, счётчики) событиями не считаются.
+static bool parse_line(Analyzer *a, const char *p, const char *end, TraceRecord *rec) {
+    while (p < end && *p == ' ') ++p;
+    if (!eat(&p, end, "[")) return false;
+    while (p < end && *p == ' ') ++p;
+    if (!eat_int(&p, end, &rec->ts_ms) || !eat(&p, end, " ms] ")) return false;
+    rec->talker = rec->peer = -1;
+    rec->duration_ms = 0;
+
+    if (eat(&p, end, "Болтун ")) {
+        if (!eat_int32(&p, end, &rec->talker)) return false;
+        if (eat(&p, end, " набирает ")) {
+            rec->type = EVT_DIAL;
+            return eat_int32(&p, end, &rec->peer);
+        }
+        if (eat(&p, end, " отвечает на звонок ")) {
+            rec->type = EVT_ANSWER;
+            return eat_int32(&p, end, &rec->peer);
+        }
+        if (eat(&p, end, " завершил разговор с ")) {
+            rec->type = EVT_FINISH;
+            return eat_int32(&p, end, &rec->peer) && eat(&p, end, " (")
+                && eat_int32(&p, end, &rec->duration_ms);
+        }
+        if (eat(&p, end, " отключился (осталось ")) {
+            rec->type = EVT_LEAVE;
+            return eat_int32(&p, end, &rec->peer);
+        }
+        rec->type = EVT_CONNECT;
+        return eat(&p, end, " подключился");
+    }
+    if (eat(&p, end, "Линия ")) {
+        rec->type = EVT_BUSY;
+        return eat_int32(&p, end, &rec->peer) && eat(&p, end, " занята для ")
+            && eat_int32(&p, end, &rec->talker);
+    }
+    if (eat(&p, end, "Разговор ")) {
+        rec->type = EVT_TALK;
+        return eat_int32(&p, end, &rec->talker) && eat(&p, end, " ↔ ")
+            && eat_int32(&p, end, &rec->peer) && eat(&p, end, " (")
+            && eat_int32(&p, end, &rec->duration_ms);
+    }
+    if (eat(&p, end, "Нет свободных линий для ")) {
+        rec->type = EVT_NO_LINE;
+        return eat_int32(&p, end, &rec->talker);
+    }
+    if (eat(&p, end, "Старт симуляции, режим: ")) {
+        size_t n = (size_t)(end - p) < sizeof(a->mode) - 1 ? (size_t)(end - p) : sizeof(a->mode) - 1;
+        memcpy(a->mode, p, n);
+        a->mode[n] = '\0';
+        rec->type = EVT_START;
+        return true;
+    }
+    if (eat(&p, end, "Последний болтун завершил работу")) {
+        rec->type = EVT_LAST;
+        return true;
+    }
+    if (eat(&p, end, "Завершение симуляции, код ")) {
+        rec->type = EVT_END;
+        return eat_int32(&p, end, &rec->peer);
+    }
+    return false;
+}
+
+static void scan_text(Analyzer *a, Mapping *map) {
+    const char *base = map->data;
+    const char *end = base + map->size;
+    const char *p = base;
+    TraceRecord rec;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+        memset(&rec, 0, sizeof(rec));
+        if (parse_line(a, p, eol, &rec)) {
+            on_event(a, &rec);
+        } else {
+            a->skipped++;
+        }
+        p = eol + 1;
+        release_behind(map, (size_t)(eol - base));
+    }
+}
+
+static bool scan_binary(Analyzer *a, Mapping *map) {
+    const TraceHeader *header = (const TraceHeader *)map->data;
+    if (header->version != TRACE_VERSION || header->record_size != sizeof(TraceRecord)) {
+        fprintf(stderr, "Неизвестный формат журнала\n");
+        return false;
+    }
+    memcpy(a->mode, header->mode, sizeof(header->mode));
+    a->mode[sizeof(header->mode)] = '\0';
+
+    const TraceRecord *records = (const TraceRecord *)(map->data + sizeof(TraceHeader));
+    size_t count = (map->size - sizeof(TraceHeader)) / sizeof(TraceRecord);
+    for (size_t i = 0; i < count; ++i) {
+        on_event(a, &records[i]);
+        if ((i & 0xffff) == 0) release_behind(map, sizeof(TraceHeader) + i * sizeof(TraceRecord));
+    }
+    return true;
+}
+
+static void report(Analyzer *a, bool per_talker, double scan_s, size_t bytes) {
+    double span_s = (double)(a->last_ts - a->first_ts) / 1000.0;
+    printf("Режим: %s, событий %llu, прочих строк %llu, битых записей %llu\n",
+           a->mode[0] ? a->mode : "?", a->events, a->skipped, a->malformed);
+    printf("Звонков %llu (%.1f/с за %.3f с), наборов %llu, занятых линий %llu (%.1f%%), без свободной линии %llu\n",
+           a->answered, span_s > 0 ? (double)a->answered / span_s : 0.0, span_s, a->dials, a->busy,
+           a->dials + a->busy ? 100.0 * (double)a->busy / (double)(a->dials + a->busy) : 0.0, a->no_line);
+    printf("Установка звонка p50/p90/p99/max %llu/%llu/%llu/%llu мс\n",
+           (unsigned long long)histogram_percentile(&a->setup_ms, 50),
+           (unsigned long long)histogram_percentile(&a->setup_ms, 90),
+           (unsigned long long)histogram_percentile(&a->setup_ms, 99),
+           (unsigned long long)atomic_load(&a->setup_ms.max));
+    printf("Длительность разговора p50/p90/p99/max %llu/%llu/%llu/%llu мс\n",
+           (unsigned long long)histogram_percentile(&a->duration_ms, 50),
+           (unsigned long long)histogram_percentile(&a->duration_ms, 90),
+           (unsigned long long)histogram_percentile(&a->duration_ms, 99),
+           (unsigned long long)atomic_load(&a->duration_ms.max));
+
+    Histogram *per = calloc(1, sizeof(Histogram));
+    unsigned long long open_calls = 0;
+    for (int i = 0; per && i < a->count; ++i) {
+        histogram_record(per, a->talkers[i].conversations);
+        if (a->talkers[i].peer >= 0) open_calls++;
+    }
+    if (per) {
+        printf("Болтунов %d, разговоров на болтуна p50/p90/max %llu/%llu/%llu, ушло %llu, не договорили к концу лога %llu\n",
+               a->count, (unsigned long long)histogram_percentile(per, 50),
+               (unsigned long long)histogram_percentile(per, 90),
+               (unsigned long long)atomic_load(&per->max), a->departures, open_calls);
+        free(per);
+    }
+    if (per_talker) {
+        for (int i = 0; i < a->count; ++i) {
+            printf("Болтун %d: разговоров %u\n", i, a->talkers[i].conversations);
+        }
+    }
+
+    if (!a->check && !multi_process(a->mode)) {
+        printf("Проверка инвариантов пропущена: лог начинается не со старта симуляции\n");
+    } else if (!a->check) {
+        printf("Проверка инвариантов пропущена: в режиме %s порядок строк между процессами не причинный\n", a->mode);
+    } else {
+        unsigned long long total = 0;
+        for (int k = 0; k < VIOL_COUNT; ++k) total += a->violations[k];
+        printf("Нарушений инвариантов: %llu\n", total);
+        for (int k = 0; k < VIOL_COUNT; ++k) {
+            if (a->violations[k]) printf("  %s: %llu\n", violation_names[k], a->violations[k]);
+        }
+    }
+    fflush(stdout);
+    fprintf(stderr, "Разобрано %.1f МБ за %.2f с (%.0f МБ/с)\n", (double)bytes / 1e6, scan_s,
+            scan_s > 0 ? (double)bytes / 1e6 / scan_s : 0.0);
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s <log|trace> [--per-talker] [--max-violations N]\n", prog);
+    printf("  --per-talker        число разговоров каждого болтуна\n");
+    printf("  --max-violations N  сколько нарушений вывести построчно (по умолчанию 20)\n");
+}
+
+int main(int argc, char **argv) {
+    const char *path = NULL;
+    bool per_talker = false;
+    static Analyzer analyzer = { .check = true, .max_report = 20 };
+    Analyzer *a = &analyzer;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--per-talker") == 0) {
+            per_talker = true;
+        } else if (strcmp(argv[i], "--max-violations") == 0 && i + 1 < argc) {
+            a->max_report = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--help") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (!path) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open log");
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        fprintf(stderr, "Пустой файл лога\n");
+        close(fd);
+        return 1;
+    }
+    Mapping map = { .size = (size_t)st.st_size };
+    map.data = mmap(NULL, map.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map.data == MAP_FAILED) {
+        perror("mmap log");
+        return 1;
+    }
+    madvise((void *)map.data, map.size, MADV_SEQUENTIAL);
+
+    struct timespec begin, end;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+    bool ok = true;
+    if (map.size >= sizeof(TraceHeader) && memcmp(map.data, TRACE_MAGIC, sizeof(((TraceHeader *)0)->magic)) == 0) {
+        ok = scan_binary(a, &map);
+    } else {
+        scan_text(a, &map);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    munmap((void *)map.data, map.size);
+    if (!ok) return 1;
+
+    double scan_s = (double)(end.tv_sec - begin.tv_sec) + (double)(end.tv_nsec - begin.tv_nsec) / 1e9;
+    report(a, per_talker, scan_s, map.size);
+    free(a->talkers);
+
+    for (int k = 0; k < VIOL_COUNT; ++k) {
+        if (a->violations[k]) return 2;
+    }
+    return 0;
+}
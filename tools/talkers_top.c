@@ -0,0 +1,154 @@
+#define _DEFAULT_SOURCE // nanosleep
+
+#include "../src/live.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Просмотр живого снимка talkers (--live-snapshot). Файл отображается
+// только на чтение и копируется по seqlock, так что просмотр не трогает
+// симуляцию. Файл переоткрывается на каждом обновлении: новый прогон
+// с тем же путём подхватывается сам.
+static const char *const state_names[] = {
+    [LIVE_IDLE] = "свободен",
+    [LIVE_DIALING] = "набирает",
+    [LIVE_TALKING] = "говорит",
+    [LIVE_LEFT] = "ушёл",
+};
+
+static volatile sig_atomic_t interrupted;
+
+static void on_signal(int signum) {
+    (void)signum;
+    interrupted = 1;
+}
+
+static void usage(const char *prog) {
+    printf("Usage: %s [snapshot] [--once] [--interval <ms>] [--rows <N>]\n", prog);
+    printf("  snapshot         файл --live-snapshot (по умолчанию outputs/live.snap)\n");
+    printf("  --once           напечатать снимок один раз и выйти\n");
+    printf("  --interval <ms>  период обновления экрана (по умолчанию 500)\n");
+    printf("  --rows <N>       сколько болтунов показывать (по умолчанию 20, 0 — всех)\n");
+}
+
+// printf выравнивает по байтам, а подписи в UTF-8: дополняем по символам.
+static void pad(const char *text, int width, bool left) {
+    int chars = 0;
+    for (const char *p = text; *p; ++p) chars += ((unsigned char)*p & 0xc0) != 0x80;
+    if (!left) printf("%*s", width > chars ? width - chars : 0, "");
+    fputs(text, stdout);
+    if (left) printf("%*s", width > chars ? width - chars : 0, "");
+}
+
+// 1 — снимок показан, 0 — прогон завершён и показан, -1 — ошибка
+static int show(const char *path, bool clear, uint32_t max_rows) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror("open snapshot");
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(LiveHeader)) {
+        fprintf(stderr, "Файл слишком мал для снимка\n");
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    const LiveHeader *shared = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) {
+        perror("mmap snapshot");
+        return -1;
+    }
+    if (memcmp(shared->magic, LIVE_MAGIC, sizeof(shared->magic)) != 0 || shared->version != LIVE_VERSION
+        || size < live_snapshot_size(shared->talkers)) {
+        fprintf(stderr, "Не снимок talkers или неподходящая версия\n");
+        munmap((void *)shared, size);
+        return -1;
+    }
+
+    uint32_t talkers = shared->talkers;
+    LiveTalker *rows = malloc((size_t)talkers * sizeof(*rows) + 1);
+    LiveHeader head;
+    if (!rows || !live_read(shared, &head, rows, talkers)) {
+        fprintf(stderr, rows ? "Снимок всё время переписывается\n" : "Недостаточно памяти\n");
+        free(rows);
+        munmap((void *)shared, size);
+        return -1;
+    }
+    munmap((void *)shared, size);
+
+    unsigned long counts[4] = { 0 };
+    unsigned long long conversations = 0;
+    for (uint32_t i = 0; i < talkers; ++i) {
+        counts[rows[i].state & 3u]++;
+        conversations += rows[i].conversations;
+    }
+    if (clear) printf("\033[H\033[J");
+    printf("talkers: режим %s, pid %d, время %lld мс, снимок #%llu%s\n", head.mode, head.pid,
+           (long long)head.updated_ms, (unsigned long long)head.publishes, head.finished ? ", завершён" : "");
+    printf("В сети %lld из %u: свободны %lu, набирают %lu, говорят %lu, ушли %lu; разговоров %llu\n\n",
+           (long long)head.active, talkers, counts[LIVE_IDLE], counts[LIVE_DIALING], counts[LIVE_TALKING],
+           counts[LIVE_LEFT], conversations);
+    uint32_t shown = max_rows && max_rows < talkers ? max_rows : talkers;
+    pad("болтун", 8, false);
+    printf("  ");
+    pad("состояние", 10, true);
+    pad("с кем", 8, false);
+    pad("разговоров", 12, false);
+    printf("\n");
+    for (uint32_t i = 0; i < shown; ++i) {
+        char peer[16] = "-";
+        if (rows[i].peer >= 0) snprintf(peer, sizeof(peer), "%d", rows[i].peer);
+        printf("%8u  ", i);
+        pad(state_names[rows[i].state & 3u], 10, true);
+        printf("%8s%12u\n", peer, rows[i].conversations);
+    }
+    if (shown < talkers) printf("... ещё %u\n", talkers - shown);
+    fflush(stdout);
+    free(rows);
+    return head.finished ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    const char *path = "outputs/live.snap";
+    bool once = false;
+    long interval_ms = 500;
+    long max_rows = 20;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--once") == 0) {
+            once = true;
+        } else if (strcmp(argv[i], "--interval") == 0 && i + 1 < argc) {
+            interval_ms = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--rows") == 0 && i + 1 < argc) {
+            max_rows = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--help") == 0) {
+            usage(argv[0]);
+            return 0;
+        } else {
+            path = argv[i];
+        }
+    }
+    if (interval_ms < 10 || max_rows < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    signal(SIGINT, on_signal);
+
+    for (;;) {
+        int rc = show(path, !once, (uint32_t)max_rows);
+        if (rc < 0) return 1;
+        if (once || rc == 0 || interrupted) return 0;
+        struct timespec pause = { interval_ms / 1000, (interval_ms % 1000) * 1000000L };
+        nanosleep(&pause, NULL);
+        if (interrupted) return 0;
+    }
+}